@@ -1,6 +1,9 @@
 #include <iostream>
+#include <memory>
 
 #include "src/Scene.hpp"
+#include "src/Scenario.hpp"
+#include "src/utils/Comm.hpp"
 #include "src/model/oil/OilMethod.hpp"
 #include "src/model/stoch_oil/StochOilMethod.hpp"
 #include "src/model/dual_stoch_oil/DualStochOilMethod.hpp"
@@ -16,98 +19,94 @@ namespace issues
 		typename typedef methodType Method;
 	};
 
-	//struct Oil : public Issue<oil::Oil, oil::OilMethod> {};
+	struct Oil : public Issue<oil::Oil, oil::OilMethod> {};
 	struct StochOil : public Issue<stoch_oil::StochOil, stoch_oil::StochOilMethod> {};
     struct DualStochOil : public Issue<dual_stoch_oil::DualStochOil, dual_stoch_oil::DualStochOilMethod> {};
 }
 
 
-void loadWells(const double x1, const double x2, const double y1, const double y2, 
-                const int num_x, const int num_y, const std::string fileName, 
-                std::vector<Well>& wells, std::vector<stoch_oil::Measurement>& conds, double visc)
+// Scene lives through consecutive scenarios of the same issue, so they share mesh and prior statistics
+template <class issueType>
+void run(std::unique_ptr<Scene<issueType>>& scene, const Config& cfg, const bool isBatch)
 {
-    const double hx = (x2 - x1) / (double)num_x;
-    const double hy = (y2 - y1) / (double)num_y;
+	typename issueType::Model::Properties props;
+	scenario::load(cfg, props, isBatch);
 
-    std::ifstream file(fileName.c_str(), std::ifstream::in);
-    std::string buf;
-    std::string::size_type sz;
-    int id;
-    double x, y, perm;
-    int id_x, id_y;
-    file >> buf;
-    while (!file.eof())
-    {
-        id = (int)(std::stod(buf, &sz));
-        file >> buf;    x = std::stod(buf, &sz);
-        file >> buf;    y = std::stod(buf, &sz);
-        file >> buf;    perm = visc * exp(std::stod(buf, &sz));
-        file >> buf;
-        id_x = 1 + (x - x1) / hx;
-        id_y = 1 + (y - y1) / hy;
-        //if (id != 17)
-        //{
-            wells.push_back(Well(id, (num_y + 2) * id_x + id_y));
-            conds.push_back({ (num_y + 2) * id_x + id_y, perm });
-        //}
-    }
-
-    file.close();
+	if (!scene)
+		scene.reset(new Scene<issueType>());
+	scene->load(props);
+	scene->start();
 }
-int main()
+// Arguments are scenario files or batch lists of them, props/scenario.ini by default
+int main(int argc, char* argv[])
 {
-    double x1 = 8402.8, x2 = 13900.0;// x2 = 13988.4;
-    double y1 = 24917.4, y2 = 29700.0;// y2 = 30242.5;
-    int num_x = 41, num_y = 41;
-
-	stoch_oil::Properties props;
-	
-	props.possible_steps_num = 2;
-	props.start_time_simple_approx = 1;
-	props.t_dim = 3600.0;
-	props.ht = props.ht_min = 100000000.0;
-	props.ht_max = 100000000.0;
-    props.hx = props.R_dim = 2100.0;// x2 - x1;
-    props.hy = 2100.0;// y2 - y1;
-    props.hz = 10.0;
-	props.num_x = num_x;
-    props.num_y = num_y;
-	int num = (props.num_x + 2) * (props.num_y + 2);
-
-	props.props_sk.p_init = props.props_sk.p_out = 275.39 * BAR_TO_PA;
-	props.props_sk.m = 0.1;
-	props.props_sk.beta = 4.E-10;
-    props.props_sk.l_f = 500.0 / 3.0;
-	props.props_sk.sigma_f = 0.5;
-    props.props_sk.perm = 100.0 * exp(props.props_sk.sigma_f * props.props_sk.sigma_f / 2.0);
-
-	props.props_oil.visc = 1.0;
-	props.props_oil.rho_stc = 887.261;
-	props.props_oil.beta = 1.0 * 1.e-9;
-	props.props_oil.p_ref = props.props_sk.p_init;
+	// Built with USE_MPI and started by mpirun, ranks split covariance sweeps, only root reports
+	comm::init(&argc, &argv);
+	if (!comm::isRoot())
+		cout.rdbuf(NULL);
 
-	props.wells.push_back(Well(0, (props.num_y + 2) * (int)(props.num_x / 2 + 1) + (int)(props.num_x / 2 + 1)));
-    //loadWells(x1, x2, y1, y2, num_x, num_y, "props/wells_gen.txt", props.wells, props.conditions, props.props_oil.visc);
-    for (auto& well1 : props.wells)
-    {
-        well1.periodsNum = 1;
-        well1.period.resize(well1.periodsNum);
-        well1.period[0] = 365.0 * 86400.0;
-        well1.rate.resize(well1.periodsNum);
-        //if(well1.id != 13)
-            well1.rate[0] = -430.0;
-        //else
-        //    well1.rate[0] = -100.0;
-        well1.pwf.resize(well1.periodsNum);
-        //well1.pwf[0] = 180.0 * BAR_TO_PA;
-        well1.leftBoundIsRate.resize(well1.periodsNum);
-        well1.leftBoundIsRate[0] = true;
-        well1.rw = 0.1;
-    }
+	std::vector<std::string> files;
+	// Unreadable batch lists count as failed scenarios
+	int done = 0, failed = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		try
+		{
+			scenario::expandBatch(argv[i], files);
+		}
+		catch (const std::exception& e)
+		{
+			cerr << e.what() << endl;
+			failed++;
+		}
+	}
+	if (argc < 2)
+		files.push_back("props/scenario.ini");
 
-	Scene<issues::StochOil> scene;
-	scene.load(props);
-	scene.start();
+	// Scenarios are run one by one: ADOL-C tapes are global to the process.
+	// Only one scene is alive at a time, it is dropped after a failure
+	std::unique_ptr<Scene<issues::Oil>> oilScene;
+	std::unique_ptr<Scene<issues::StochOil>> stochScene;
+	std::unique_ptr<Scene<issues::DualStochOil>> dualStochScene;
+	const bool isBatch = (files.size() > 1);
+	for (const auto& fileName : files)
+	{
+		cout << "Scenario " << fileName << endl;
+		try
+		{
+			Config cfg(fileName);
+			switch (scenario::getIssueType(cfg))
+			{
+			case scenario::STOCH_OIL:
+				oilScene.reset();
+				dualStochScene.reset();
+				run(stochScene, cfg, isBatch);
+				break;
+			case scenario::DUAL_STOCH_OIL:
+				oilScene.reset();
+				stochScene.reset();
+				run(dualStochScene, cfg, isBatch);
+				break;
+			case scenario::OIL:
+				stochScene.reset();
+				dualStochScene.reset();
+				run(oilScene, cfg, isBatch);
+				break;
+			}
+			done++;
+		}
+		catch (const std::exception& e)
+		{
+			cerr << e.what() << endl;
+			failed++;
+			oilScene.reset();
+			stochScene.reset();
+			dualStochScene.reset();
+		}
+	}
+	if (files.size() > 1 || failed)
+		cout << done << " of " << done + failed << " scenarios done" << endl;
 
-	return 0;
-}
\ No newline at end of file
+	comm::finalize();
+	return (failed ? 1 : 0);
+}
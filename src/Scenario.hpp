@@ -0,0 +1,363 @@
+#ifndef SCENARIO_HPP_
+#define SCENARIO_HPP_
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "src/utils/Config.hpp"
+#include "src/utils/EclipseReader.hpp"
+#include "src/utils/Comm.hpp"
+#include "src/utils/utils.h"
+#include "src/model/oil/Properties.hpp"
+#include "src/model/stoch_oil/Properties.hpp"
+#include "src/model/dual_stoch_oil/Properties.hpp"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Filling of model properties from scenario files (see props/scenario.ini).
+// Units of the file: bar, mD, cP, m3/day, days; SI values are put into properties
+namespace scenario
+{
+	enum IssueType { STOCH_OIL, DUAL_STOCH_OIL, OIL };
+
+	inline IssueType getIssueType(const Config& cfg)
+	{
+		return (IssueType)cfg.getChoice("issue", "type", { "stoch_oil", "dual_stoch_oil", "oil" });
+	};
+	// Scenario files of a batch list ([batch] scenarios = a.ini, b.ini), the file itself if it is not a list.
+	// Paths in the list are relative to the list
+	inline void expandBatch(const std::string& fileName, std::vector<std::string>& files, const int depth = 0)
+	{
+		Config cfg(fileName);
+		if (!cfg.hasSection("batch"))
+		{
+			files.push_back(fileName);
+			return;
+		}
+		if (depth > 8)
+			throw std::runtime_error(fileName + ": batch lists are nested too deep");
+		for (const auto& name : cfg.getStrings("batch", "scenarios"))
+			expandBatch(name.size() && (name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos) ?
+							name : cfg.getDir() + name, files, depth + 1);
+		cfg.checkUnused();
+	};
+
+	// Name of the file without directory and extension
+	inline std::string getStem(const std::string& fileName)
+	{
+		const size_t begin = fileName.find_last_of("/\\");
+		const std::string name = (begin == std::string::npos ? fileName : fileName.substr(begin + 1));
+		return name.substr(0, name.find_last_of('.'));
+	};
+	// Creates directory with all missing parents, returns path with trailing separator
+	inline std::string makeDir(std::string path)
+	{
+		if (path.empty())
+			return path;
+		if (path.back() != '/' && path.back() != '\\')
+			path += '/';
+		for (size_t pos = path.find_first_of("/\\", 1); pos != std::string::npos; pos = path.find_first_of("/\\", pos + 1))
+		{
+			const std::string dir = path.substr(0, pos);
+#ifdef _WIN32
+			_mkdir(dir.c_str());
+#else
+			mkdir(dir.c_str(), 0755);
+#endif
+		}
+		return path;
+	};
+
+	// Paths in a scenario are relative to its file
+	inline std::string getPath(const Config& cfg, const std::string& section, const std::string& key)
+	{
+		const std::string fileName = cfg.getString(section, key);
+		if (fileName.size() && fileName[0] != '/' && fileName[0] != '\\' && fileName.find(':') == std::string::npos)
+			return cfg.getDir() + fileName;
+		return fileName;
+	};
+
+	inline int getCellId(const int num_y, const int ix, const int iy)
+	{
+		return (num_y + 2) * ix + iy;
+	};
+	// Periods of a well from its section: periods [days], rate [m3/day], pwf [bar], control = rate | pwf
+	inline void loadSchedule(const Config& cfg, const std::string& section, Well& well)
+	{
+		const auto periods = cfg.getDoubles(section, "periods");
+		const int num = (int)periods.size();
+		if (num == 0)
+			throw std::runtime_error(cfg.getFileName() + ": [" + section + "] has no periods");
+
+		auto getList = [&](const std::string& key, const double def)
+		{
+			std::vector<double> vals = (cfg.has(section, key) ? cfg.getDoubles(section, key) : std::vector<double>(num, def));
+			if ((int)vals.size() != num)
+				throw std::runtime_error(cfg.getFileName() + ": [" + section + "] '" + key + "' needs " + std::to_string(num) + " values");
+			return vals;
+		};
+		const auto rate = getList("rate", 0.0);
+		const auto pwf = getList("pwf", 0.0);
+		std::vector<std::string> control = (cfg.has(section, "control") ? cfg.getStrings(section, "control") : std::vector<std::string>(num, "rate"));
+		if ((int)control.size() != num)
+			throw std::runtime_error(cfg.getFileName() + ": [" + section + "] 'control' needs " + std::to_string(num) + " values");
+
+		well.periodsNum = num;
+		well.period.resize(num);
+		well.rate.resize(num);
+		well.pwf.resize(num);
+		well.leftBoundIsRate.resize(num);
+		for (int p = 0; p < num; p++)
+		{
+			if (p > 0 && periods[p] <= periods[p - 1])
+				throw std::runtime_error(cfg.getFileName() + ": [" + section + "] periods have to increase");
+			if (control[p] != "rate" && control[p] != "pwf")
+				throw std::runtime_error(cfg.getFileName() + ": [" + section + "] control '" + control[p] + "' is not one of: rate, pwf");
+			well.period[p] = periods[p] * 86400.0;
+			well.rate[p] = rate[p];
+			well.pwf[p] = pwf[p] * BAR_TO_PA;
+			well.leftBoundIsRate[p] = (control[p] == "rate");
+		}
+		well.rw = cfg.getDouble(section, "rw", 0.1);
+	};
+	// Wells with measured permeability from text file of rows "id x y ln(perm / visc)" in field coordinates,
+	// region [x1, x2] x [y1, y2] is mapped onto the grid
+	template <class TMeasurement>
+	void loadWells(const double x1, const double x2, const double y1, const double y2,
+					const int num_x, const int num_y, const std::string fileName,
+					std::vector<Well>& wells, std::vector<TMeasurement>& conds, const double visc)
+	{
+		const double hx = (x2 - x1) / (double)num_x;
+		const double hy = (y2 - y1) / (double)num_y;
+
+		MappedFile file(fileName);
+		const char* p = file.begin();
+		const char* const end = file.end();
+		auto isBlank = [](const char c) { return c == ' ' || c == '\t' || c == '\r'; };
+		int line = 0;
+		while (p < end)
+		{
+			line++;
+			const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (eol == NULL)
+				eol = end;
+
+			double vals[4];
+			int num = 0;
+			for (; num < 4; num++)
+			{
+				while (p < eol && isBlank(*p))
+					p++;
+				const char* next = eclipse::parseDouble(p, eol, vals[num]);
+				if (next == p || (next < eol && !isBlank(*next)))
+					break;
+				p = next;
+			}
+			if (num == 0)
+			{
+				// Blank line
+				if (p != eol)
+					throw std::runtime_error(fileName + ":" + std::to_string(line) + ": number expected");
+			}
+			else if (num < 4)
+				throw std::runtime_error(fileName + ":" + std::to_string(line) + ": 4 columns expected");
+			else
+			{
+				const int id_x = 1 + int((vals[1] - x1) / hx);
+				const int id_y = 1 + int((vals[2] - y1) / hy);
+				if (id_x < 1 || id_x > num_x || id_y < 1 || id_y > num_y)
+					throw std::runtime_error(fileName + ":" + std::to_string(line) + ": well is out of the region");
+				const int cell_id = getCellId(num_y, id_x, id_y);
+				wells.push_back(Well((int)vals[0], cell_id));
+				conds.push_back({ cell_id, visc * exp(vals[3]) });
+			}
+			p = eol + 1;
+		}
+	};
+
+	// Grid, time steps, output, fluid, checkpoints and wells placed by grid indices, read by every issue
+	template <class TProps>
+	void loadCommon(const Config& cfg, TProps& props, const bool isBatch)
+	{
+		props.num_x = cfg.getInt("grid", "num_x");
+		props.num_y = cfg.getInt("grid", "num_y");
+		props.hx = cfg.getDouble("grid", "hx");
+		props.hy = cfg.getDouble("grid", "hy");
+		props.hz = cfg.getDouble("grid", "hz");
+		props.R_dim = cfg.getDouble("grid", "r_dim", props.hx);
+		if (props.num_x < 1 || props.num_y < 1 || props.hx <= 0.0 || props.hy <= 0.0 || props.hz <= 0.0)
+			throw std::runtime_error(cfg.getFileName() + ": [grid] sizes have to be positive");
+
+		props.t_dim = cfg.getDouble("time", "t_dim", 3600.0);
+		props.ht = cfg.getDouble("time", "ht");
+		props.ht_min = cfg.getDouble("time", "ht_min", props.ht);
+		props.ht_max = cfg.getDouble("time", "ht_max", props.ht);
+
+		props.assembly_threads = cfg.getInt("run", "assembly_threads", 0);
+		// Scenarios of a batch write into own subdirectories by default
+		props.out_dir = makeDir(cfg.getString("run", "out_dir", isBatch ? "snaps/" + getStem(cfg.getFileName()) : "snaps"));
+		// Other ranks of a distributed run keep their files apart from root
+		if (!comm::isRoot())
+			props.out_dir = makeDir(props.out_dir + "rank" + std::to_string(comm::getRank()));
+
+		auto& sk = props.props_sk;
+		sk.m = cfg.getDouble("skeleton", "m");
+		sk.beta = cfg.getDouble("skeleton", "beta");
+		sk.p_init = cfg.getDouble("skeleton", "p_init") * BAR_TO_PA;
+		sk.p_out = cfg.getDouble("skeleton", "p_out", sk.p_init / BAR_TO_PA) * BAR_TO_PA;
+
+		auto& oil = props.props_oil;
+		oil.visc = cfg.getDouble("oil", "visc");
+		oil.rho_stc = cfg.getDouble("oil", "rho_stc");
+		oil.beta = cfg.getDouble("oil", "beta");
+		oil.p_ref = cfg.getDouble("oil", "p_ref", sk.p_init / BAR_TO_PA) * BAR_TO_PA;
+
+		props.checkpoint.path = cfg.getString("checkpoint", "path", "");
+		if (!comm::isRoot() && !props.checkpoint.path.empty())
+			props.checkpoint.path += ".rank" + std::to_string(comm::getRank());
+		props.checkpoint.step_period = cfg.getInt("checkpoint", "step_period", 0);
+		props.checkpoint.time_period = cfg.getDouble("checkpoint", "time_period", 0.0);
+		props.checkpoint.restart = cfg.getBool("checkpoint", "restart", false);
+
+		// Wells placed by grid indices, 1 <= x <= num_x, 1 <= y <= num_y
+		const int wellsNum = cfg.count("well");
+		for (int w = 0; w < wellsNum; w++)
+		{
+			const std::string section = Config::indexed("well", w);
+			const int ix = cfg.getInt(section, "x");
+			const int iy = cfg.getInt(section, "y");
+			if (ix < 1 || ix > props.num_x || iy < 1 || iy > props.num_y)
+				throw std::runtime_error(cfg.getFileName() + ": [well] #" + std::to_string(w + 1) + " is out of the grid");
+			props.wells.push_back(Well(cfg.getInt(section, "id", w), getCellId(props.num_y, ix, iy)));
+			loadSchedule(cfg, section, props.wells.back());
+		}
+	};
+	// History layers, prior of the permeability field and wells with measured permeability of stochastic issues
+	template <class TProps>
+	void loadStochastic(const Config& cfg, TProps& props)
+	{
+		props.possible_steps_num = cfg.getInt("time", "possible_steps_num");
+		props.start_time_simple_approx = cfg.getInt("time", "start_time_simple_approx", 1);
+		if (props.possible_steps_num < 2)
+			throw std::runtime_error(cfg.getFileName() + ": [time] possible_steps_num has to be at least 2");
+
+		auto& sk = props.props_sk;
+		sk.sigma_f = cfg.getDouble("skeleton", "sigma_f");
+		sk.l_f = cfg.getDouble("skeleton", "l_f");
+		sk.kernel = (cov::KernelType)cfg.getChoice("skeleton", "kernel", { "gauss", "exponential", "wendland", "spherical", "tapered_gauss" }, cov::GAUSS);
+		sk.cov_radius = cfg.getDouble("skeleton", "cov_radius", 0.0);
+		// Mean permeability or the geometric one (median of lognormal field),
+		// spatially varying prior is given by grid file of num_x * num_y values (e.g. props/perm41)
+		if (cfg.has("skeleton", "perm_file"))
+		{
+			eclipse::readKeyword(getPath(cfg, "skeleton", "perm_file"), cfg.getString("skeleton", "perm_keyword", "PERMX"),
+								sk.perm_grd, props.num_x * props.num_y);
+			if (cfg.getChoice("skeleton", "perm_file_type", { "mean", "geom" }, 0) == 1)
+				for (auto& perm : sk.perm_grd)
+					perm *= exp(sk.sigma_f * sk.sigma_f / 2.0);
+		}
+		if (cfg.has("skeleton", "perm_geom"))
+			sk.perm = cfg.getDouble("skeleton", "perm_geom") * exp(sk.sigma_f * sk.sigma_f / 2.0);
+		else if (!sk.perm_grd.empty() && !cfg.has("skeleton", "perm"))
+		{
+			// Uniform value is only reported then
+			sk.perm = 0.0;
+			for (const auto& perm : sk.perm_grd)
+				sk.perm += perm / (double)sk.perm_grd.size();
+		}
+		else
+			sk.perm = cfg.getDouble("skeleton", "perm");
+
+		// Wells with measured permeability from file, all of them follow the same schedule
+		if (cfg.hasSection("wells_file"))
+		{
+			const size_t first = props.wells.size();
+			const std::string fileName = getPath(cfg, "wells_file", "file");
+			loadWells(cfg.getDouble("wells_file", "x1"), cfg.getDouble("wells_file", "x2"),
+					cfg.getDouble("wells_file", "y1"), cfg.getDouble("wells_file", "y2"),
+					props.num_x, props.num_y, fileName, props.wells, props.conditions, props.props_oil.visc);
+			for (size_t w = first; w < props.wells.size(); w++)
+				loadSchedule(cfg, "wells_file", props.wells[w]);
+		}
+	};
+	inline void loadSpecific(const Config& cfg, oil::Properties& props)
+	{
+		props.props_sk.perm = cfg.getDouble("skeleton", "perm");
+		// Two-column tables of B(p) and viscosity(p) [bar, cP] replace the closed forms
+		auto getTable = [&](const std::string& key)
+		{
+			if (!cfg.has("oil", key))
+				return std::string();
+			const std::string fileName = getPath(cfg, "oil", key);
+			if (!std::ifstream(fileName).is_open())
+				throw std::runtime_error(cfg.getFileName() + ": [oil] " + key + " " + fileName + " cannot be opened");
+			return fileName;
+		};
+		props.b_file = getTable("b_file");
+		props.visc_file = getTable("visc_file");
+		props.reference_dir = (cfg.has("run", "reference_dir") ? getPath(cfg, "run", "reference_dir") + "/" : "");
+		props.reference_tol = cfg.getDouble("run", "reference_tol", 0.0);
+	};
+	inline void loadSpecific(const Config& cfg, stoch_oil::Properties& props)
+	{
+		loadStochastic(cfg, props);
+
+		auto& sc = props.step_control;
+		sc.type = (StepControlProps::Type)cfg.getChoice("time", "step_control", { "doubling", "pid" }, StepControlProps::DOUBLING);
+		sc.p0_tol = cfg.getDouble("step_control", "p0_tol", sc.p0_tol);
+		sc.newton_target = cfg.getInt("step_control", "newton_target", sc.newton_target);
+		sc.linear_target = cfg.getInt("step_control", "linear_target", sc.linear_target);
+		sc.kP = cfg.getDouble("step_control", "kp", sc.kP);
+		sc.kI = cfg.getDouble("step_control", "ki", sc.kI);
+		sc.kD = cfg.getDouble("step_control", "kd", sc.kD);
+		sc.min_ratio = cfg.getDouble("step_control", "min_ratio", sc.min_ratio);
+		sc.max_ratio = cfg.getDouble("step_control", "max_ratio", sc.max_ratio);
+
+		props.kl_energy = cfg.getDouble("kl", "energy", 0.0);
+		props.kl_max_modes = cfg.getInt("kl", "max_modes", 0);
+
+		props.storage.mem_limit = (size_t)(cfg.getDouble("storage", "mem_limit_mb", 0.0) * 1048576.0);
+		props.storage.dir = cfg.getString("storage", "dir", props.storage.dir);
+		if (!comm::isRoot())
+			props.storage.dir = makeDir(props.storage.dir + "/rank" + std::to_string(comm::getRank()));
+		props.cf_bf16 = (cfg.getChoice("storage", "cf_precision", { "double", "bfloat16" }, 0) == 1);
+		props.reference_dir = (cfg.has("run", "reference_dir") ? getPath(cfg, "run", "reference_dir") + "/" : "");
+	};
+	inline void loadSpecific(const Config& cfg, dual_stoch_oil::Properties& props)
+	{
+		loadStochastic(cfg, props);
+
+		// Shared scenario files may carry options of the single grid issue, the dual one runs full sweeps
+		// in memory with step doubling
+		bool isIgnored = false;
+		for (const char* section : { "kl", "storage", "step_control" })
+			isIgnored |= cfg.ignore(section);
+		isIgnored |= cfg.ignore("time", "step_control");
+		isIgnored |= cfg.ignore("run", "reference_dir");
+		if (isIgnored)
+			std::cout << cfg.getFileName() << ": [kl], [storage], [step_control], [time] step_control and [run] reference_dir "
+				"are not used by dual_stoch_oil" << std::endl;
+	};
+	// Properties of the issue, keys not known to it are errors
+	template <class TProps>
+	void load(const Config& cfg, TProps& props, const bool isBatch = false)
+	{
+		loadCommon(cfg, props, isBatch);
+		loadSpecific(cfg, props);
+		if (props.wells.empty())
+			throw std::runtime_error(cfg.getFileName() + ": no wells given");
+		cfg.checkUnused();
+	};
+};
+
+#endif /* SCENARIO_HPP_ */
@@ -16,17 +16,30 @@ protected:
 	std::shared_ptr<Method> method;
 public:
 
-	Scene() {};
-	~Scene() { paralution::stop_paralution(); };
+	Scene() { paralution::init_paralution(); };
+	~Scene()
+	{
+		method.reset();
+		model.reset();
+		paralution::stop_paralution();
+	};
 
+	// Scene is loaded again for every scenario of a batch, the new model takes over
+	// what the finished one built from the same input (see Model::adopt)
 	void load(const Properties& props)
 	{
-		paralution::init_paralution();
-
+		method.reset();
+		std::shared_ptr<Model> done = model;
 		model = std::make_shared<Model>();
+		if (done)
+			model->adopt(done.get());
 		model->load(props);
+		done.reset();
 		model->setSnapshotter(model.get());
 		method = std::make_shared<Method>(model.get());
+		method->setAssemblyThreads(props.assembly_threads);
+		if (props.checkpoint.restart)
+			method->restart();
 	}
 	void start()
 	{
@@ -1,6 +1,9 @@
 #ifndef ELEM_HPP_
 #define ELEM_HPP_
 
+#include <array>
+#include <type_traits>
+
 #include "src/grid/Point.hpp"
 
 namespace elem
@@ -8,6 +11,40 @@ namespace elem
 	typedef point::Point Point;
 
 	enum Type {QUAD, BORDER, CORNER};
+
+	// Element type known at compile time, equation kernels are overloaded on it
+	template <Type T>
+	using TypeTag = std::integral_constant<Type, T>;
+	// Number of used stencil entries for the element type
+	template <Type T, int MaxStencilNum>
+	struct StencilNum : std::integral_constant<int, MaxStencilNum> {};
+	template <int MaxStencilNum>
+	struct StencilNum<BORDER, MaxStencilNum> : std::integral_constant<int, 2> {};
+	template <int MaxStencilNum>
+	struct StencilNum<CORNER, MaxStencilNum> : std::integral_constant<int, 3> {};
+
+	// Calls f(TypeTag<type>()), the only runtime branch left in the element loops.
+	// Cells are QUAD or BORDER
+	template <class Func>
+	inline auto dispatchCell(const Type type, const Func& f) -> decltype(f(TypeTag<QUAD>()))
+	{
+		if (type == QUAD)
+			return f(TypeTag<QUAD>());
+		else
+			return f(TypeTag<BORDER>());
+	};
+	// Nodes may also be CORNER
+	template <class Func>
+	inline auto dispatchNode(const Type type, const Func& f) -> decltype(f(TypeTag<QUAD>()))
+	{
+		if (type == QUAD)
+			return f(TypeTag<QUAD>());
+		else if (type == BORDER)
+			return f(TypeTag<BORDER>());
+		else
+			return f(TypeTag<CORNER>());
+	};
+
 	template <int MaxStencilNum>
 	class Element
 	{
@@ -16,14 +53,14 @@ namespace elem
 	public:
 		int id;
 		const Type type;
-		static const int getCurStencNum()
+		int getCurStencNum() const
 		{
 			if (type == QUAD)
-				return MaxStencilNum;
+				return StencilNum<QUAD, MaxStencilNum>::value;
 			else if (type == BORDER)
-				return 2;
+				return StencilNum<BORDER, MaxStencilNum>::value;
 			else if (type == CORNER)
-				return 3;
+				return StencilNum<CORNER, MaxStencilNum>::value;
             else 
                 return -1;
 		};
@@ -65,6 +102,24 @@ namespace elem
         Node(const int _id, const Type _type) : Element(_id, _type) {};
         Node(const int _id, const Type _type, const Point _cent) : Element(_id, _type), cent(_cent) {};
     };
+
+	// Block row of sparse matrix pattern for the element: VarSize x VarSize block per used stencil entry.
+	// Trip counts are compile-time constants, returns the number of written entries
+	template <int VarSize, Type T, int MaxStencilNum>
+	inline int fillBlockRow(TypeTag<T>, const Element<MaxStencilNum>& el, int* ind_i, int* ind_j)
+	{
+		const int stencilNum = StencilNum<T, MaxStencilNum>::value;
+		int counter = 0;
+		for (int i = 0; i < VarSize; i++)
+			for (int k = 0; k < stencilNum; k++)
+				for (int j = 0; j < VarSize; j++)
+				{
+					ind_i[counter] = VarSize * el.id + i;
+					ind_j[counter] = VarSize * el.stencil[k] + j;
+					counter++;
+				}
+		return counter;
+	};
 };
 
 #endif /* ELEM_HPP_ */
@@ -0,0 +1,83 @@
+#ifndef GRIDTRANSFER_HPP_
+#define GRIDTRANSFER_HPP_
+
+#include <vector>
+
+#include "src/grid/Mesh.hpp"
+
+namespace mesh
+{
+	// Sparse transfer operator between cell and node grids in CSR form
+	struct TransferOperator
+	{
+		int rows, cols;
+		std::vector<int> offset, col;
+		std::vector<double> val;
+
+		TransferOperator() : rows(0), cols(0) {};
+
+		// y = A x
+		inline void apply(const double* x, double* y) const
+		{
+			for (int i = 0; i < rows; i++)
+			{
+				double s = 0.0;
+				for (int k = offset[i]; k < offset[i + 1]; k++)
+					s += val[k] * x[col[k]];
+				y[i] = s;
+			}
+		};
+		// Y = A X A^T for dense X of size cols x cols, Y is rows x rows
+		inline void applySym(const std::vector<std::vector<double>>& X, std::vector<std::vector<double>>& Y) const
+		{
+			// T = A X, then Y = T A^T row by row
+			std::vector<double> T((size_t)rows * cols, 0.0);
+			for (int i = 0; i < rows; i++)
+				for (int k = offset[i]; k < offset[i + 1]; k++)
+				{
+					const double w = val[k];
+					const auto& x_row = X[col[k]];
+					double* t_row = &T[(size_t)i * cols];
+					for (int j = 0; j < cols; j++)
+						t_row[j] += w * x_row[j];
+				}
+			for (int i = 0; i < rows; i++)
+			{
+				const double* t_row = &T[(size_t)i * cols];
+				auto& y_row = Y[i];
+				for (int j = 0; j < rows; j++)
+				{
+					double s = 0.0;
+					for (int k = offset[j]; k < offset[j + 1]; k++)
+						s += val[k] * t_row[col[k]];
+					y_row[j] = s;
+				}
+			}
+		};
+	};
+
+	// Node value is the mean of four cells sharing the node (border cells included)
+	inline TransferOperator buildProlongation(const CellRectangularUniformGrid& cells, const NodeRectangularUniformGrid& nodes)
+	{
+		TransferOperator op;
+		op.rows = nodes.num;	op.cols = cells.num;
+		op.offset.reserve(op.rows + 1);
+		op.col.reserve(4 * op.rows);		op.val.reserve(4 * op.rows);
+		op.offset.push_back(0);
+		for (int i = 0; i < op.rows; i++)
+		{
+			const int ind_x = i / (nodes.num_y + 1);
+			const int ind_y = i % (nodes.num_y + 1);
+			const int id = ind_x * (cells.num_y + 2) + ind_y;
+			for (const int c : { id, id + 1, id + cells.num_y + 2, id + cells.num_y + 3 })
+			{
+				op.col.push_back(c);
+				op.val.push_back(0.25);
+			}
+			op.offset.push_back(op.col.size());
+		}
+		return op;
+	};
+};
+
+#endif /* GRIDTRANSFER_HPP_ */
@@ -10,7 +10,6 @@ namespace mesh
 	class CellRectangularUniformGrid
 	{
 		template<typename> friend class snapshotter::VTKSnapshotter;
-		template<typename> friend class AbstractMethod;
 	public:
 		typedef elem::Quad Cell;
 		static const int stencil = 5;
@@ -76,7 +75,6 @@ namespace mesh
     class NodeRectangularUniformGrid
     {
         template<typename> friend class snapshotter::VTKSnapshotter;
-        template<typename> friend class AbstractMethod;
     public:
         typedef elem::DualQuad Node;
         static const int stencil = 5;
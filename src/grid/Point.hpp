@@ -4,7 +4,7 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
-#include <new>
+#include <type_traits>
 
 #include "adolc/drivers/drivers.h"
 #include "adolc/adolc.h"
@@ -13,40 +13,15 @@
 
 namespace point
 {
-	enum PointType { INNER, BORDER };
+	// Plain coordinates only: trivially copyable, so geometry math stays in registers.
+	// Connectivity is kept by mesh elements
 	struct Point
 	{
-		PointType type;
-		const int id;
-		union
-		{
-			double coords[3];
-			struct
-			{
-				double x;	double y;	double z;
-			};
-		};
-		std::vector<int> cells;
+		double x;	double y;	double z;
+
+		Point() = default;
+		constexpr Point(const double _x, const double _y, const double _z) : x(_x), y(_y), z(_z) {};
 
-		Point() : id(-1), type(INNER) {};
-		Point(const double _x, const double _y, const double _z) : id(-1), x(_x), y(_y), z(_z), type(INNER) { };
-		Point(const int _id, const double _x, const double _y, const double _z) : id(_id), x(_x), y(_y), z(_z), type(INNER) { };
-		Point(const int _id, const double _x, const double _y, const double _z, const std::vector<int>& _cells) : Point(_id, _x, _y, _z)
-		{
-			this->cells = _cells;
-		};
-		~Point() {};
-		Point(const Point& a) : id(a.id)
-		{
-			(*this) = a;
-		};
-		Point& operator=(const Point& rhs)
-		{
-			x = rhs.x, y = rhs.y, z = rhs.z;
-			cells = rhs.cells;
-			type = rhs.type;
-			return *this;
-		};
 		Point& operator/=(const double k)
 		{
 			x /= k;	y /= k;	z /= k;
@@ -60,10 +35,13 @@ namespace point
 		Point& operator-=(const Point& rhs)
 		{
 			x -= rhs.x;	y -= rhs.y;	z -= rhs.z;
+			return *this;
 		};
 
 		inline double norm() const { return sqrt(x * x + y * y + z * z); };
 	};
+	static_assert(std::is_pod<Point>::value, "Point has to stay POD");
+
 	inline std::ostream& operator<<(std::ostream& os, const Point& a)
 	{
 		os << a.x << " " << a.y << " " << a.z << std::endl;
@@ -78,48 +56,48 @@ namespace point
 		else
 			return true;
 	};
-	inline Point operator-(const Point& rhs)
+	constexpr Point operator-(const Point& rhs)
 	{
 		return Point(-rhs.x, -rhs.y, -rhs.z);
 	};
-	inline Point operator-(const Point& a1, const Point& a2)
+	constexpr Point operator-(const Point& a1, const Point& a2)
 	{
 		return Point(a1.x - a2.x, a1.y - a2.y, a1.z - a2.z);
 	};
-	inline Point operator+(const Point& rhs)
+	constexpr Point operator+(const Point& rhs)
 	{
 		return Point(rhs.x, rhs.y, rhs.z);
 	};
-	inline Point operator+(const Point& a1, const Point& a2)
+	constexpr Point operator+(const Point& a1, const Point& a2)
 	{
 		return Point(a1.x + a2.x, a1.y + a2.y, a1.z + a2.z);
 	};
-	inline Point operator*(const Point& a1, double k)
+	constexpr Point operator*(const Point& a1, double k)
 	{
 		return Point(a1.x * k, a1.y * k, a1.z * k);
 	};
-	inline Point operator*(double k, const Point& a1)
+	constexpr Point operator*(double k, const Point& a1)
 	{
 		return a1 * k;
 	};
-	inline Point operator/(const Point& a1, double k)
+	constexpr Point operator/(const Point& a1, double k)
 	{
 		return Point(a1.x / k, a1.y / k, a1.z / k);
 	};
-	inline Point operator/(const Point& a1, const Point& a2)
+	constexpr Point operator/(const Point& a1, const Point& a2)
 	{
 		return Point(a1.x / a2.x, a1.y / a2.y, a1.z / a2.z);
 	};
-	inline Point operator*(const Point& a1, const Point& a2)
+	constexpr Point operator*(const Point& a1, const Point& a2)
 	{
 		return Point(a1.x * a2.x, a1.y * a2.y, a1.z * a2.z);
 	};
 
-	inline double dot_product(const Point& a1, const Point& a2)
+	constexpr double dot_product(const Point& a1, const Point& a2)
 	{
 		return a1.x * a2.x + a1.y * a2.y + a1.z * a2.z;
 	};
-	inline Point vector_product(const Point& a1, const Point& a2)
+	constexpr Point vector_product(const Point& a1, const Point& a2)
 	{
 		return{ a1.y * a2.z - a1.z * a2.y,
 			a1.z * a2.x - a1.x * a2.z,
@@ -127,7 +105,8 @@ namespace point
 	};
 	inline double distance(const Point& a1, const Point& a2)
 	{
-		return sqrt(dot_product(a2 - a1, a2 - a1));
+		const double dx = a2.x - a1.x, dy = a2.y - a1.y, dz = a2.z - a1.z;
+		return sqrt(dx * dx + dy * dy + dz * dz);
 	};
 	inline double square(const Point& a1, const Point& a2, const Point& a3)
 	{
@@ -4,9 +4,17 @@
 #include <valarray>
 #include <array>
 #include "adolc/adouble.h"
+#include "src/utils/MappedField.hpp"
 
 namespace var
 {
+	// Storage type of N^2 covariance fields
+#ifdef STOCH_COV_FLOAT
+	typedef float cov_t;
+#else
+	typedef double cov_t;
+#endif
+
 	namespace containers
 	{
 		struct DummyStruct {};
@@ -103,9 +111,12 @@ namespace var
 
 		//typedef StochVarWrapper<TVariable0,TVariable1,TVariable2,TVariable3> Wrap;
 		std::valarray<double> p0_prev, p0_iter, p0_next, p2_prev, p2_iter, p2_next;
-		std::valarray<std::valarray<double>> Cfp;
-		double* Cfp_next, *Cfp_prev;
-		std::valarray<std::valarray<double>> Cp_prev, Cp_next;								
+		MappedField<cov_t> Cfp;
+		cov_t* Cfp_next, *Cfp_prev;
+		MappedField<cov_t> Cp_prev, Cp_next;
+		// First-order pressure responses to Karhunen-Loeve modes of log-permeability
+		std::valarray<std::valarray<double>> p1_kl;
+		double* p1_kl_next, *p1_kl_prev;
 		/*Wrap operator[](const size_t idx)
 		{
 			return{ TVariable0(&u_prev0[idx * size0]), TVariable0(&u_iter0[idx * size0]), TVariable0(&u_next0[idx * size0]),
@@ -1,210 +1,223 @@
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <chrono>
+#include <csignal>
 
 #include "src/model/AbstractMethod.hpp"
+#include "src/utils/Comm.hpp"
 
 #include "src/model/oil/Oil.hpp"
 #include "src/model/stoch_oil/StochOil.hpp"
 #include "src/model/dual_stoch_oil/DualStochOil.hpp"
 
+#include "adolc/sparse/sparsedrivers.h"
+#include "adolc/drivers/drivers.h"
+
 using namespace std;
 
-template <class modelType>
-AbstractMethod<modelType>::AbstractMethod(modelType* _model) : model(_model), mesh(_model->getMesh()), 
-	size(_model->getCellsNum()), Tt(model->wells.back().period[model->wells.back().periodsNum - 1])
+// Last caught signal: SIGINT/SIGTERM - write checkpoint and stop, SIGUSR1 - write checkpoint and continue
+static volatile std::sig_atomic_t checkpoint_signal = 0;
+static void onCheckpointSignal(int sig)
+{
+	checkpoint_signal = sig;
+}
+static double getWallTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+MethodDriver<modelType, GridPolicy, MomentPolicy>::MethodDriver(modelType* _model) : GridPolicy<modelType>(_model), Tt(_model->schedule.getEndTime())
 {
 	cur_t = cur_t_log = 0.0;
 	curTimePeriod = 0;
+	step_idx = 0;
 
-	t_dim = model->t_dim;
+	t_dim = this->model->t_dim;
 	repeat = 0;
+
+	col = offset = NULL;
+	dmat = NULL;
+	avoidMatrixCalc = false;
+
+	stepsWallTime = 0.0;
+	stepsDone = 0;
+
+	isRestarted = false;
+	stepsSinceCheckpoint = 0;
+	lastCheckpointTime = getWallTime();
+	checkpoint.setPath(this->model->checkpoint_props.path);
+	if (checkpoint.isEnabled())
+	{
+		signal(SIGINT, onCheckpointSignal);
+		signal(SIGTERM, onCheckpointSignal);
+#ifdef SIGUSR1
+		signal(SIGUSR1, onCheckpointSignal);
+#endif
+	}
 }
-template <class modelType>
-AbstractMethod<modelType>::~AbstractMethod()
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+MethodDriver<modelType, GridPolicy, MomentPolicy>::~MethodDriver()
 {
+	ParSolver::freeInvert(offset, col, dmat);
 }
-template <class modelType>
-void AbstractMethod<modelType>::start()
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+void MethodDriver<modelType, GridPolicy, MomentPolicy>::start()
 {
-	int counter = 0;
+	if (!isRestarted)
+		step_idx = 0;
 
+	prepare();
+
+	auto& model = this->model;
 	model->setPeriod(curTimePeriod);
 	while (cur_t < Tt)
 	{
 		control();
-		model->snapshot_all(counter++);
+		// Ranks of a distributed run hold the same fields, root writes them
+		if (comm::isRoot())
+			model->snapshot_all(step_idx);
+		step_idx++;
+		onStepBegin();
+		const double t0 = getWallTime();
 		doNextStep();
 		copyTimeLayer();
+		onStepEnd(getWallTime() - t0);
 		cout << "---------------------NEW TIME STEP---------------------" << endl;
 		cout << setprecision(6);
 		cout << "time = " << cur_t << endl;
+		if (checkpointIfNeeded())
+			return;
 	}
-	model->snapshot_all(counter++);
+	if (comm::isRoot())
+		model->snapshot_all(step_idx);
 	writeData();
+	if (stepsDone > 0)
+		cout << "Steps: " << stepsDone << ", wall time: " << stepsWallTime << " s, per step: " << stepsWallTime / stepsDone << " s" << endl;
 }
-template <class modelType>
-void AbstractMethod<modelType>::doNextStep()
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+void MethodDriver<modelType, GridPolicy, MomentPolicy>::doNextStep()
 {
 	solveStep();
 }
-
-template <class modelType>
-void AbstractMethod<modelType>::copyIterLayer()
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+void MethodDriver<modelType, GridPolicy, MomentPolicy>::onStepEnd(const double wallTime)
 {
-	model->u_iter = model->u_next;
+	stepsWallTime += wallTime;
+	stepsDone++;
+	cout << "step wall time = " << wallTime << " s" << endl;
 }
-template <class modelType>
-void AbstractMethod<modelType>::copyTimeLayer()
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+void MethodDriver<modelType, GridPolicy, MomentPolicy>::saveState()
 {
-	model->u_prev = model->u_iter = model->u_next;
+	checkpoint.add("cur_t", &cur_t, sizeof(cur_t));
+	checkpoint.add("curTimePeriod", &curTimePeriod, sizeof(curTimePeriod));
+	checkpoint.add("step_idx", &step_idx, sizeof(step_idx));
+	this->model->saveState(checkpoint);
 }
-void AbstractMethod<stoch_oil::StochOil>::copyIterLayer()
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+void MethodDriver<modelType, GridPolicy, MomentPolicy>::loadState()
 {
+	checkpoint.get("cur_t", &cur_t, sizeof(cur_t));
+	checkpoint.get("curTimePeriod", &curTimePeriod, sizeof(curTimePeriod));
+	checkpoint.get("step_idx", &step_idx, sizeof(step_idx));
+	this->model->loadState(checkpoint);
 }
-void AbstractMethod<stoch_oil::StochOil>::copyTimeLayer()
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+bool MethodDriver<modelType, GridPolicy, MomentPolicy>::checkpointIfNeeded()
 {
-}
+	if (!checkpoint.isEnabled())
+		return false;
 
-template <class modelType>
-double AbstractMethod<modelType>::convergance(int& ind, int& varInd)
-{
-	double relErr = 0.0;
-	double cur_relErr = 0.0;
+	stepsSinceCheckpoint++;
+	const int sig = checkpoint_signal;
+	checkpoint_signal = 0;
+	const auto& props = this->model->checkpoint_props;
+	const double now = getWallTime();
+	const bool isDue = (sig != 0 || (props.step_period > 0 && stepsSinceCheckpoint >= props.step_period) ||
+					(props.time_period > 0.0 && now - lastCheckpointTime >= props.time_period));
+	// Ranks write and stop together, whichever of them has got the signal or run out of time
+	const double action = comm::maxAll(sig == SIGINT || sig == SIGTERM ? 2.0 : (isDue ? 1.0 : 0.0));
+	if (action == 0.0)
+		return false;
 
-	varInd = 0;
-	auto diff = std::abs((model->u_next - model->u_iter) / model->u_next);
-	auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-	ind = std::distance(std::begin(diff), max_iter);
+	saveState();
+	const size_t bytes = checkpoint.commit();
+	cout << "Checkpoint #" << checkpoint.getGeneration() << ": " << bytes / 1048576.0 << " MB written in " <<
+		getWallTime() - now << " s" << endl;
+	stepsSinceCheckpoint = 0;
+	lastCheckpointTime = getWallTime();
 
-	return *max_iter;
+	return (action == 2.0);
 }
-template <class modelType>
-void AbstractMethod<modelType>::averValue(std::array<double, var_size>& aver)
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+bool MethodDriver<modelType, GridPolicy, MomentPolicy>::restart()
 {
-	std::fill(aver.begin(), aver.end(), 0.0);
+	if (!checkpoint.isEnabled())
+		return false;
 
-	for (int i = 0; i < var_size; i++)
+	loadState();
+	isRestarted = checkpoint.load();
+	if (!isRestarted)
+		cout << "No valid checkpoint found at " << this->model->checkpoint_props.path << ", starting from scratch" << endl;
+	return isRestarted;
+}
+
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+void MethodDriver<modelType, GridPolicy, MomentPolicy>::evalJacobian(TapeJacobian& jac, const int n, const double* x, ParSolver& solver)
+{
+	sparse_jac(jac.tag, n, n, jac.repeat, const_cast<double*>(x), &jac.nnz, &jac.ind_i, &jac.ind_j, &jac.a, options);
+	if (jac.repeat == 0)
 	{
-		const auto var = static_cast<std::valarray<double>>(model->u_next[std::slice(i, model->cellsNum, var_size)]);
-		int cell_idx = 0;
-		for (const auto& cell : mesh->cells)
-			aver[i] += var[cell_idx++] * cell.V;
+		solver.MapEntries(jac.ind_i, jac.ind_j, jac.nnz, jac.slots);
+		jac.repeat = 1;
 	}
-	for (auto& val : aver)
-		val /= mesh->V;
+	solver.ScatterValues(jac.slots, jac.a);
 }
-double AbstractMethod<stoch_oil::StochOil>::convergance(int& ind, int& varInd)
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+bool MethodDriver<modelType, GridPolicy, MomentPolicy>::evalTape(const TapeJacobian& jac, const int n, const double* x, double* y) const
+{
+	return zos_forward(jac.tag, n, n, 0, x, y) >= 0;
+}
+
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+double MethodDriver<modelType, GridPolicy, MomentPolicy>::convergance(int& ind, int& varInd)
 {
+	const auto& next = MomentPolicy::next(this->model);
+	const auto& iter = MomentPolicy::iter(this->model);
 	double relErr = 0.0;
 	double cur_relErr = 0.0;
 
 	varInd = 0;
-	auto diff = std::abs((model->p0_next - model->p0_iter) / model->p0_next);
-	auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-	ind = std::distance(std::begin(diff), max_iter);
-
-	return *max_iter;
+	ind = 0;
+	for (int i = 0; i < next.size(); i++)
+	{
+		cur_relErr = fabs((next[i] - iter[i]) / next[i]);
+		if (cur_relErr > relErr)
+		{
+			relErr = cur_relErr;
+			ind = i;
+		}
+	}
+	return relErr;
 }
-void AbstractMethod<stoch_oil::StochOil>::averValue(std::array<double, var_size>& aver)
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+void MethodDriver<modelType, GridPolicy, MomentPolicy>::averValue(std::array<double, var_size>& aver)
 {
+	const auto& next = MomentPolicy::next(this->model);
 	std::fill(aver.begin(), aver.end(), 0.0);
 
 	for (int i = 0; i < var_size; i++)
 	{
-		const auto var = static_cast<std::valarray<double>>(model->p0_next[std::slice(i, model->cellsNum, var_size)]);
 		int cell_idx = 0;
-		for (const auto& cell : mesh->cells)
-			aver[i] += var[cell_idx++] * cell.V;
+		for (const auto& cell : this->mesh->cells)
+			aver[i] += next[var_size * cell_idx++ + i] * cell.V;
 	}
 	for (auto& val : aver)
-		val /= mesh->V;
-}
-
-template <class modelType>
-AbstractDualGridMethod<modelType>::AbstractDualGridMethod(modelType* _model) : model(_model), cell_mesh(_model->getCellMesh()), node_mesh(_model->getNodeMesh()),
-cells_size(_model->getCellsNum()), nodes_size(_model->getNodesNum()), Tt(model->wells.back().period[model->wells.back().periodsNum - 1])
-{
-    cur_t = cur_t_log = 0.0;
-    curTimePeriod = 0;
-
-    t_dim = model->t_dim;
-    repeat = 0;
-}
-template <class modelType>
-AbstractDualGridMethod<modelType>::~AbstractDualGridMethod()
-{
-}
-template <class modelType>
-void AbstractDualGridMethod<modelType>::start()
-{
-    int counter = 0;
-
-    model->setPeriod(curTimePeriod);
-    while (cur_t < Tt)
-    {
-        control();
-        model->snapshot_all(counter++);
-        doNextStep();
-        copyTimeLayer();
-        cout << "---------------------NEW TIME STEP---------------------" << endl;
-        cout << setprecision(6);
-        cout << "time = " << cur_t << endl;
-    }
-    model->snapshot_all(counter++);
-    writeData();
-}
-template <class modelType>
-void AbstractDualGridMethod<modelType>::doNextStep()
-{
-    solveStep();
-}
-
-template <class modelType>
-void AbstractDualGridMethod<modelType>::copyIterLayer()
-{
-    model->u_iter = model->u_next;
-}
-template <class modelType>
-void AbstractDualGridMethod<modelType>::copyTimeLayer()
-{
-    model->u_prev = model->u_iter = model->u_next;
-}
-void AbstractDualGridMethod<dual_stoch_oil::DualStochOil>::copyIterLayer()
-{   
-}
-void AbstractDualGridMethod<dual_stoch_oil::DualStochOil>::copyTimeLayer()
-{
-}
-
-template <class modelType>
-double AbstractDualGridMethod<modelType>::convergance(int& ind, int& varInd)
-{
-    double relErr = 0.0;
-    double cur_relErr = 0.0;
-
-    varInd = 0;
-    auto diff = std::abs((model->p0_next - model->p0_iter) / model->p0_next);
-    auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-    ind = std::distance(std::begin(diff), max_iter);
-
-    return *max_iter;
-}
-template <class modelType>
-void AbstractDualGridMethod<modelType>::averValue(std::array<double, var_size>& aver)
-{
-    std::fill(aver.begin(), aver.end(), 0.0);
-
-    for (int i = 0; i < var_size; i++)
-    {
-        const auto var = static_cast<std::valarray<double>>(model->p0_next[std::slice(i, model->cellsNum, var_size)]);
-        int cell_idx = 0;
-        for (const auto& cell : cell_mesh->cells)
-            aver[i] += var[cell_idx++] * cell.V;
-    }
-    for (auto& val : aver)
-        val /= cell_mesh->V;
+		val /= this->mesh->V;
 }
 
-template class AbstractMethod<stoch_oil::StochOil>;
-template class AbstractDualGridMethod<dual_stoch_oil::DualStochOil>;
\ No newline at end of file
+template class MethodDriver<oil::Oil, SingleGridPolicy, DeterministicMoments>;
+template class MethodDriver<stoch_oil::StochOil, SingleGridPolicy, StochasticMoments>;
+template class MethodDriver<dual_stoch_oil::DualStochOil, DualGridPolicy, StochasticMoments>;
\ No newline at end of file
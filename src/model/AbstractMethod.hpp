@@ -6,9 +6,44 @@
 #include <iostream>
 #include <array>
 #include <vector>
+#include <cstdlib>
+
+#include "src/model/MethodPolicy.hpp"
+#include "src/utils/Checkpoint.hpp"
+#include "src/utils/Workspace.hpp"
+#include "src/utils/NewtonUpdate.hpp"
+#include "src/utils/ParalutionInterface.h"
+
+// Sparse Jacobian of one ADOL-C tape: triplets allocated by ADOL-C and their slots in pinned CSR of the solver.
+// Sparsity found by the first sparse_jac is reused (repeat = 1) until the tape is recorded again
+struct TapeJacobian
+{
+	const short tag;
+	unsigned int* ind_i;
+	unsigned int* ind_j;
+	double* a;
+	int nnz;
+	int repeat;
+	std::vector<int> slots;
+
+	TapeJacobian(const short _tag) : tag(_tag), ind_i(NULL), ind_j(NULL), a(NULL), nnz(0), repeat(0) {};
+	~TapeJacobian()
+	{
+		free(ind_i);	free(ind_j);	free(a);
+	};
+	TapeJacobian(const TapeJacobian&) = delete;
+	TapeJacobian& operator=(const TapeJacobian&) = delete;
+	// ADOL-C drops stored sparsity of a tag when it is traced again
+	inline void retaped() { repeat = 0; };
+};
 
-template <class modelType>
-class AbstractMethod {
+// Time integration driver of all methods.
+// GridPolicy gives meshes and stencils (SingleGridPolicy / DualGridPolicy),
+// MomentPolicy gives the mean field of Newton loops (DeterministicMoments / StochasticMoments).
+// Step loop, checkpoints, instrumentation and solver caches live here once for every model
+template <class modelType, template <class> class GridPolicy, class MomentPolicy>
+class MethodDriver : public GridPolicy<modelType>
+{
 public:
 	typedef modelType Model;
 	typedef typename Model::Mesh Mesh;
@@ -16,89 +51,73 @@ public:
 	static const int var_size = Model::var_size;
 protected:
 	double t_dim;
-	const size_t size;
-
-	Model* model;
-	Mesh* mesh;
 
 	size_t curTimePeriod;
 	const double Tt;
 	double cur_t, cur_t_log;
+	// Number of time layers passed
+	int step_idx;
 
-	virtual void copyIterLayer();
-	virtual void copyTimeLayer();
+	virtual void copyIterLayer() { MomentPolicy::copyIterLayer(this->model); };
+	virtual void copyTimeLayer() { MomentPolicy::copyTimeLayer(this->model); };
 
 	double convergance(int& ind, int& varInd);
 	void averValue(std::array<double, var_size>& aver);
 
 	virtual void writeData() = 0;
 	virtual void control() = 0;
+	// Patterns of matrices and solvers set up before the first step
+	virtual void prepare() {};
 	virtual void doNextStep();
 	virtual void solveStep() = 0;
 
-	inline void getMatrixStencil(Cell& cell)
+	// Instrumentation hooks around every step, wall time of step is given after it
+	virtual void onStepBegin() {};
+	virtual void onStepEnd(const double wallTime);
+	double stepsWallTime;
+	int stepsDone;
+
+	// Checkpointing
+	Checkpoint checkpoint;
+	bool isRestarted;
+	int stepsSinceCheckpoint;
+	double lastCheckpointTime;
+	// Register chunks of the state for writing / reading
+	virtual void saveState();
+	virtual void loadState();
+	// Writes checkpoint if it is time or if signal came, returns true if run has to be stopped
+	bool checkpointIfNeeded();
+
+	// Owner of work buffers of derived methods
+	Workspace workspace;
+
+	// x += dx over cells with max relative change and volume average of x found in the same pass.
+	// One streaming pass is memory bound, so it runs serially and touches no heap
+	inline newton::UpdateStats applyNewtonUpdate(double* x, const double* dx)
 	{
-		const size_t ind_x = int(cell.id / (mesh->num_y + 2));
-		const size_t ind_y = cell.id % (mesh->num_y + 2);
-		cell.stencil[0] = cell.id;
-
-		const double k1 = model->getGeomPerm(cell);
-		double k2;
+		auto res = newton::applyUpdate(x, dx, &this->cellV[0], 0, (int)this->cellV.size());
+		res.volSum /= this->model->Volume;
+		return res;
+	};
 
-		if (cell.type == elem::BORDER)
-		{
-			if (ind_y == 0)
-			{
-				cell.stencil[1] = cell.id + 1;
-				const Cell& beta = mesh->cells[cell.stencil[1]];
-				k2 = model->getGeomPerm(beta);
-				cell.trans[0] = k1 * k2 * (cell.hy + beta.hy) / (k1 * beta.hy + k2 * cell.hy);
-			}
-			else if (ind_y == mesh->num_y + 1)
-			{
-				cell.stencil[1] = cell.id - 1;
-				const Cell& beta = mesh->cells[cell.stencil[1]];
-				k2 = model->getGeomPerm(beta);
-				cell.trans[0] = k1 * k2 * (cell.hy + beta.hy) / (k1 * beta.hy + k2 * cell.hy);
-			}
-			if (ind_x == 0)
-			{
-				cell.stencil[1] = cell.id + mesh->num_y + 2;
-				const Cell& beta = mesh->cells[cell.stencil[1]];
-				k2 = model->getGeomPerm(beta);
-				cell.trans[0] = k1 * k2 * (cell.hx + beta.hx) / (k1 * beta.hx + k2 * cell.hx);
-			}
-			else if (ind_x == mesh->num_x + 1)
-			{
-				cell.stencil[1] = cell.id - mesh->num_y - 2;
-				const Cell& beta = mesh->cells[cell.stencil[1]];
-				k2 = model->getGeomPerm(beta);
-				cell.trans[0] = k1 * k2 * (cell.hx + beta.hx) / (k1 * beta.hx + k2 * cell.hx);
-			}
-		}
-		else
+	// Dense inverse of the covariance Jacobian, reused by all columns within a time step
+	double* dmat;
+	int* offset;
+	int* col;
+	bool avoidMatrixCalc;
+	inline void buildInvert(ParSolver& solver)
+	{
+		if (!avoidMatrixCalc)
 		{
-			cell.stencil[1] = cell.id - 1;
-			const Cell& beta1 = mesh->cells[cell.stencil[1]];
-			k2 = model->getGeomPerm(beta1);
-			cell.trans[0] = k1 * k2 * (cell.hy + beta1.hy) / (k1 * beta1.hy + k2 * cell.hy);
-			
-            cell.stencil[2] = cell.id + 1;
-			const Cell& beta2 = mesh->cells[cell.stencil[2]];
-			k2 = model->getGeomPerm(beta2);
-			cell.trans[1] = k1 * k2 * (cell.hy + beta2.hy) / (k1 * beta2.hy + k2 * cell.hy);
-			
-            cell.stencil[3] = cell.id - mesh->num_y - 2;
-			const Cell& beta3 = mesh->cells[cell.stencil[3]];
-			k2 = model->getGeomPerm(beta3);
-			cell.trans[2] = k1 * k2 * (cell.hx + beta3.hx) / (k1 * beta3.hx + k2 * cell.hx);
-			
-            cell.stencil[4] = cell.id + mesh->num_y + 2;
-			const Cell& beta4 = mesh->cells[cell.stencil[4]];
-			k2 = model->getGeomPerm(beta4);
-			cell.trans[3] = k1 * k2 * (cell.hx + beta4.hx) / (k1 * beta4.hx + k2 * cell.hx);
+			solver.getInvert(offset, col, dmat);
+			avoidMatrixCalc = true;
 		}
 	};
+	inline void releaseInvert()
+	{
+		ParSolver::freeInvert(offset, col, dmat);
+		avoidMatrixCalc = false;
+	};
 
 	double** jac;
 	double* y;
@@ -113,257 +132,29 @@ protected:
 
 	int options[4];
 	int repeat;
-
+	// Jacobian of the tape at x scattered into values of the solver, slots are mapped after every new sparsity
+	void evalJacobian(TapeJacobian& jac, const int n, const double* x, ParSolver& solver);
+	// Residual of the tape at x without tracing, false if the control flow differs from the recorded one
+	bool evalTape(const TapeJacobian& jac, const int n, const double* x, double* y) const;
 public:
-	AbstractMethod(modelType* _model);
-	virtual ~AbstractMethod();
+	MethodDriver(modelType* _model);
+	virtual ~MethodDriver();
 
-	virtual void fill() {};
-	void fillIndices()
+	// Restores state from the newest valid checkpoint
+	virtual bool restart();
+	// Number of assembly threads (0 - hardware concurrency), their workers live as long as the method
+	void setAssemblyThreads(const int threadsNum)
 	{
-		int counter = 0;
-
-		for (int i = 0; i < model->varNum; i++)
-		{
-			auto& cell = mesh->cells[i];
-			getMatrixStencil(cell);
-			
-			for (size_t i = 0; i < var_size; i++)
-				for (const int idx : cell.stencil)
-					for (size_t j = 0; j < var_size; j++)
-					{
-						ind_i[counter] = var_size * cell.id + i;			ind_j[counter++] = var_size * idx + j;
-					}
-		}
-
-		elemNum = counter;
-
-		for (int i = 0; i < var_size * model->cellsNum; i++)
-			ind_rhs[i] = i;
+		this->buildPartitions(threadsNum);
+		std::cout << "Assembly: " << this->partition.getThreadsNum() << " threads" << std::endl;
 	};
+	virtual void fill() {};
 	virtual void start();
 };
 
-template <class modelType>
-class AbstractDualGridMethod {
-public:
-    typedef modelType Model;
-    typedef typename Model::CellMesh CellMesh;
-    typedef typename Model::NodeMesh NodeMesh;
-    typedef typename Model::Cell Cell;
-    typedef typename Model::Node Node;
-    static const int var_size = Model::var_size;
-protected:
-    double t_dim;
-    const size_t cells_size, nodes_size;
-
-    Model* model;
-    CellMesh* cell_mesh;
-    NodeMesh* node_mesh;
-
-    size_t curTimePeriod;
-    const double Tt;
-    double cur_t, cur_t_log;
-
-    virtual void copyIterLayer();
-    virtual void copyTimeLayer();
-
-    double convergance(int& ind, int& varInd);
-    void averValue(std::array<double, var_size>& aver);
-
-    virtual void writeData() = 0;
-    virtual void control() = 0;
-    virtual void doNextStep();
-    virtual void solveStep() = 0;
-
-    inline void getCellMatrixStencil(Cell& cell)
-    {
-        const size_t ind_x = int(cell.id / (cell_mesh->num_y + 2));
-        const size_t ind_y = cell.id % (cell_mesh->num_y + 2);
-        cell.stencil[0] = cell.id;
-
-        const double k1 = model->getGeomPerm(cell);
-        double k2;
-
-        if (cell.type == elem::BORDER)
-        {
-            if (ind_y == 0)
-            {
-                cell.stencil[1] = cell.id + 1;
-                const Cell& beta = cell_mesh->cells[cell.stencil[1]];
-                k2 = model->getGeomPerm(beta);
-                cell.trans[0] = k1 * k2 * (cell.hy + beta.hy) / (k1 * beta.hy + k2 * cell.hy);
-            }
-            else if (ind_y == cell_mesh->num_y + 1)
-            {
-                cell.stencil[1] = cell.id - 1;
-                const Cell& beta = cell_mesh->cells[cell.stencil[1]];
-                k2 = model->getGeomPerm(beta);
-                cell.trans[0] = k1 * k2 * (cell.hy + beta.hy) / (k1 * beta.hy + k2 * cell.hy);
-            }
-            if (ind_x == 0)
-            {
-                cell.stencil[1] = cell.id + cell_mesh->num_y + 2;
-                const Cell& beta = cell_mesh->cells[cell.stencil[1]];
-                k2 = model->getGeomPerm(beta);
-                cell.trans[0] = k1 * k2 * (cell.hx + beta.hx) / (k1 * beta.hx + k2 * cell.hx);
-            }
-            else if (ind_x == cell_mesh->num_x + 1)
-            {
-                cell.stencil[1] = cell.id - cell_mesh->num_y - 2;
-                const Cell& beta = cell_mesh->cells[cell.stencil[1]];
-                k2 = model->getGeomPerm(beta);
-                cell.trans[0] = k1 * k2 * (cell.hx + beta.hx) / (k1 * beta.hx + k2 * cell.hx);
-            }
-        }
-        else
-        {
-            cell.stencil[1] = cell.id - 1;
-            const Cell& beta1 = cell_mesh->cells[cell.stencil[1]];
-            k2 = model->getGeomPerm(beta1);
-            cell.trans[0] = k1 * k2 * (cell.hy + beta1.hy) / (k1 * beta1.hy + k2 * cell.hy);
-
-            cell.stencil[2] = cell.id + 1;
-            const Cell& beta2 = cell_mesh->cells[cell.stencil[2]];
-            k2 = model->getGeomPerm(beta2);
-            cell.trans[1] = k1 * k2 * (cell.hy + beta2.hy) / (k1 * beta2.hy + k2 * cell.hy);
-
-            cell.stencil[3] = cell.id - cell_mesh->num_y - 2;
-            const Cell& beta3 = cell_mesh->cells[cell.stencil[3]];
-            k2 = model->getGeomPerm(beta3);
-            cell.trans[2] = k1 * k2 * (cell.hx + beta3.hx) / (k1 * beta3.hx + k2 * cell.hx);
-
-            cell.stencil[4] = cell.id + cell_mesh->num_y + 2;
-            const Cell& beta4 = cell_mesh->cells[cell.stencil[4]];
-            k2 = model->getGeomPerm(beta4);
-            cell.trans[3] = k1 * k2 * (cell.hx + beta4.hx) / (k1 * beta4.hx + k2 * cell.hx);
-        }
-    };
-    inline void getNodeMatrixStencil(Node& node)
-    {
-        const auto& mesh = node_mesh;
-        const size_t ind_x = int(node.id / (mesh->num_y + 1));
-        const size_t ind_y = node.id % (mesh->num_y + 1);
-        node.stencil[0] = node.id;
-        double k1, k2;
-
-        if (node.type == elem::CORNER)
-        { 
-            if (ind_y == 0 && ind_x == 0)
-            {
-                node.stencil[1] = node.id + 1;
-                node.stencil[2] = node.id + mesh->num_y + 1;
-                const Cell& beta = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
-                k1 = model->getGeomPerm(beta);
-                node.trans[0] = node.trans[1] = k1;
-            }
-            else if (ind_y == mesh->num_y && ind_x == 0)
-            {
-                node.stencil[1] = node.id - 1;
-                node.stencil[2] = node.id + mesh->num_y + 1;
-                const Cell& beta = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
-                node.trans[0] = node.trans[1] = model->getGeomPerm(beta);
-            }
-            else if (ind_y == 0 && ind_x == mesh->num_x)
-            {
-                node.stencil[1] = node.id + 1;
-                node.stencil[2] = node.id - mesh->num_y - 1;
-                const Cell& beta = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
-                node.trans[0] = node.trans[1] = model->getGeomPerm(beta);
-            }
-            else if (ind_y == mesh->num_y && ind_x == mesh->num_x)
-            {
-                node.stencil[1] = node.id - 1;
-                node.stencil[2] = node.id - mesh->num_y - 1;
-                const Cell& beta = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
-                node.trans[0] = node.trans[1] = model->getGeomPerm(beta);
-            }
-        }
-        else if (node.type == elem::BORDER)
-        {
-
-            if (ind_y == 0)
-            {
-                node.stencil[1] = node.id + 1;
-                const Cell& beta1 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
-                const Cell& beta2 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
-                k1 = model->getGeomPerm(beta1);     k2 = model->getGeomPerm(beta2);
-                node.trans[0] = (k1 * beta1.hx + k2 * beta2.hx) / (beta1.hx + beta2.hx);
-            }
-            else if (ind_y == mesh->num_y)
-            {
-                node.stencil[1] = node.id - 1;
-                const Cell& beta1 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
-                const Cell& beta2 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
-                k1 = model->getGeomPerm(beta1);     k2 = model->getGeomPerm(beta2);
-                node.trans[0] = (k1 * beta1.hx + k2 * beta2.hx) / (beta1.hx + beta2.hx);
-            }
-            if (ind_x == 0)
-            {
-                node.stencil[1] = node.id + mesh->num_y + 1;
-                const Cell& beta1 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
-                const Cell& beta2 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
-                k1 = model->getGeomPerm(beta1);     k2 = model->getGeomPerm(beta2);
-                node.trans[0] = (k1 * beta1.hy + k2 * beta2.hy) / (beta1.hy + beta2.hy);
-            }
-            else if (ind_x == mesh->num_x)
-            {
-                node.stencil[1] = node.id - mesh->num_y - 1;
-                const Cell& beta1 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
-                const Cell& beta2 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
-                k1 = model->getGeomPerm(beta1);     k2 = model->getGeomPerm(beta2);
-                node.trans[0] = (k1 * beta1.hy + k2 * beta2.hy) / (beta1.hy + beta2.hy);
-            }
-        }
-        else if (node.type == elem::QUAD)
-        {
-            node.stencil[1] = node.id - 1;
-            const Cell& beta11 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
-            const Cell& beta12 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
-            k1 = model->getGeomPerm(beta11);     k2 = model->getGeomPerm(beta12);
-            node.trans[0] = (k1 * beta11.hx + k2 * beta12.hx) / (beta11.hx + beta12.hx);
-
-            node.stencil[2] = node.id + 1;
-            const Cell& beta21 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
-            const Cell& beta22 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
-            k1 = model->getGeomPerm(beta21);     k2 = model->getGeomPerm(beta22);
-            node.trans[1] = (k1 * beta21.hx + k2 * beta22.hx) / (beta21.hx + beta22.hx);
-
-            node.stencil[3] = node.id - mesh->num_y - 1;
-            const Cell& beta31 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
-            const Cell& beta32 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
-            k1 = model->getGeomPerm(beta31);     k2 = model->getGeomPerm(beta32);
-            node.trans[2] = (k1 * beta31.hy + k2 * beta32.hy) / (beta31.hy + beta32.hy);
-
-            node.stencil[4] = node.id + mesh->num_y + 1;
-            const Cell& beta41 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
-            const Cell& beta42 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
-            k1 = model->getGeomPerm(beta41);     k2 = model->getGeomPerm(beta42);
-            node.trans[3] = (k1 * beta41.hy + k2 * beta42.hy) / (beta41.hy + beta42.hy);
-        }
-    };
-
-    double** jac;
-    double* y;
-    int* ind_i;
-    int* ind_j;
-    double* a;
-    int* ind_rhs;
-    double* rhs;
-    int* cols;
-    // Number of non-zero elements in sparse matrix
-    int elemNum;
-
-    int options[4];
-    int repeat;
-
-public:
-    AbstractDualGridMethod(modelType* _model);
-    virtual ~AbstractDualGridMethod();
-
-    virtual void fill() {};
-    virtual void start();
-};
-
+template <class modelType, class MomentPolicy = StochasticMoments>
+using AbstractMethod = MethodDriver<modelType, SingleGridPolicy, MomentPolicy>;
+template <class modelType, class MomentPolicy = StochasticMoments>
+using AbstractDualGridMethod = MethodDriver<modelType, DualGridPolicy, MomentPolicy>;
 
-#endif /* ABSTRACTMETHOD_HPP_ */
\ No newline at end of file
+#endif /* ABSTRACTMETHOD_HPP_ */
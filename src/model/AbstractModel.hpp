@@ -8,11 +8,17 @@
 
 #include "src/utils/VTKSnapshotter.hpp"
 #include "src/Well.hpp"
+#include "src/utils/Schedule.hpp"
 #include "src/grid/Variables.hpp"
 
 #include "adolc/drivers/drivers.h"
 #include "adolc/adolc.h"
 
+// Methods driving models, see src/model/AbstractMethod.hpp
+template <class modelType> class CellGridPolicy;
+template <class modelType> class DualGridPolicy;
+template <class modelType, template <class> class GridPolicy, class MomentPolicy> class MethodDriver;
+
 template <typename propsType,
 			class MeshType,
 			class modelType,
@@ -21,7 +27,9 @@ template <typename propsType,
 class AbstractModel : public TVariables<TVarContainer>
 {
 	template<typename> friend class snapshotter::VTKSnapshotter;
-	template<typename> friend class AbstractMethod;
+	template<typename> friend class ::CellGridPolicy;
+	template<typename> friend class ::DualGridPolicy;
+	template<class, template <class> class, class> friend class ::MethodDriver;
 public:
 	typedef TVarContainer VarContainer;
 	typedef TVariables<TVarContainer> Variables;
@@ -44,6 +52,8 @@ protected:
 
 	// Rate of the well
 	std::vector<Well> wells;
+	// Events of all wells merged
+	Schedule schedule;
 
 	// Temporary properties
 	double ht;
@@ -54,6 +64,8 @@ protected:
 	// BHP will be converted to the depth
 	double depth_point;
 	// During the time flow rate decreases 'e' times in well test [sec] 
+	// Directory of snapshots and plots with trailing separator
+	std::string out_dir;
 
 	adouble linearInterp1d(const adouble a1, const double r1, const adouble a2, const double r2) const
 	{
@@ -63,7 +75,7 @@ protected:
 	virtual void makeDimLess() = 0;
 	virtual void setInitialState() = 0;
 public:
-	AbstractModel()
+	AbstractModel() : out_dir("snaps/")
 	{
 		grav = 9.8;
 	};
@@ -81,8 +93,12 @@ public:
 	void load(const Properties& props)
 	{
 		setProps(props);
+		schedule.build(wells);
 		setInitialState();
 	};
+	// Data built from input only may be taken over from a finished model of the same batch, called before load()
+	virtual void adopt(modelType* done) {};
+	const std::string& getOutDir() const { return out_dir; };
 	virtual void setPeriod(const int period) = 0;
 	virtual void setWellborePeriod(int period, double cur_t) {};
 	int getCellsNum() { return cellsNum; };
@@ -110,7 +126,9 @@ template <typename propsType,
     class AbstractDualGridModel : public TVariables<TVarContainer>
 {
     template<typename> friend class snapshotter::VTKSnapshotter;
-    template<typename> friend class AbstractMethod;
+    template<typename> friend class ::CellGridPolicy;
+    template<typename> friend class ::DualGridPolicy;
+    template<class, template <class> class, class> friend class ::MethodDriver;
 public:
     typedef TVarContainer VarContainer;
     typedef TVariables<TVarContainer> Variables;
@@ -137,6 +155,8 @@ protected:
 
     // Rate of the well
     std::vector<Well> wells;
+    // Events of all wells merged
+    Schedule schedule;
      
     // Temporary properties
     double ht;
@@ -147,6 +167,8 @@ protected:
     // BHP will be converted to the depth
     double depth_point;
     // During the time flow rate decreases 'e' times in well test [sec] 
+    // Directory of snapshots and plots with trailing separator
+    std::string out_dir;
 
     adouble linearInterp1d(const adouble a1, const double r1, const adouble a2, const double r2) const
     {
@@ -156,7 +178,7 @@ protected:
     virtual void makeDimLess() = 0;
     virtual void setInitialState() = 0;
 public:
-    AbstractDualGridModel()
+    AbstractDualGridModel() : out_dir("snaps/")
     {
         grav = 9.8;
     };
@@ -174,8 +196,12 @@ public:
     void load(const Properties& props)
     {
         setProps(props);
+        schedule.build(wells);
         setInitialState();
     };
+    // Data built from input only may be taken over from a finished model of the same batch, called before load()
+    virtual void adopt(modelType* done) {};
+    const std::string& getOutDir() const { return out_dir; };
     virtual void setPeriod(const int period) = 0;
     virtual void setWellborePeriod(int period, double cur_t) {};
     int getCellsNum() { return cellsNum; };
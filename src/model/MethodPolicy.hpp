@@ -0,0 +1,270 @@
+#ifndef METHODPOLICY_HPP_
+#define METHODPOLICY_HPP_
+
+#include <vector>
+#include <valarray>
+
+#include "src/utils/RowPartition.hpp"
+#include "src/grid/Elem.hpp"
+
+// Grid policies of MethodDriver: meshes, sizes, strips of grid rows and stencil builders.
+// Cell grid part is shared by single and dual grid methods
+template <class modelType>
+class CellGridPolicy
+{
+public:
+	typedef modelType Model;
+	typedef typename Model::Mesh Mesh;
+	typedef typename Model::Cell Cell;
+protected:
+	Model* model;
+	Mesh* mesh;
+	const size_t size;
+
+	// Strips of cell grid rows assembled by separate threads
+	RowPartition partition;
+	// Cell volumes in id order
+	std::vector<double> cellV;
+
+	CellGridPolicy(Model* _model, Mesh* _mesh) : model(_model), mesh(_mesh), size(_model->getCellsNum())
+	{
+		partition.build(size, mesh->num_y + 2, 1);
+		cellV.resize(size);
+		for (size_t i = 0; i < size; i++)
+			cellV[i] = mesh->cells[i].V;
+	};
+	void buildPartitions(const int threadsNum)
+	{
+		partition.build(size, mesh->num_y + 2, threadsNum);
+		partition.startWorkers();
+	};
+
+	inline void getMatrixStencil(Cell& cell)
+	{
+		const size_t ind_x = int(cell.id / (mesh->num_y + 2));
+		const size_t ind_y = cell.id % (mesh->num_y + 2);
+		cell.stencil[0] = cell.id;
+
+		const double k1 = model->getGeomPerm(cell);
+		double k2;
+
+		if (cell.type == elem::BORDER)
+		{
+			if (ind_y == 0)
+			{
+				cell.stencil[1] = cell.id + 1;
+				const Cell& beta = mesh->cells[cell.stencil[1]];
+				k2 = model->getGeomPerm(beta);
+				cell.trans[0] = k1 * k2 * (cell.hy + beta.hy) / (k1 * beta.hy + k2 * cell.hy);
+			}
+			else if (ind_y == mesh->num_y + 1)
+			{
+				cell.stencil[1] = cell.id - 1;
+				const Cell& beta = mesh->cells[cell.stencil[1]];
+				k2 = model->getGeomPerm(beta);
+				cell.trans[0] = k1 * k2 * (cell.hy + beta.hy) / (k1 * beta.hy + k2 * cell.hy);
+			}
+			if (ind_x == 0)
+			{
+				cell.stencil[1] = cell.id + mesh->num_y + 2;
+				const Cell& beta = mesh->cells[cell.stencil[1]];
+				k2 = model->getGeomPerm(beta);
+				cell.trans[0] = k1 * k2 * (cell.hx + beta.hx) / (k1 * beta.hx + k2 * cell.hx);
+			}
+			else if (ind_x == mesh->num_x + 1)
+			{
+				cell.stencil[1] = cell.id - mesh->num_y - 2;
+				const Cell& beta = mesh->cells[cell.stencil[1]];
+				k2 = model->getGeomPerm(beta);
+				cell.trans[0] = k1 * k2 * (cell.hx + beta.hx) / (k1 * beta.hx + k2 * cell.hx);
+			}
+		}
+		else
+		{
+			cell.stencil[1] = cell.id - 1;
+			const Cell& beta1 = mesh->cells[cell.stencil[1]];
+			k2 = model->getGeomPerm(beta1);
+			cell.trans[0] = k1 * k2 * (cell.hy + beta1.hy) / (k1 * beta1.hy + k2 * cell.hy);
+			
+            cell.stencil[2] = cell.id + 1;
+			const Cell& beta2 = mesh->cells[cell.stencil[2]];
+			k2 = model->getGeomPerm(beta2);
+			cell.trans[1] = k1 * k2 * (cell.hy + beta2.hy) / (k1 * beta2.hy + k2 * cell.hy);
+			
+            cell.stencil[3] = cell.id - mesh->num_y - 2;
+			const Cell& beta3 = mesh->cells[cell.stencil[3]];
+			k2 = model->getGeomPerm(beta3);
+			cell.trans[2] = k1 * k2 * (cell.hx + beta3.hx) / (k1 * beta3.hx + k2 * cell.hx);
+			
+            cell.stencil[4] = cell.id + mesh->num_y + 2;
+			const Cell& beta4 = mesh->cells[cell.stencil[4]];
+			k2 = model->getGeomPerm(beta4);
+			cell.trans[3] = k1 * k2 * (cell.hx + beta4.hx) / (k1 * beta4.hx + k2 * cell.hx);
+		}
+	};
+};
+
+template <class modelType>
+class SingleGridPolicy : public CellGridPolicy<modelType>
+{
+protected:
+	SingleGridPolicy(modelType* _model) : CellGridPolicy<modelType>(_model, _model->getMesh()) {};
+};
+
+template <class modelType>
+class DualGridPolicy : public CellGridPolicy<modelType>
+{
+public:
+	typedef typename modelType::NodeMesh NodeMesh;
+	typedef typename modelType::Node Node;
+protected:
+	NodeMesh* node_mesh;
+	const size_t nodes_size;
+	// Strips of node grid rows
+	RowPartition node_partition;
+
+	DualGridPolicy(modelType* _model) : CellGridPolicy<modelType>(_model, _model->getCellMesh()),
+		node_mesh(_model->getNodeMesh()), nodes_size(_model->getNodesNum())
+	{
+		node_partition.build(nodes_size, node_mesh->num_y + 1, 1);
+	};
+	void buildPartitions(const int threadsNum)
+	{
+		CellGridPolicy<modelType>::buildPartitions(threadsNum);
+		// Own workers: node sweep runs alongside the cell one
+		node_partition.build(nodes_size, node_mesh->num_y + 1, threadsNum);
+		node_partition.startWorkers();
+	};
+
+	// Geometric permeability of cells, exp is taken once per cell instead of per node face
+	std::vector<double> cellGeomPerm;
+	inline void cacheCellGeomPerm()
+	{
+		cellGeomPerm.resize(this->size);
+		for (size_t i = 0; i < this->size; i++)
+			cellGeomPerm[i] = this->model->getGeomPerm(this->mesh->cells[i]);
+	};
+	inline void getNodeMatrixStencil(Node& node)
+	{
+		const auto& mesh = node_mesh;
+		const auto& cell_mesh = this->mesh;
+		const size_t ind_x = int(node.id / (mesh->num_y + 1));
+		const size_t ind_y = node.id % (mesh->num_y + 1);
+		node.stencil[0] = node.id;
+		double k1, k2;
+
+		if (node.type == elem::CORNER)
+		{ 
+			if (ind_y == 0 && ind_x == 0)
+			{
+				node.stencil[1] = node.id + 1;
+				node.stencil[2] = node.id + mesh->num_y + 1;
+				const Cell& beta = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
+				k1 = cellGeomPerm[beta.id];
+				node.trans[0] = node.trans[1] = k1;
+			}
+			else if (ind_y == mesh->num_y && ind_x == 0)
+			{
+				node.stencil[1] = node.id - 1;
+				node.stencil[2] = node.id + mesh->num_y + 1;
+				const Cell& beta = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
+				node.trans[0] = node.trans[1] = cellGeomPerm[beta.id];
+			}
+			else if (ind_y == 0 && ind_x == mesh->num_x)
+			{
+				node.stencil[1] = node.id + 1;
+				node.stencil[2] = node.id - mesh->num_y - 1;
+				const Cell& beta = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
+				node.trans[0] = node.trans[1] = cellGeomPerm[beta.id];
+			}
+			else if (ind_y == mesh->num_y && ind_x == mesh->num_x)
+			{
+				node.stencil[1] = node.id - 1;
+				node.stencil[2] = node.id - mesh->num_y - 1;
+				const Cell& beta = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
+				node.trans[0] = node.trans[1] = cellGeomPerm[beta.id];
+			}
+		}
+		else if (node.type == elem::BORDER)
+		{
+
+			if (ind_y == 0)
+			{
+				node.stencil[1] = node.id + 1;
+				const Cell& beta1 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
+				const Cell& beta2 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
+				k1 = cellGeomPerm[beta1.id];     k2 = cellGeomPerm[beta2.id];
+				node.trans[0] = (k1 * beta1.hx + k2 * beta2.hx) / (beta1.hx + beta2.hx);
+			}
+			else if (ind_y == mesh->num_y)
+			{
+				node.stencil[1] = node.id - 1;
+				const Cell& beta1 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
+				const Cell& beta2 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
+				k1 = cellGeomPerm[beta1.id];     k2 = cellGeomPerm[beta2.id];
+				node.trans[0] = (k1 * beta1.hx + k2 * beta2.hx) / (beta1.hx + beta2.hx);
+			}
+			if (ind_x == 0)
+			{
+				node.stencil[1] = node.id + mesh->num_y + 1;
+				const Cell& beta1 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
+				const Cell& beta2 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
+				k1 = cellGeomPerm[beta1.id];     k2 = cellGeomPerm[beta2.id];
+				node.trans[0] = (k1 * beta1.hy + k2 * beta2.hy) / (beta1.hy + beta2.hy);
+			}
+			else if (ind_x == mesh->num_x)
+			{
+				node.stencil[1] = node.id - mesh->num_y - 1;
+				const Cell& beta1 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
+				const Cell& beta2 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
+				k1 = cellGeomPerm[beta1.id];     k2 = cellGeomPerm[beta2.id];
+				node.trans[0] = (k1 * beta1.hy + k2 * beta2.hy) / (beta1.hy + beta2.hy);
+			}
+		}
+		else if (node.type == elem::QUAD)
+		{
+			node.stencil[1] = node.id - 1;
+			const Cell& beta11 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
+			const Cell& beta12 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
+			k1 = cellGeomPerm[beta11.id];     k2 = cellGeomPerm[beta12.id];
+			node.trans[0] = (k1 * beta11.hx + k2 * beta12.hx) / (beta11.hx + beta12.hx);
+
+			node.stencil[2] = node.id + 1;
+			const Cell& beta21 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
+			const Cell& beta22 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
+			k1 = cellGeomPerm[beta21.id];     k2 = cellGeomPerm[beta22.id];
+			node.trans[1] = (k1 * beta21.hx + k2 * beta22.hx) / (beta21.hx + beta22.hx);
+
+			node.stencil[3] = node.id - mesh->num_y - 1;
+			const Cell& beta31 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y];
+			const Cell& beta32 = cell_mesh->cells[ind_x * (cell_mesh->num_y + 2) + ind_y + 1];
+			k1 = cellGeomPerm[beta31.id];     k2 = cellGeomPerm[beta32.id];
+			node.trans[2] = (k1 * beta31.hy + k2 * beta32.hy) / (beta31.hy + beta32.hy);
+
+			node.stencil[4] = node.id + mesh->num_y + 1;
+			const Cell& beta41 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y];
+			const Cell& beta42 = cell_mesh->cells[(ind_x + 1) * (cell_mesh->num_y + 2) + ind_y + 1];
+			k1 = cellGeomPerm[beta41.id];     k2 = cellGeomPerm[beta42.id];
+			node.trans[3] = (k1 * beta41.hy + k2 * beta42.hy) / (beta41.hy + beta42.hy);
+		}
+	};
+};
+
+// Moment policies of MethodDriver: the mean field checked and averaged in Newton loops
+struct DeterministicMoments
+{
+	template <class Model> static std::valarray<double>& next(Model* model) { return model->u_next; };
+	template <class Model> static std::valarray<double>& iter(Model* model) { return model->u_iter; };
+	template <class Model> static void copyIterLayer(Model* model) { model->u_iter = model->u_next; };
+	template <class Model> static void copyTimeLayer(Model* model) { model->u_prev = model->u_iter = model->u_next; };
+};
+// Mean pressure p0, time layers of all moments are advanced by methods themselves
+struct StochasticMoments
+{
+	template <class Model> static std::valarray<double>& next(Model* model) { return model->p0_next; };
+	template <class Model> static std::valarray<double>& iter(Model* model) { return model->p0_iter; };
+	template <class Model> static void copyIterLayer(Model* model) {};
+	template <class Model> static void copyTimeLayer(Model* model) {};
+};
+
+#endif /* METHODPOLICY_HPP_ */
@@ -1,6 +1,9 @@
 #include "src/model/dual_stoch_oil/DualStochOil.hpp"
+#include "src/utils/CovFill.hpp"
 
 #include <valarray>
+#include <algorithm>
+#include <stdexcept>
 
 #include <assert.h>
 #include <boost/math/special_functions/expint.hpp>
@@ -13,25 +16,14 @@ using boost::math::expint;
 DualStochOil::DualStochOil()
 {
     inv_cond_cov = NULL;
+    cov_threads = 0;
 }
 DualStochOil::~DualStochOil()
 {
-	delete[] x_cell, h_cell, x_node, h_node;
-}
-void DualStochOil::loadPermAvg(const std::string fileName)
-{
-    std::ifstream file(fileName.c_str(), std::ifstream::in);
-    std::string buf;
-    std::string::size_type sz;
-    while(buf != "PERMX")
-        file >> buf;
-    file >> buf;
-    while (buf != "/")
-    {
-        props_sk.perm_grd.push_back(MilliDarcyToM2(std::stod(buf, &sz)));
-        file >> buf;
-    }
-    file.close();
+	delete[] x_cell;
+	delete[] h_cell;
+	delete[] x_node;
+	delete[] h_node;
 }
 void DualStochOil::writeCPS(const int i)
 {
@@ -51,7 +43,7 @@ void DualStochOil::writeCPS(const int i)
     };
     auto writePres = [&](const int i)
     {
-        const std::string filename = "snaps/Pres_" + std::to_string(i) + ".cps";
+        const std::string filename = out_dir + "Pres_" + std::to_string(i) + ".cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -73,7 +65,7 @@ void DualStochOil::writeCPS(const int i)
     };
     auto writePresStd = [&](const int i)
     {
-        const std::string filename = "snaps/Pres_std_" + std::to_string(i) + ".cps";
+        const std::string filename = out_dir + "Pres_std_" + std::to_string(i) + ".cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -95,7 +87,7 @@ void DualStochOil::writeCPS(const int i)
     };
     auto writePerm = [&]()
     {
-        const std::string filename = "snaps/Perm.cps";
+        const std::string filename = out_dir + "Perm.cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -117,7 +109,7 @@ void DualStochOil::writeCPS(const int i)
     };
     auto writePermStd = [&]()
     {
-        const std::string filename = "snaps/Perm_std.cps";
+        const std::string filename = out_dir + "Perm_std.cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -142,7 +134,7 @@ void DualStochOil::writeCPS(const int i)
     };
     auto writeGeomPerm = [&]()
     {
-        const std::string filename = "snaps/Perm_geom.cps";
+        const std::string filename = out_dir + "Perm_geom.cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -175,11 +167,14 @@ void DualStochOil::writeCPS(const int i)
 }
 void DualStochOil::setProps(const Properties& props)
 {
+	if (!props.out_dir.empty())
+		out_dir = props.out_dir;
 	R_dim = props.R_dim;
 	t_dim = props.t_dim;
 	Q_dim = R_dim * R_dim * R_dim / t_dim;
 
 	possible_steps_num = props.possible_steps_num;
+	last_period = -1;
 	start_time_simple_approx = props.start_time_simple_approx;
 	ht = props.ht;
 	ht_min = props.ht_min;
@@ -187,7 +182,11 @@ void DualStochOil::setProps(const Properties& props)
 
 	props_sk = props.props_sk;
 	props_sk.perm = MilliDarcyToM2(props_sk.perm);
-    //loadPermAvg("props/perm41");
+	if (!props_sk.perm_grd.empty() && props_sk.perm_grd.size() != (size_t)(props.num_x * props.num_y))
+		throw std::runtime_error("Permeability grid has " + std::to_string(props_sk.perm_grd.size()) + " values, " +
+									std::to_string(props.num_x * props.num_y) + " expected");
+	for (auto& perm : props_sk.perm_grd)
+		perm = MilliDarcyToM2(perm);
 
 	props_oil = props.props_oil;
 	props_oil.visc = cPToPaSec(props_oil.visc);
@@ -200,6 +199,7 @@ void DualStochOil::setProps(const Properties& props)
 	for (auto& well : wells)
 		for (auto& rate : well.rate)
 			rate /= 86400.0;
+    checkpoint_props = props.checkpoint;
 
 	cell_mesh = std::make_shared<CellMesh>(*new CellMesh(props.num_x, props.num_y, props.hx / R_dim, props.hy / R_dim, props.hz / R_dim));
 	Volume = cell_mesh.get()->V;
@@ -207,6 +207,9 @@ void DualStochOil::setProps(const Properties& props)
 
     node_mesh = std::make_shared<NodeMesh>(*new NodeMesh(props.num_x, props.num_y, props.hx / R_dim, props.hy / R_dim, props.hz / R_dim));
     nodesNum = node_mesh.get()->num;
+    toNodes = mesh::buildProlongation(*cell_mesh, *node_mesh);
+    p0_nodes_prev.resize(nodesNum);
+    p0_nodes_next.resize(nodesNum);
 
 	p0_prev.resize(cellsNum);	
 	p0_iter.resize(cellsNum);	
@@ -239,6 +242,8 @@ void DualStochOil::setProps(const Properties& props)
     h_node = new adouble[nodesNum];
 
 	makeDimLess();
+    kernel = cov::Kernel(props_sk.kernel, props_sk.sigma_f, props_sk.l_f, props_sk.cov_radius);
+    cov_threads = props.assembly_threads;
 }
 void DualStochOil::makeDimLess()
 {
@@ -253,6 +258,7 @@ void DualStochOil::makeDimLess()
 	props_sk.perm /= R_dim * R_dim;
 	props_sk.beta /= (1.0 / P_dim);
 	props_sk.l_f /= R_dim;
+	props_sk.cov_radius /= R_dim;
     for (auto& perm : props_sk.perm_grd)
         perm /= R_dim * R_dim;
 
@@ -288,26 +294,23 @@ void DualStochOil::setInitialState()
         Cp_prev_node[i] = Cp_next_node[i] = 0.0;
     }
 
+    calculatePermPrior();
     Favg_cells.resize(cellsNum, 0.0);   Favg_nodes.resize(nodesNum, 0.0);
-    Cf_cells.resize(cellsNum);          Cf_nodes.resize(nodesNum);
-    std::for_each(Cf_cells.begin(), Cf_cells.end(), [&](std::vector<double>& vec) { vec.resize(cellsNum, 0.0); });
+    Cf_nodes.resize(nodesNum);
     std::for_each(Cf_nodes.begin(), Cf_nodes.end(), [&](std::vector<double>& vec) { vec.resize(nodesNum, 0.0); });
+    std::vector<point::Point> cent(cellsNum);
     for (int i = 0; i < cellsNum; i++)
     {
         const Cell& cell1 = cell_mesh->cells[i];
         Favg_cells[i] = getFavg_prior(cell1);
-        for (int j = 0; j < cellsNum; j++)
-            Cf_cells[i][j] = getCf_prior(cell1, cell_mesh->cells[j]);
-    }
-    for (int i = 0; i < nodesNum; i++)
-    {
-        const Node& node1 = node_mesh->nodes[i];
-        Favg_nodes[i] = getFavg_prior(node1);
-        for (int j = 0; j < nodesNum; j++)
-            Cf_nodes[i][j] = getCf_prior(node1, node_mesh->nodes[j]);
+        cent[i] = cell1.cent;
     }
+    const double err = cov::fillDense(kernel, cent, Cf_cells, cov_threads);
+    std::cout << "Cf fill: max deviation from exact kernel = " << err << std::endl;
     // Conditioning
     calculateConditioning();
+    calculateNodeStats();
+    calculateKg();
 
     // WI calculation
     for (auto& well : wells)
@@ -317,16 +320,83 @@ void DualStochOil::setInitialState()
         well.WI = 2.0 * M_PI * well.perm * cell.hz / log(well.r_peaceman / well.rw);
     }
 }
+void DualStochOil::calculatePermPrior()
+{
+    perm_prior.resize(cellsNum);
+    if (props_sk.perm_grd.empty())
+    {
+        std::fill(perm_prior.begin(), perm_prior.end(), props_sk.perm);
+        return;
+    }
+    const int ny = cell_mesh->num_y + 2;
+    for (int i = 0; i < cellsNum; i++)
+    {
+        // Border cells take values of their inner neighbours, rows of the grid file go from the top
+        const int ind_x = std::min(std::max(i / ny, 1), cell_mesh->num_x);
+        const int ind_y = std::min(std::max(i % ny, 1), cell_mesh->num_y);
+        perm_prior[i] = props_sk.perm_grd[(ind_x - 1) * cell_mesh->num_y + (cell_mesh->num_y - ind_y)];
+    }
+}
+void DualStochOil::calculateKg()
+{
+    Kg_cells.resize(cellsNum);
+    for (int i = 0; i < cellsNum; i++)
+        Kg_cells[i] = exp(Favg_cells[i]);
+    Kg_nodes.resize(nodesNum);
+    for (int i = 0; i < nodesNum; i++)
+        Kg_nodes[i] = exp(Favg_nodes[i]);
+}
+void DualStochOil::saveState(Checkpoint& chk) const
+{
+    chk.add("ht", &ht, sizeof(ht));
+    chk.add("p0_prev", &p0_prev[0], cellsNum * sizeof(double));
+    chk.add("p0_iter", &p0_iter[0], cellsNum * sizeof(double));
+    chk.add("p0_next", &p0_next[0], cellsNum * sizeof(double));
+    chk.add("p2_prev", &p2_prev[0], cellsNum * sizeof(double));
+    chk.add("p2_iter", &p2_iter[0], cellsNum * sizeof(double));
+    chk.add("p2_next", &p2_next[0], cellsNum * sizeof(double));
+    // One chunk per time layer, so untouched layers are not rewritten
+    for (int k = 0; k < possible_steps_num; k++)
+    {
+        chk.add("Cfp#" + std::to_string(k), &Cfp[k][0], Cfp[k].size() * sizeof(double));
+        chk.add("Cfp_node#" + std::to_string(k), &Cfp_node[k][0], Cfp_node[k].size() * sizeof(double));
+        chk.add("Cp_prev#" + std::to_string(k), &Cp_prev[k][0], Cp_prev[k].size() * sizeof(double));
+        chk.add("Cp_next#" + std::to_string(k), &Cp_next[k][0], Cp_next[k].size() * sizeof(double));
+    }
+}
+void DualStochOil::loadState(Checkpoint& chk)
+{
+    chk.get("ht", &ht, sizeof(ht));
+    chk.get("p0_prev", &p0_prev[0], cellsNum * sizeof(double));
+    chk.get("p0_iter", &p0_iter[0], cellsNum * sizeof(double));
+    chk.get("p0_next", &p0_next[0], cellsNum * sizeof(double));
+    chk.get("p2_prev", &p2_prev[0], cellsNum * sizeof(double));
+    chk.get("p2_iter", &p2_iter[0], cellsNum * sizeof(double));
+    chk.get("p2_next", &p2_next[0], cellsNum * sizeof(double));
+    for (int k = 0; k < possible_steps_num; k++)
+    {
+        chk.get("Cfp#" + std::to_string(k), &Cfp[k][0], Cfp[k].size() * sizeof(double));
+        chk.get("Cfp_node#" + std::to_string(k), &Cfp_node[k][0], Cfp_node[k].size() * sizeof(double));
+        chk.get("Cp_prev#" + std::to_string(k), &Cp_prev[k][0], Cp_prev[k].size() * sizeof(double));
+        chk.get("Cp_next#" + std::to_string(k), &Cp_next[k][0], Cp_next[k].size() * sizeof(double));
+    }
+}
 void DualStochOil::setPeriod(const int period)
 {
-	for (auto& well : wells)
+	// Only wells switching their own period at this event are updated, all of them after a jump (restart)
+	const bool all = (period != last_period + 1);
+	last_period = period;
+	for (int w = 0; w < wells.size(); w++)
 	{
-		well.cur_period = period;
-		well.cur_bound = well.leftBoundIsRate[period];
+		if (!all && !std::binary_search(schedule.getChanged(period).begin(), schedule.getChanged(period).end(), w))
+			continue;
+		auto& well = wells[w];
+		well.cur_period = schedule.getPeriod(period, w);
+		well.cur_bound = well.leftBoundIsRate[well.cur_period];
 		if (well.cur_bound)
-			well.cur_rate = well.rate[period];
+			well.cur_rate = well.rate[well.cur_period];
 		else
-			well.cur_pwf = well.pwf[period];
+			well.cur_pwf = well.pwf[well.cur_period];
 	}
 }
 double DualStochOil::getRate(const Well& well) const
@@ -398,12 +468,13 @@ double DualStochOil::getPwfVar(const Well& well, const int step_idx) const
         return 0.0;
 }
 
-adouble DualStochOil::solveInner_p0(const Cell& cell) const
+template <class T>
+T DualStochOil::solve_p0(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::QUAD);
-	const auto& next = x_cell[cell.id];
+	const auto& next = p[cell.id];
 	const auto prev = p0_prev[cell.id];
-    adouble H, var_plus, var_minus;
+    T H, var_plus, var_minus;
 	H = getS(cell) * (next - prev) / getKg(cell);
 
 	const auto& beta_y_minus = cell_mesh->cells[cell.stencil[1]];
@@ -411,10 +482,10 @@ adouble DualStochOil::solveInner_p0(const Cell& cell) const
 	const auto& beta_x_minus = cell_mesh->cells[cell.stencil[3]];
 	const auto& beta_x_plus = cell_mesh->cells[cell.stencil[4]];
 
-	const auto& nebr_y_minus = x_cell[cell.stencil[1]];
-	const auto& nebr_y_plus = x_cell[cell.stencil[2]];
-	const auto& nebr_x_minus = x_cell[cell.stencil[3]];
-	const auto& nebr_x_plus = x_cell[cell.stencil[4]];
+	const auto& nebr_y_minus = p[cell.stencil[1]];
+	const auto& nebr_y_plus = p[cell.stencil[2]];
+	const auto& nebr_x_minus = p[cell.stencil[3]];
+	const auto& nebr_x_plus = p[cell.stencil[4]];
 
 	H -= ht * ((nebr_x_plus - next) / (beta_x_plus.cent.x - cell.cent.x) -
 			(next - nebr_x_minus) / (cell.cent.x - beta_x_minus.cent.x)) / cell.hx;
@@ -436,26 +507,28 @@ adouble DualStochOil::solveInner_p0(const Cell& cell) const
 
 	return H;
 }
-adouble DualStochOil::solveBorder_p0(const Cell& cell) const
+template <class T>
+T DualStochOil::solve_p0(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::BORDER);
 	const auto& beta = cell_mesh->cells[cell.stencil[1]];
 
-	const auto& cur = x_cell[cell.id];
-	const auto& nebr = x_cell[cell.stencil[1]];
+	const auto& cur = p[cell.id];
+	const auto& nebr = p[cell.stencil[1]];
 
-    return /*(cur - nebr) / P_dim; */(cur - (adouble)(props_sk.p_out)) / P_dim;
+    return /*(cur - nebr) / P_dim; */(cur - (T)(props_sk.p_out)) / P_dim;
 }
-adouble DualStochOil::solveSource_p0(const Well& well) const
+template <class T>
+T DualStochOil::solveSource_p0(const Well& well, const T* p) const
 {
 	const Cell& cell = cell_mesh->cells[well.cell_id];
 	if(well.cur_bound == true)
 		return -well.cur_rate * ht / cell.V / getKg(cell);
     else
-        return -well.WI / well.perm * (well.cur_pwf - x_cell[cell.id]) * ht / cell.V;
+        return -well.WI / well.perm * (well.cur_pwf - p[cell.id]) * ht / cell.V;
 }
 
-adouble DualStochOil::solveInner_Cfp(const Cell& cell, const Cell& cur_cell) const
+adouble DualStochOil::solve_Cfp(elem::TypeTag<elem::QUAD>, const Cell& cell, const Cell& cur_cell) const
 {
 	assert(cell.type == elem::QUAD);
     adouble next = x_cell[cell.id];
@@ -503,12 +576,11 @@ adouble DualStochOil::solveInner_Cfp(const Cell& cell, const Cell& cur_cell) con
 	
     double H2 = -getS(cell) / getKg(cell) * (p0_next[cell.id] - p0_prev[cell.id]) * getCf(cur_cell, cell);
 
-    return H + H1 + H2;
+    return (H + H1 + H2) / P_dim;
 }
-adouble DualStochOil::solveBorder_Cfp(const Cell& cell, const Cell& cur_cell) const
+adouble DualStochOil::solve_Cfp(elem::TypeTag<elem::BORDER>, const Cell& cell, const Cell&) const
 {
-	assert(cell.type == elem::BORDER || cur_cell.type == elem::BORDER);
-	const auto& beta = cell_mesh->cells[cell.stencil[1]];
+	assert(cell.type == elem::BORDER);
     return /*(x[cell.id] - x[beta.id]) / P_dim;*/ x_cell[cell.id] / P_dim;
 }
 adouble DualStochOil::solveSource_Cfp(const Well& well, const Cell& cur_cell) const
@@ -520,7 +592,7 @@ adouble DualStochOil::solveSource_Cfp(const Well& well, const Cell& cur_cell) co
         return well.WI / well.perm * x_cell[cell.id] * ht / cell.V;
 }
 
-adouble DualStochOil::solveInnerNode_Cfp(const Node& node, const Node& cur_node) const
+adouble DualStochOil::solveNode_Cfp(elem::TypeTag<elem::QUAD>, const Node& node, const Node& cur_node) const
 {
     assert(node.type == elem::QUAD);
     adouble next = x_node[node.id];
@@ -561,28 +633,27 @@ adouble DualStochOil::solveInnerNode_Cfp(const Node& node, const Node& cur_node)
         log(node.trans[0] / props_oil.visc) + var_minus / 2.0) / node.hy *
         (nebr_y_plus - nebr_y_minus) / (beta_y_plus.cent.y - beta_y_minus.cent.y);
 
-    double H1 = -ht * ((p0_next[x_plus] - p0_next[x_minus]) / (beta_x_plus.cent.x - beta_x_minus.cent.x) *
+    // Mean pressure lives on cells
+    const auto& p0n = p0_nodes_next;
+    double H1 = -ht * ((p0n[x_plus] - p0n[x_minus]) / (beta_x_plus.cent.x - beta_x_minus.cent.x) *
         (getCf(cur_node, beta_x_plus) - getCf(cur_node, beta_x_minus)) / (beta_x_plus.cent.x - beta_x_minus.cent.x) +
-        (p0_next[y_plus] - p0_next[y_minus]) / (beta_y_plus.cent.y - beta_y_minus.cent.y) *
+        (p0n[y_plus] - p0n[y_minus]) / (beta_y_plus.cent.y - beta_y_minus.cent.y) *
         (getCf(cur_node, beta_y_plus) - getCf(cur_node, beta_y_minus)) / (beta_y_plus.cent.y - beta_y_minus.cent.y));
 
-    double H2 = -getS(node) / getKg(node) * (p0_next[node.id] - p0_prev[node.id]) * getCf(cur_node, node);
+    double H2 = -getS(node) / getKg(node) * (p0n[node.id] - p0_nodes_prev[node.id]) * getCf(cur_node, node);
 
-    return H + H1 + H2;
-}
-adouble DualStochOil::solveBorderNode_Cfp(const Node& cell, const Node& cur_node) const
-{
-    return 0.0;
+    return (H + H1 + H2) / P_dim;
 }
 
-adouble DualStochOil::solveInner_p2(const Cell& cell) const
+template <class T>
+T DualStochOil::solve_p2(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::QUAD);
 
-	const auto& next = x_cell[cell.id];
+	const auto& next = p[cell.id];
 	const auto prev = p2_prev[cell.id];
 
-	adouble H, var_plus, var_minus;
+	T H, var_plus, var_minus;
 	H = getS(cell) * (next - prev) / getKg(cell);
 
 	const int& y_minus = cell.stencil[1];
@@ -595,10 +666,10 @@ adouble DualStochOil::solveInner_p2(const Cell& cell) const
 	const auto& beta_x_minus = cell_mesh->cells[x_minus];
 	const auto& beta_x_plus = cell_mesh->cells[x_plus];
 
-	const auto& nebr_y_minus = x_cell[y_minus];
-	const auto& nebr_y_plus = x_cell[y_plus];
-	const auto& nebr_x_minus = x_cell[x_minus];
-	const auto& nebr_x_plus = x_cell[x_plus];
+	const auto& nebr_y_minus = p[y_minus];
+	const auto& nebr_y_plus = p[y_plus];
+	const auto& nebr_x_minus = p[x_minus];
+	const auto& nebr_x_plus = p[x_plus];
 
 	H -= ht * ((nebr_x_plus - next) / (beta_x_plus.cent.x - cell.cent.x) -
 		(next - nebr_x_minus) / (cell.cent.x - beta_x_minus.cent.x)) / cell.hx;
@@ -630,13 +701,15 @@ adouble DualStochOil::solveInner_p2(const Cell& cell) const
 							(Cfp_next[idx] - Cfp_prev[idx]));
 	return H + H1 + H2;
 }
-adouble DualStochOil::solveBorder_p2(const Cell& cell) const
+template <class T>
+T DualStochOil::solve_p2(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::BORDER);
 	const auto& beta = cell_mesh->cells[cell.stencil[1]];
-    return /*(x[cell.id] - x[beta.id]) / P_dim;*/ x_cell[cell.id] / P_dim;
+    return /*(x[cell.id] - x[beta.id]) / P_dim;*/ p[cell.id] / P_dim;
 }
-adouble DualStochOil::solveSource_p2(const Well& well) const
+template <class T>
+T DualStochOil::solveSource_p2(const Well& well, const T* p) const
 {
 	const Cell& cell = cell_mesh->cells[well.cell_id];
     if (well.cur_bound == true)
@@ -645,7 +718,7 @@ adouble DualStochOil::solveSource_p2(const Well& well) const
         return 0.0;// -well.WI / props_oil.visc * (well.cur_pwf - x[cell.id]) * ht / cell.V / getKg(cell) * getSigma2f(cell) / 2.0;
 }
 
-adouble DualStochOil::solveInner_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const
+adouble DualStochOil::solve_Cp(elem::TypeTag<elem::QUAD>, const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const
 {
 	assert(cell.type == elem::QUAD && cur_cell.type == elem::QUAD);
 	adouble next = x_cell[cell.id];
@@ -698,12 +771,11 @@ adouble DualStochOil::solveInner_Cp(const Cell& cell, const Cell& cur_cell, cons
 
 	double H2 = -getS(cell) / getKg(cell) * (p0_next[cell.id] - p0_prev[cell.id]) * Cfp[step_idx][cell.id * cellsNum + cur_cell.id];
 
-    return H + H1 + H2;
+    return (H + H1 + H2) / P_dim;
 }
-adouble DualStochOil::solveBorder_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx) const
+adouble DualStochOil::solve_Cp(elem::TypeTag<elem::BORDER>, const Cell& cell, const Cell&, const size_t, const size_t) const
 {
-	assert(cell.type == elem::BORDER || cur_cell.type == elem::BORDER);
-	const auto& beta = cell_mesh->cells[cell.stencil[1]];
+	assert(cell.type == elem::BORDER);
     return /*(x[cell.id] - x[beta.id]) / P_dim;*/ x_cell[cell.id] / P_dim;
 }
 adouble DualStochOil::solveSource_Cp(const Well& well, const Cell& cur_cell, const size_t step_idx) const
@@ -713,4 +785,12 @@ adouble DualStochOil::solveSource_Cp(const Well& well, const Cell& cur_cell, con
         return well.cur_rate * ht / cell.V / getKg(cell) * Cfp[step_idx][cell.id * cellsNum + cur_cell.id];
     else
         return 0.0;// well.WI / props_oil.visc * (well.cur_pwf - x[cell.id]) * ht / cell.V / getKg(cell) * Cfp[step_idx][cell.id * cellsNum + cur_cell.id];
-}
\ No newline at end of file
+}
+
+// Taped and plain evaluation of p0 / p2 equations
+template adouble dual_stoch_oil::DualStochOil::solve_p0<adouble>(elem::TypeTag<elem::QUAD>, const Cell&, const adouble*) const;
+template adouble dual_stoch_oil::DualStochOil::solve_p0<adouble>(elem::TypeTag<elem::BORDER>, const Cell&, const adouble*) const;
+template adouble dual_stoch_oil::DualStochOil::solveSource_p0<adouble>(const Well&, const adouble*) const;
+template adouble dual_stoch_oil::DualStochOil::solve_p2<adouble>(elem::TypeTag<elem::QUAD>, const Cell&, const adouble*) const;
+template adouble dual_stoch_oil::DualStochOil::solve_p2<adouble>(elem::TypeTag<elem::BORDER>, const Cell&, const adouble*) const;
+template adouble dual_stoch_oil::DualStochOil::solveSource_p2<adouble>(const Well&, const adouble*) const;
@@ -4,8 +4,10 @@
 #include "src/model/AbstractModel.hpp"
 #include "src/grid/Variables.hpp"
 #include "src/grid/Mesh.hpp"
+#include "src/grid/GridTransfer.hpp"
 #include "src/model/dual_stoch_oil/Properties.hpp"
 #include "src/Well.hpp"
+#include "src/utils/Checkpoint.hpp"
 #include "paralution.hpp"
 
 namespace dual_stoch_oil
@@ -18,7 +20,9 @@ namespace dual_stoch_oil
 				var::containers::Var1phase>
 	{
 		template<typename> friend class snapshotter::VTKSnapshotter;
-		template<typename> friend class AbstractDualGridMethod;
+		template<typename> friend class ::CellGridPolicy;
+		template<typename> friend class ::DualGridPolicy;
+		template<class, template <class> class, class> friend class ::MethodDriver;
 		friend class DualStochOilMethod;
 	public:
 
@@ -30,6 +34,8 @@ namespace dual_stoch_oil
 		adouble *h_cell, *h_node;
 
 		int possible_steps_num, start_time_simple_approx;
+		// Last applied schedule interval
+		int last_period;
 		Skeleton_Props props_sk;
 		Oil_Props props_oil;
 		std::vector<Well> wells;
@@ -38,36 +44,33 @@ namespace dual_stoch_oil
         double* inv_cond_cov;
         std::vector<double> Favg_cells, Favg_nodes;
         std::vector<std::vector<double>> Cf_cells, Cf_nodes;
+        // Cells -> nodes transfer, mean of four cells around the node
+        mesh::TransferOperator toNodes;
+        // Mean pressure carried over to nodes for node equations
+        std::vector<double> p0_nodes_prev, p0_nodes_next;
+        cov::Kernel kernel;
+        // Threads of dense covariance fill (0 - hardware concurrency)
+        int cov_threads;
+        CheckpointProps checkpoint_props;
+        void saveState(Checkpoint& chk) const;
+        void loadState(Checkpoint& chk);
 
-        void loadPermAvg(const std::string fileName);
+        // Prior mean permeability of cells, uniform or from the grid file
+        std::vector<double> perm_prior;
+        void calculatePermPrior();
+        // exp(Favg) of cells and nodes, kernels take it without exp per evaluation
+        std::vector<double> Kg_cells, Kg_nodes;
+        void calculateKg();
         void writeCPS(const int i);
         template<class TElem>
 		inline double getPerm_prior(const TElem& elem) const
 		{
-            /*int ind_x = int(cell.id / (mesh->num_y + 2));
-            int ind_y = cell.id % (mesh->num_y + 2);
-            int id = cell.id;
-            if (cell.type != elem::QUAD)
-            {
-                //if ((ind_x == 0 || ind_x == mesh->num_x + 1) && (ind_y == 0 || ind_y == mesh->num_y + 1))
-                //    return 1.0;
-                //else
-                //{
-                    if (ind_y == 0)
-                        id += 1;
-                    else if (ind_y == mesh->num_y + 1)
-                        id -= 1;
-                    if (ind_x == 0)
-                        id += mesh->num_y + 2;
-                    else if (ind_x == mesh->num_x + 1)
-                        id -= mesh->num_y + 2;
-                //}
-            }
-            ind_x = int(id / (mesh->num_y + 2));
-            ind_y = mesh->num_y + 1 - id % (mesh->num_y + 2);
-            return props_sk.perm_grd[(ind_x - 1) * mesh->num_y + (ind_y - 1)];*/
             return props_sk.perm;
 		};
+        inline double getPerm_prior(const Cell& cell) const
+        {
+            return perm_prior[cell.id];
+        };
         template<class TElem>
         inline double getS(const TElem& cell) const
         {
@@ -81,9 +84,7 @@ namespace dual_stoch_oil
         };
         inline double getCf_coord(const point::Point& p1, const point::Point& p2) const
         {
-            const double dist = point::distance(p1, p2) / props_sk.l_f;
-            return props_sk.sigma_f * props_sk.sigma_f * exp(-dist * dist);
-            //return props_sk.sigma_f * props_sk.sigma_f * exp(-dist);
+            return kernel(point::distance(p1, p2));
         };
         template<class TElem>
 		inline double getCf_prior(const TElem& elem1, const TElem& elem2) const
@@ -147,91 +148,45 @@ namespace dual_stoch_oil
                             assert(fabs(s) < EQUALITY_TOLERANCE);
                     }
                 }*/
-                delete[] ind_i, ind_j;
+                delete[] ind_i;
+                delete[] ind_j;
                 delete[] cond_cov;
-                // Mult for cell grid
-                std::vector<std::vector<double>> cell_mult_mat;
-                cell_mult_mat.resize(cellsNum);
-                std::for_each(cell_mult_mat.begin(), cell_mult_mat.end(), [&](std::vector<double>& vec) { vec.resize(conditions.size(), 0.0); });
-                for (int i = 0; i < cellsNum; i++)
-                {
-                    const Cell& cell = cell_mesh->cells[i];
-                    for (int k = 0; k < conditions.size(); k++)
-                    {
-                        const Cell& c_cell = cell_mesh->cells[conditions[k].id];
-                        s = 0.0;
-                        for (int k1 = 0; k1 < conditions.size(); k1++)
-                        {
-                            const Cell& c_cell1 = cell_mesh->cells[conditions[k1].id];
-                            s += getCf_prior(cell, c_cell1) * inv_cond_cov[k1 * conditions.size() + k];
-                        }
-                        cell_mult_mat[i][k] = s;
-                    }
-                }
-                // Mult for node grid
-                std::vector<std::vector<double>> node_mult_mat;
-                node_mult_mat.resize(nodesNum);
-                std::for_each(node_mult_mat.begin(), node_mult_mat.end(), [&](std::vector<double>& vec) { vec.resize(conditions.size(), 0.0); });
-                for (int i = 0; i < nodesNum; i++)
-                {
-                    const Node& node = node_mesh->nodes[i];
-                    for (int k = 0; k < conditions.size(); k++)
+                // Kriging weights of data residuals
+                const int condNum = conditions.size();
+                std::vector<double> weights(condNum, 0.0);
+                for (int k1 = 0; k1 < condNum; k1++)
+                    for (int k = 0; k < condNum; k++)
                     {
-                        const Node& c_node = node_mesh->nodes[conditions[k].id];
-                        s = 0.0;
-                        for (int k1 = 0; k1 < conditions.size(); k1++)
-                        {
-                            const Node& c_node1 = node_mesh->nodes[conditions[k1].id];
-                            s += getCf_prior(node, c_node1) * inv_cond_cov[k1 * conditions.size() + k];
-                        }
-                        node_mult_mat[i][k] = s;
+                        const auto& cond = conditions[k];
+                        weights[k1] += inv_cond_cov[k1 * condNum + k] * (log(cond.perm / props_oil.visc) - getFavg_prior(cell_mesh->cells[cond.id]));
                     }
-                }
-                // Kriging for cells
+                // Prior covariances between data points and cells are computed once
+                // and used for the mean, the multipliers and the covariance update
+                std::vector<double> cond_cf(condNum * cellsNum), mult(condNum);
+                for (int k = 0; k < condNum; k++)
+                    for (int i = 0; i < cellsNum; i++)
+                        cond_cf[k * cellsNum + i] = getCf_prior(cell_mesh->cells[conditions[k].id], cell_mesh->cells[i]);
+
                 for (int i = 0; i < cellsNum; i++)
                 {
-                    const Cell& cell1 = cell_mesh->cells[i];
-                    for (int k2 = 0; k2 < conditions.size(); k2++)
+                    for (int k1 = 0; k1 < condNum; k1++)
+                        Favg_cells[i] += cond_cf[k1 * cellsNum + i] * weights[k1];
+                    for (int k = 0; k < condNum; k++)
                     {
-                        const auto& cond = conditions[k2];
-                        const auto c_cell = cell_mesh->cells[cond.id];
-                        Favg_cells[i] += cell_mult_mat[i][k2] * (log(cond.perm / props_oil.visc) - getFavg_prior(c_cell));
+                        mult[k] = 0.0;
+                        for (int k1 = 0; k1 < condNum; k1++)
+                            mult[k] += cond_cf[k1 * cellsNum + i] * inv_cond_cov[k1 * condNum + k];
                     }
                     // Covariance
-                    for (int j = 0; j < cellsNum; j++)
+                    auto& row = Cf_cells[i];
+                    for (int k = 0; k < condNum; k++)
                     {
-                        const Cell& cell2 = cell_mesh->cells[j];
-                        for (int k2 = 0; k2 < conditions.size(); k2++)
-                        {
-                            const auto& cond = conditions[k2];
-                            Cf_cells[i][j] -= cell_mult_mat[i][k2] * getCf_prior(cell_mesh->cells[cond.id], cell2);
-                        }
+                        const double* cond_row = &cond_cf[k * cellsNum];
+                        for (int j = 0; j < cellsNum; j++)
+                            row[j] -= mult[k] * cond_row[j];
                     }
-                    if (Cf_cells[i][i] < 0.0 && Cf_cells[i][i] > -EQUALITY_TOLERANCE)
-                        Cf_cells[i][i] = 0.0;
-                }
-                // Kriging for nodes
-                for (int i = 0; i < nodesNum; i++)
-                {
-                    const Node& node1 = node_mesh->nodes[i];
-                    for (int k2 = 0; k2 < conditions.size(); k2++)
-                    {
-                        const auto& cond = conditions[k2];
-                        const auto c_node = node_mesh->nodes[cond.id];
-                        Favg_nodes[i] += node_mult_mat[i][k2] * (log(cond.perm / props_oil.visc) - getFavg_prior(c_node));
-                    }
-                    // Covariance
-                    for (int j = 0; j < nodesNum; j++)
-                    {
-                        const Node& node2 = node_mesh->nodes[j];
-                        for (int k2 = 0; k2 < conditions.size(); k2++)
-                        {
-                            const auto& cond = conditions[k2];
-                            Cf_nodes[i][j] -= node_mult_mat[i][k2] * getCf_prior(node_mesh->nodes[cond.id], node2);
-                        }
-                    }
-                    if (Cf_nodes[i][i] < 0.0 && Cf_nodes[i][i] > -EQUALITY_TOLERANCE)
-                        Cf_nodes[i][i] = 0.0;
+                    if (row[i] < 0.0 && row[i] > -EQUALITY_TOLERANCE)
+                        row[i] = 0.0;
                 }
             }
 
@@ -284,34 +239,59 @@ namespace dual_stoch_oil
         {
             return getCf(elem, elem);
         };
+        // Node statistics are the cell ones carried over by prolongation
+        void calculateNodeStats()
+        {
+            toNodes.apply(&Favg_cells[0], &Favg_nodes[0]);
+            toNodes.applySym(Cf_cells, Cf_nodes);
+            for (int i = 0; i < nodesNum; i++)
+                if (Cf_nodes[i][i] < 0.0 && Cf_nodes[i][i] > -EQUALITY_TOLERANCE)
+                    Cf_nodes[i][i] = 0.0;
+        };
         template<class TElem>
         inline double getKg(const TElem& elem) const
         {
             return exp(getFavg(elem));
         };
+        inline double getKg(const Cell& elem) const
+        {
+            return Kg_cells[elem.id];
+        };
+        inline double getKg(const Node& elem) const
+        {
+            return Kg_nodes[elem.id];
+        };
         template<class TElem>
         inline double getGeomPerm(const TElem& elem) const
         {
             return getKg(elem) * props_oil.visc;
         };
 
-		adouble solveInner_p0(const Cell& cell) const;
-		adouble solveBorder_p0(const Cell& cell) const;
-		adouble solveSource_p0(const Well& well) const;
+		// p0 equations templated on scalar type, adouble is instantiated for taping.
+		// Element type is resolved at compile time through elem::TypeTag
+		template <class T> T solve_p0(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const;
+		template <class T> T solve_p0(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const;
+		template <class T> T solveSource_p0(const Well& well, const T* p) const;
 
-		adouble solveInner_Cfp(const Cell& cell, const Cell& cur_cell) const;
-		adouble solveBorder_Cfp(const Cell& cell, const Cell& cur_cell) const;
+		// Cfp & Cp equations are overloaded on the element type as well, all rows are scaled by P_dim
+		adouble solve_Cfp(elem::TypeTag<elem::QUAD>, const Cell& cell, const Cell& cur_cell) const;
+		adouble solve_Cfp(elem::TypeTag<elem::BORDER>, const Cell& cell, const Cell& cur_cell) const;
 		adouble solveSource_Cfp(const Well& well, const Cell& cur_cell) const;
 
-        adouble solveInnerNode_Cfp(const Node& node, const Node& cur_node) const;
-        adouble solveBorderNode_Cfp(const Node& node, const Node& cur_node) const;
+		// Border and corner nodes share the zero condition
+		adouble solveNode_Cfp(elem::TypeTag<elem::QUAD>, const Node& node, const Node& cur_node) const;
+		template <elem::Type T>
+		inline adouble solveNode_Cfp(elem::TypeTag<T>, const Node& node, const Node&) const
+		{
+			return x_node[node.id] / P_dim;
+		};
 
-		adouble solveInner_p2(const Cell& cell) const;
-		adouble solveBorder_p2(const Cell& cell) const;
-		adouble solveSource_p2(const Well& well) const;
+		template <class T> T solve_p2(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const;
+		template <class T> T solve_p2(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const;
+		template <class T> T solveSource_p2(const Well& well, const T* p) const;
 
-		adouble solveInner_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const;
-		adouble solveBorder_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx) const;
+		adouble solve_Cp(elem::TypeTag<elem::QUAD>, const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const;
+		adouble solve_Cp(elem::TypeTag<elem::BORDER>, const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const;
 		adouble solveSource_Cp(const Well& well, const Cell& cur_cell, const size_t step_idx) const;
 
         double getRate(const Well& well) const;
@@ -324,6 +304,12 @@ namespace dual_stoch_oil
 
 		void setProps(const Properties& props);
 		void setPeriod(const int period);
+		// Refreshes node values of mean pressure before node sweeps
+		void updateNodePressure()
+		{
+			toNodes.apply(&p0_prev[0], &p0_nodes_prev[0]);
+			toNodes.apply(&p0_next[0], &p0_nodes_next[0]);
+		};
 	};
 };
 
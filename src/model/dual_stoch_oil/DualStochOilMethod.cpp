@@ -1,6 +1,8 @@
 #include <fstream>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <future>
 #include "src/model/dual_stoch_oil/DualStochOilMethod.hpp"
 
 #include "adolc/sparse/sparsedrivers.h"
@@ -8,57 +10,50 @@
 
 using namespace dual_stoch_oil;
 
-DualStochOilMethod::DualStochOilMethod(Model* _model) : AbstractDualGridMethod<Model>(_model)
+DualStochOilMethod::DualStochOilMethod(Model* _model) : AbstractDualGridMethod<Model>(_model),
+	jac_p0(0), jac_Cfp(1), jac_p2(2), jac_Cp(3), jac_Cfp_node(4)
 {
 	const int strNum0 = model->cellsNum;
-	y0 = new double[strNum0];
-	ind_i0 = new int[CellMesh::stencil * strNum0];
-	ind_j0 = new int[CellMesh::stencil * strNum0];
-	//cols = new int[strNum];
-	a0 = new double[CellMesh::stencil * strNum0];
-	ind_rhs0 = new int[strNum0];
-	rhs0 = new double[strNum0];
+	workspace.add(y0, strNum0);
+	workspace.add(ind_i0, CellMesh::stencil * strNum0);
+	workspace.add(ind_j0, CellMesh::stencil * strNum0);
+	workspace.add(ind_rhs0, strNum0);
+	workspace.add(rhs0, strNum0);
 
 	const int strNum1 = model->cellsNum;
-	y1 = new double[strNum1];
-	ind_i1 = new int[CellMesh::stencil * strNum1];
-	ind_j1 = new int[CellMesh::stencil * strNum1];
-	//cols = new int[strNum];
-	a1 = new double[CellMesh::stencil * strNum1];
-	ind_rhs1 = new int[strNum1];
-	rhs1 = new double[strNum1];
+	workspace.add(y1, strNum1);
+	workspace.add(ind_i1, CellMesh::stencil * strNum1);
+	workspace.add(ind_j1, CellMesh::stencil * strNum1);
+	workspace.add(ind_rhs1, strNum1);
+	workspace.add(rhs1, strNum1);
 
     const int strNum_node = model->nodesNum;
-    y_node = new double[strNum_node];
-    ind_i_node = new int[NodeMesh::stencil * strNum_node];
-    ind_j_node = new int[NodeMesh::stencil * strNum_node];
-    //cols = new int[strNum];
-    a_node = new double[NodeMesh::stencil * strNum_node];
-    ind_rhs_node = new int[strNum_node];
-    rhs_node = new double[strNum_node];
+    workspace.add(y_node, strNum_node);
+    workspace.add(ind_i_node, NodeMesh::stencil * strNum_node);
+    workspace.add(ind_j_node, NodeMesh::stencil * strNum_node);
+    workspace.add(ind_rhs_node, strNum_node);
+    workspace.add(rhs_node, strNum_node);
+
+    workspace.allocate();
+    col_node = offset_node = NULL;
+    dmat_node = NULL;
 
 	//options[0] = 0;          /* sparsity pattern by index domains (default) */
 	//options[1] = 0;          /*                         safe mode (default) */
 	//options[2] = 0;          /*              not required if options[0] = 0 */
 	//options[3] = 0;          /*                column compression (default) */
 
-	pvd.open("snaps/DualStochOil.pvd", std::ofstream::out);
+	pvd.open(model->getOutDir() + "DualStochOil.pvd", std::ofstream::out);
 	pvd << "<VTKFile type = \"Collection\" version = \"1.0\" byte_order = \"LittleEndian\" header_type = \"UInt64\">\n";
 	pvd << "\t<Collection>\n";
 
-	plot_P.open("snaps/P.dat", std::ofstream::out);
-	plot_Q.open("snaps/Q.dat", std::ofstream::out);
+	plot_P.open(model->getOutDir() + "P.dat", std::ofstream::out);
+	plot_Q.open(model->getOutDir() + "Q.dat", std::ofstream::out);
 };
 DualStochOilMethod::~DualStochOilMethod()
 {
-	delete[] ind_i0, ind_j0, ind_rhs0;
-	delete[] y0, a0, rhs0;
-
-	delete[] ind_i1, ind_j1, ind_rhs1;
-	delete[] y1, a1, rhs1;
-
-    delete[] ind_i_node, ind_j_node, ind_rhs_node;
-    delete[] y_node, a_node, rhs_node;
+	// Workspace buffers are released by workspace itself
+	ParSolver::freeInvert(offset_node, col_node, dmat_node);
 
 	plot_P.close();
 	plot_Q.close();
@@ -89,11 +84,13 @@ void DualStochOilMethod::control()
 {
 	writeData();
 
-	if (cur_t >= model->wells[0].period[curTimePeriod])
+	const auto& schedule = model->schedule;
+	if (cur_t >= schedule.getTime(curTimePeriod))
 	{
 		curTimePeriod++;
-		model->ht = model->ht_min;
 		model->setPeriod(curTimePeriod);
+		if (schedule.isControlChange(curTimePeriod))
+			model->ht = model->ht_min;
 	}
 
 	model->ht *= 2.0;
@@ -102,34 +99,39 @@ void DualStochOilMethod::control()
 	//else if (iterations > 6 && model->ht > model->ht_min)
 	//	model->ht = model->ht / 1.5;
 
-	if (cur_t + model->ht > model->wells[0].period[curTimePeriod])
-		model->ht = model->wells[0].period[curTimePeriod] - cur_t;
-
-	cur_t += model->ht;
+	if (cur_t + model->ht >= schedule.getTime(curTimePeriod))
+	{
+		model->ht = schedule.getTime(curTimePeriod) - cur_t;
+		cur_t = schedule.getTime(curTimePeriod);
+	}
+	else
+		cur_t += model->ht;
 }
-void DualStochOilMethod::start()
+void DualStochOilMethod::prepare()
 {
-	step_idx = 0;
-
 	fillIndices();
 	solver0.Init(model->cellsNum, 1.e-15, 1.e-15);
 	solver1.Init(model->cellsNum, 1.e-15, 1.e-15);
+	solver0.SetPattern(ind_i0, ind_j0, elemNum0);
+	solver1.SetPattern(ind_i1, ind_j1, elemNum1);
     solver_node.Init(model->nodesNum, 1.e-15, 1.e-15);
+    solver_node.SetPattern(ind_i_node, ind_j_node, elemNum_node);
+}
+bool DualStochOilMethod::restart()
+{
+	if (!AbstractDualGridMethod<Model>::restart())
+		return false;
 
-	model->setPeriod(curTimePeriod);
-	while (cur_t < Tt)
+	// Time layer pointers follow the restored step
+	if (step_idx + 1 < model->possible_steps_num)
 	{
-		control();
-		model->snapshot_all(step_idx++);
-		doNextStep();
-		copyTimeLayer();
-		cout << "---------------------NEW TIME STEP---------------------" << std::endl;
-		cout << std::setprecision(6);
-		cout << "time = " << cur_t << std::endl;
+		model->Cfp_prev = &model->Cfp[step_idx][0];
+		model->Cfp_next = &model->Cfp[step_idx + 1][0];
+		model->Cfp_prev_node = &model->Cfp_node[step_idx][0];
+		model->Cfp_next_node = &model->Cfp_node[step_idx + 1][0];
 	}
-
-	model->snapshot_all(step_idx);
-	writeData();
+	std::cout << "Restarted at time = " << cur_t << ", step = " << step_idx << std::endl;
+	return true;
 }
 void DualStochOilMethod::fillIndices()
 {
@@ -137,34 +139,29 @@ void DualStochOilMethod::fillIndices()
 
 	for (int i = 0; i < model->cellsNum; i++)
 	{
-		auto& cell = cell_mesh->cells[i];
-		getCellMatrixStencil(cell);
-
-		for (size_t i = 0; i < var_size; i++)
-			for (const int idx : cell.stencil)
-				for (size_t j = 0; j < var_size; j++)
-				{
-					ind_i0[counter] = ind_i1[counter] = var_size * cell.id + i;			
-                    ind_j0[counter] = ind_j1[counter] = var_size * idx + j;
-                    counter++;
-				}
+		auto& cell = mesh->cells[i];
+		getMatrixStencil(cell);
+		// Border cells take only their used stencil entries
+		counter += elem::dispatchCell(cell.type, [&](auto tag)
+		{
+			return elem::fillBlockRow<var_size>(tag, cell, ind_i0 + counter, ind_j0 + counter);
+		});
         ind_rhs0[i] = ind_rhs1[i] = i;
 	}
 	elemNum0 = elemNum1 = counter;
+	std::copy_n(ind_i0, counter, ind_i1);
+	std::copy_n(ind_j0, counter, ind_j1);
 
     counter = 0;
+    cacheCellGeomPerm();
     for (int i = 0; i < model->nodesNum; i++)
     {
         auto& node = node_mesh->nodes[i];
         getNodeMatrixStencil(node);
-
-        for (size_t i = 0; i < var_size; i++)
-            for (const int idx : node.stencil)
-                for (size_t j = 0; j < var_size; j++)
-                {
-                    ind_i_node[counter] = var_size * node.id + i;   ind_j_node[counter] = var_size * idx + j;
-                    counter++;
-                }
+        counter += elem::dispatchNode(node.type, [&](auto tag)
+        {
+            return elem::fillBlockRow<var_size>(tag, node, ind_i_node + counter, ind_j_node + counter);
+        });
         ind_rhs_node[i] = i;
     }
     elemNum_node = counter;
@@ -172,9 +169,9 @@ void DualStochOilMethod::fillIndices()
 
 void DualStochOilMethod::solveStep()
 {
-	col = offset = NULL;
-	dmat = NULL;
-	avoidMatrixCalc = false;
+	releaseInvert();
+	ParSolver::freeInvert(offset_node, col_node, dmat_node);
+	avoidMatrixCalc_node = false;
 
 	solveStep_p0();
 	solveStep_Cfp();
@@ -183,22 +180,26 @@ void DualStochOilMethod::solveStep()
 }
 void DualStochOilMethod::solveStep_p0()
 {
-	int cellIdx, varIdx, iterations;
+	int cellIdx, iterations;
 	double err_newton = 1.0;
 	averValPrev = averValue_p0();
 
 	iterations = 0;	err_newton = 1;	dAverVal = 1.0;
 	while (err_newton > 1.e-4 && dAverVal > 1.e-7 && iterations < 20)
 	{
-		copyIterLayer_p0();
-		computeJac_p0();
+		// Tape of a step is reused by later iterates unless they branch off it
+		if (iterations == 0 || !evalTape(jac_p0, model->cellsNum, &model->p0_next[0], y0))
+			computeJac_p0();
 		fill_p0();
-		solver0.Assemble(ind_i0, ind_j0, a0, elemNum0, ind_rhs0, rhs0);
+		solver0.AssembleValues(rhs0);
 		solver0.Solve(PRECOND::ILU_SIMPLE);
-		copySolution_p0(solver0.getSolution());
+		// Update, convergence check and average in one pass
+		double* dx = solver0.lendSolution();
+		const auto stats = applyNewtonUpdate(&model->p0_next[0], dx);
+		solver0.returnSolution(dx);
 
-		err_newton = convergance_p0(cellIdx, varIdx);
-		averVal = averValue_p0();
+		err_newton = stats.relErr;		cellIdx = stats.ind;
+		averVal = stats.volSum;
 		dAverVal = fabs(averVal - averValPrev);
 		averValPrev = averVal;
 
@@ -208,43 +209,65 @@ void DualStochOilMethod::solveStep_p0()
 }
 void DualStochOilMethod::solveStep_Cfp()
 {
-	for (const auto& cell : cell_mesh->cells)
+	// Sweeps meet only at the tape lock, dense-inverse products of one overlap taping of the other
+	model->updateNodePressure();
+	auto node_sweep = std::async(std::launch::async, [this]() { solveStep_Cfp_nodes(); });
+	solveStep_Cfp_cells();
+	node_sweep.get();
+}
+void DualStochOilMethod::solveStep_Cfp_cells()
+{
+	for (const auto& cell : mesh->cells)
 	{
-		//if (cell.type == elem::QUAD)
-		//{
+		{
+			std::lock_guard<std::mutex> lock(tapeMutex);
 			computeJac_Cfp(cell.id);
 			fill_Cfp(cell.id);
-			if (!avoidMatrixCalc)
+			buildInvert(solver1);
+			//checkInvertMatrix();
+		}
+		copySolution_Cfp(cell.id);
+		std::cout << "Cfp #" << cell.id << std::endl;
+		solver1.SetSameMatrix();
+	}
+}
+void DualStochOilMethod::solveStep_Cfp_nodes()
+{
+	for (const auto& node : node_mesh->nodes)
+	{
+		{
+			std::lock_guard<std::mutex> lock(tapeMutex);
+			computeJac_Cfp_node(node.id);
+			fill_Cfp_node(node.id);
+			if (!avoidMatrixCalc_node)
 			{
-				solver1.getInvert(ind_i1, ind_j1, a1, elemNum1, offset, col, dmat);
-				//checkInvertMatrix();
-				avoidMatrixCalc = true;
+				solver_node.getInvert(offset_node, col_node, dmat_node);
+				avoidMatrixCalc_node = true;
 			}
-			copySolution_Cfp(cell.id);
-			std::cout << "Cfp #" << cell.id << std::endl;
-			solver1.SetSameMatrix();
-		//}
+		}
+		copySolution_Cfp_node(node.id);
 	}
+	std::cout << "Cfp: " << nodes_size << " node columns done" << std::endl;
 }
 void DualStochOilMethod::checkInvertMatrix() const 
 {
     std::ofstream file("ffile.txt", std::ofstream::out);
 	int ind0 = 0, ind1 = 0, end_idx = 0;
 	double val;
-	for (int i = 0; i < cells_size; i++)
+	for (int i = 0; i < size; i++)
 	{
-		for (int j = 0; j < cells_size; j++)
+		for (int j = 0; j < size; j++)
 		{
 			val = 0.0;
 			//ind = end_idx;
-			for (int k = 0; k < cells_size; k++)
+			for (int k = 0; k < size; k++)
 			{
-                if (ind_i1[ind0] == i && ind_j1[ind0] == k)
+                if (jac_Cfp.ind_i[ind0] == i && jac_Cfp.ind_j[ind0] == k)
                 {
                     for (int l = offset[k]; l < offset[k + 1]; l++)
                         if (col[l] == j)
                         {
-                            val += a1[ind0] * dmat[ind1];
+                            val += jac_Cfp.a[ind0] * dmat[ind1];
                             break;
                         }
                     ind0++;
@@ -266,22 +289,25 @@ void DualStochOilMethod::checkInvertMatrix() const
 }
 void DualStochOilMethod::solveStep_p2()
 {
-	int cellIdx, varIdx, iterations;
+	int cellIdx, iterations;
 	double err_newton = 1.0;
-	averValPrev = averValue_p0();
+	averValPrev = averValue_p2();
 
 	iterations = 0;	err_newton = 1;	dAverVal = 1.0;
 	while (err_newton > 1.e-4 && dAverVal > 1.e-7 && iterations < 20)
 	{
-		copyIterLayer_p2();
-		computeJac_p2();
+		if (iterations == 0 || !evalTape(jac_p2, model->cellsNum, &model->p2_next[0], y0))
+			computeJac_p2();
 		fill_p2();
-		solver0.Assemble(ind_i0, ind_j0, a0, elemNum0, ind_rhs0, rhs0);
+		solver0.AssembleValues(rhs0);
 		solver0.Solve(PRECOND::ILU_SIMPLE);
-		copySolution_p2(solver0.getSolution());
+		// Update, convergence check and average in one pass
+		double* dx = solver0.lendSolution();
+		const auto stats = applyNewtonUpdate(&model->p2_next[0], dx);
+		solver0.returnSolution(dx);
 
-		err_newton = convergance_p2(cellIdx, varIdx);
-		averVal = averValue_p2();
+		err_newton = stats.relErr;		cellIdx = stats.ind;
+		averVal = stats.volSum;
 		dAverVal = fabs(averVal - averValPrev);
 		averValPrev = averVal;
 
@@ -297,7 +323,7 @@ void DualStochOilMethod::solveStep_Cp()
 
 	for (int time_step = start_idx; time_step < step_idx + 1; time_step++)
 	{
-		for (const auto& cell : cell_mesh->cells)
+		for (const auto& cell : mesh->cells)
 		{
 			if (cell.type == elem::QUAD)
 			{
@@ -310,11 +336,6 @@ void DualStochOilMethod::solveStep_Cp()
 	}
 }
 
-void DualStochOilMethod::copySolution_p0(const paralution::LocalVector<double>& sol)
-{
-	for (int i = 0; i < cells_size; i++)
-		model->p0_next[i] += sol[i];
-}
 /*void DualStochOilMethod::copySolution_Cfp(const int cell_id, const paralution::LocalVector<double>& sol)
 {
 	for (int i = 0; i < size; i++)
@@ -322,19 +343,32 @@ void DualStochOilMethod::copySolution_p0(const paralution::LocalVector<double>&
 }*/
 void DualStochOilMethod::copySolution_Cfp(const int cell_id)
 {
-	double s;
-	for (int i = 0; i < cells_size; i++)
+	// Every strip owns its rows of the inverse and its entries of Cfp column
+	partition.run([this, cell_id](const int begin, const int end)
 	{
-		s = 0.0;
-		for (int j = offset[i]; j < offset[i + 1]; j++)
-			s += dmat[j] * rhs1[col[j]];
-		model->Cfp_next[cell_id * cells_size + i] += s;
-	}
+		double s;
+		for (int i = begin; i < end; i++)
+		{
+			s = 0.0;
+			for (int j = offset[i]; j < offset[i + 1]; j++)
+				s += dmat[j] * rhs1[col[j]];
+			model->Cfp_next[cell_id * size + i] += s;
+		}
+	});
 }
-void DualStochOilMethod::copySolution_p2(const paralution::LocalVector<double>& sol)
+void DualStochOilMethod::copySolution_Cfp_node(const int node_id)
 {
-	for (int i = 0; i < cells_size; i++)
-		model->p2_next[i] += sol[i];
+	node_partition.run([this, node_id](const int begin, const int end)
+	{
+		double s;
+		for (int i = begin; i < end; i++)
+		{
+			s = 0.0;
+			for (int j = offset_node[i]; j < offset_node[i + 1]; j++)
+				s += dmat_node[j] * rhs_node[col_node[j]];
+			model->Cfp_next_node[node_id * nodes_size + i] += s;
+		}
+	});
 }
 /*void DualStochOilMethod::copySolution_Cp(const int cell_id, const paralution::LocalVector<double>& sol, const size_t time_step)
 {
@@ -343,164 +377,179 @@ void DualStochOilMethod::copySolution_p2(const paralution::LocalVector<double>&
 }*/
 void DualStochOilMethod::copySolution_Cp(const int cell_id, const size_t time_step)
 {
-	double s;
-	for (size_t i = 0; i < cells_size; i++)
+	partition.run([this, cell_id, time_step](const int begin, const int end)
 	{
-		s = 0.0;
-		for (size_t j = offset[i]; j < offset[i + 1]; j++)
-			s += dmat[j] * rhs1[col[j]];
-		model->Cp_next[time_step][cell_id * cells_size + i] += s;
-	}
+		double s;
+		for (int i = begin; i < end; i++)
+		{
+			s = 0.0;
+			for (int j = offset[i]; j < offset[i + 1]; j++)
+				s += dmat[j] * rhs1[col[j]];
+			model->Cp_next[time_step][cell_id * size + i] += s;
+		}
+	});
 }
 
 void DualStochOilMethod::computeJac_p0()
 {
 	trace_on(0);
 
-	for (size_t i = 0; i < cells_size; i++)
+	for (size_t i = 0; i < size; i++)
 		model->x_cell[i] <<= model->p0_next[i * var_size];
 
-	for (int i = 0; i < cells_size; i++)
+	for (int i = 0; i < size; i++)
 	{
-		const auto& cell = cell_mesh->cells[i];
-
-		if (cell.type == elem::QUAD)
-			model->h_cell[i * var_size] = model->solveInner_p0(cell);
-		else if (cell.type == elem::BORDER)
-			model->h_cell[i * var_size] = model->solveBorder_p0(cell);
+		const auto& cell = mesh->cells[i];
+		model->h_cell[i * var_size] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_p0(tag, cell, model->x_cell); });
 	}
 
     for (const auto& well : model->wells)
-        model->h_cell[well.cell_id * var_size] += model->solveSource_p0(well);
+        model->h_cell[well.cell_id * var_size] += model->solveSource_p0(well, model->x_cell);
 
-	for (int i = 0; i < var_size * cells_size; i++)
+	for (int i = 0; i < var_size * size; i++)
 		model->h_cell[i] >>= y0[i];
 
 	trace_off();
+	jac_p0.retaped();
 }
 void DualStochOilMethod::computeJac_Cfp(const int cell_id)
 {
 	trace_on(1);
 
-	const auto& cur_cell = cell_mesh->cells[cell_id];
-	for (size_t i = 0; i < cells_size; i++)
-		model->x_cell[i] <<= model->Cfp_next[cells_size * cell_id + i];
+	const auto& cur_cell = mesh->cells[cell_id];
+	for (size_t i = 0; i < size; i++)
+		model->x_cell[i] <<= model->Cfp_next[size * cell_id + i];
 
-	for (int i = 0; i < cells_size; i++)
+	for (int i = 0; i < size; i++)
 	{
-		const auto& cell = cell_mesh->cells[i];
-
-		if (cell.type == elem::QUAD)
-			model->h_cell[i] = model->solveInner_Cfp(cell, cur_cell) / model->P_dim;
-		else if (cell.type == elem::BORDER)
-			model->h_cell[i] = model->solveBorder_Cfp(cell, cur_cell);
+		const auto& cell = mesh->cells[i];
+		model->h_cell[i] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_Cfp(tag, cell, cur_cell); });
 	}
     for (const auto& well : model->wells)
         model->h_cell[well.cell_id] += model->solveSource_Cfp(well, cur_cell) / model->P_dim;
 
-	for (int i = 0; i < cells_size; i++)
+	for (int i = 0; i < size; i++)
 		model->h_cell[i] >>= y1[i];
 
 	trace_off();
+	jac_Cfp.retaped();
+}
+void DualStochOilMethod::computeJac_Cfp_node(const int node_id)
+{
+	trace_on(4);
+
+	const auto& cur_node = node_mesh->nodes[node_id];
+	for (size_t i = 0; i < nodes_size; i++)
+		model->x_node[i] <<= model->Cfp_next_node[nodes_size * node_id + i];
+
+	for (int i = 0; i < nodes_size; i++)
+	{
+		const auto& node = node_mesh->nodes[i];
+		model->h_node[i] = elem::dispatchNode(node.type, [&](auto tag) { return model->solveNode_Cfp(tag, node, cur_node); });
+	}
+
+	for (int i = 0; i < nodes_size; i++)
+		model->h_node[i] >>= y_node[i];
+
+	trace_off();
+	jac_Cfp_node.retaped();
 }
 void DualStochOilMethod::computeJac_p2()
 {
 	trace_on(2);
 
-	for (size_t i = 0; i < cells_size; i++)
+	for (size_t i = 0; i < size; i++)
 		model->x_cell[i] <<= model->p2_next[i * var_size];
 
-	for (int i = 0; i < cells_size; i++)
+	for (int i = 0; i < size; i++)
 	{
-		const auto& cell = cell_mesh->cells[i];
-
-        if (cell.type == elem::QUAD)
-            model->h_cell[i * var_size] = model->solveInner_p2(cell);
-        else if (cell.type == elem::BORDER)
-            model->h_cell[i * var_size] = model->solveBorder_p2(cell);
+		const auto& cell = mesh->cells[i];
+		model->h_cell[i * var_size] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_p2(tag, cell, model->x_cell); });
 	}
 
 	for (const auto& well : model->wells)
-		model->h_cell[well.cell_id * var_size] += model->solveSource_p2(well);
+		model->h_cell[well.cell_id * var_size] += model->solveSource_p2(well, model->x_cell);
 
-	for (int i = 0; i < var_size * cells_size; i++)
+	for (int i = 0; i < var_size * size; i++)
 		model->h_cell[i] >>= y0[i];
 
 	trace_off();
+	jac_p2.retaped();
 }
 void DualStochOilMethod::computeJac_Cp(const int cell_id, const size_t time_step)
 {
 	trace_on(3);
 
-	const auto& cur_cell = cell_mesh->cells[cell_id];
-	for (size_t i = 0; i < cells_size; i++)
-		model->x_cell[i] <<= model->Cp_next[time_step][cells_size * cell_id + i];
+	const auto& cur_cell = mesh->cells[cell_id];
+	for (size_t i = 0; i < size; i++)
+		model->x_cell[i] <<= model->Cp_next[time_step][size * cell_id + i];
 
-	for (int i = 0; i < cells_size; i++)
+	for (int i = 0; i < size; i++)
 	{
-		const auto& cell = cell_mesh->cells[i];
-
-        if (cell.type == elem::QUAD)
-            model->h_cell [i] = model->solveInner_Cp(cell, cur_cell, time_step, step_idx) / model->P_dim;
-		else if (cell.type == elem::BORDER)
-			model->h_cell[i] = model->solveBorder_Cp(cell, cur_cell, time_step);
+		const auto& cell = mesh->cells[i];
+		model->h_cell[i] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_Cp(tag, cell, cur_cell, time_step, step_idx); });
 	}
 	for (const auto& well : model->wells)
 		model->h_cell[well.cell_id] += model->solveSource_Cp(well, cur_cell, time_step) / model->P_dim;
 
-	for (int i = 0; i < cells_size; i++)
+	for (int i = 0; i < size; i++)
 		model->h_cell[i] >>= y1[i];
 
 	trace_off();
+	jac_Cp.retaped();
 }
 
 void DualStochOilMethod::fill_p0()
 {
-	sparse_jac(0, model->cellsNum, model->cellsNum, repeat,
-		&model->p0_next[0], &elemNum0, (unsigned int**)(&ind_i0), (unsigned int**)(&ind_j0), &a0, options);
+	evalJacobian(jac_p0, model->cellsNum, &model->p0_next[0], solver0);
 
 	int counter = 0;
-	for (int j = 0; j < cells_size; j++)
+	for (int j = 0; j < size; j++)
 	{
-		const auto& cell = cell_mesh->cells[j];
+		const auto& cell = mesh->cells[j];
 		rhs0[cell.id] = -y0[cell.id];
 	}
 }
 void DualStochOilMethod::fill_Cfp(const int cell_id)
 {
-	if(!avoidMatrixCalc)
-		sparse_jac(1, model->cellsNum, model->cellsNum, repeat,
-			&model->Cfp_next[cell_id * model->cellsNum], &elemNum1, (unsigned int**)(&ind_i1), (unsigned int**)(&ind_j1), &a1, options);
+	if (!avoidMatrixCalc)
+		evalJacobian(jac_Cfp, model->cellsNum, &model->Cfp_next[cell_id * model->cellsNum], solver1);
 
 	int counter = 0;
-	for (int j = 0; j < cells_size; j++)
+	for (int j = 0; j < size; j++)
 	{
-		const auto& cell = cell_mesh->cells[j];
+		const auto& cell = mesh->cells[j];
 		rhs1[cell.id] = -y1[cell.id];
 	}
 }
+void DualStochOilMethod::fill_Cfp_node(const int node_id)
+{
+	if (!avoidMatrixCalc_node)
+		evalJacobian(jac_Cfp_node, model->nodesNum, &model->Cfp_next_node[node_id * model->nodesNum], solver_node);
+
+	for (int j = 0; j < nodes_size; j++)
+		rhs_node[j] = -y_node[j];
+}
 void DualStochOilMethod::fill_p2()
 {
-	sparse_jac(2, model->cellsNum, model->cellsNum, repeat,
-		&model->p2_next[0], &elemNum0, (unsigned int**)(&ind_i0), (unsigned int**)(&ind_j0), &a0, options);
+	evalJacobian(jac_p2, model->cellsNum, &model->p2_next[0], solver0);
 
 	int counter = 0;
-	for (int j = 0; j < cells_size; j++)
+	for (int j = 0; j < size; j++)
 	{
-		const auto& cell = cell_mesh->cells[j];
+		const auto& cell = mesh->cells[j];
 		rhs0[cell.id] = -y0[cell.id];
 	}
 }
 void DualStochOilMethod::fill_Cp(const int cell_id, const size_t time_step)
 {
 	if (!avoidMatrixCalc)
-		sparse_jac(3, model->cellsNum, model->cellsNum, repeat,
-			&model->Cp_next[time_step][cell_id * model->cellsNum], &elemNum1, (unsigned int**)(&ind_i1), (unsigned int**)(&ind_j1), &a1, options);
+		evalJacobian(jac_Cp, model->cellsNum, &model->Cp_next[time_step][cell_id * model->cellsNum], solver1);
 
 	int counter = 0;
-	for (int j = 0; j < cells_size; j++)
+	for (int j = 0; j < size; j++)
 	{
-		const auto& cell = cell_mesh->cells[j];
+		const auto& cell = mesh->cells[j];
 		rhs1[cell.id] = -y1[cell.id];
 	}
 }
@@ -512,70 +561,40 @@ void DualStochOilMethod::copyTimeLayer()
 	model->Cfp[step_idx + 1] = model->Cfp[step_idx];
 	model->Cfp_prev = &model->Cfp[step_idx][0];
 	model->Cfp_next = &model->Cfp[step_idx + 1][0];
+	model->Cfp_node[step_idx + 1] = model->Cfp_node[step_idx];
+	model->Cfp_prev_node = &model->Cfp_node[step_idx][0];
+	model->Cfp_next_node = &model->Cfp_node[step_idx + 1][0];
 	
 	model->p2_prev = model->p2_iter = model->p2_next;
 
 	model->Cp_prev = model->Cp_next;
 }
-void DualStochOilMethod::copyIterLayer_p0()
-{
-	model->p0_iter = model->p0_next;
-}
-void DualStochOilMethod::copyIterLayer_p2()
-{
-	model->p2_iter = model->p2_next;
-}
-
-double DualStochOilMethod::convergance_p0(int& ind, int& varInd)
-{
-	double relErr = 0.0;
-	double cur_relErr = 0.0;
-
-	varInd = 0;
-	auto diff = std::abs((model->p0_next - model->p0_iter) / model->p0_next);
-	auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-	ind = std::distance(std::begin(diff), max_iter);
-
-	return *max_iter;
-}
-double DualStochOilMethod::convergance_p2(int& ind, int& varInd)
-{
-	double relErr = 0.0;
-	double cur_relErr = 0.0;
-
-	varInd = 0;
-	auto diff = std::abs((model->p2_next - model->p2_iter) / model->p2_next);
-	auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-	ind = std::distance(std::begin(diff), max_iter);
-
-	return *max_iter;
-}
 
 double DualStochOilMethod::averValue_p0() const 
 {
 	double aver = 0.0;
-	for (const auto& cell : cell_mesh->cells)
+	for (const auto& cell : mesh->cells)
 		aver += model->p0_next[cell.id] * cell.V;
 	return aver / model->Volume;
 }
 double DualStochOilMethod::averValue_Cfp(const int cell_id) const
 {
 	double aver = 0.0;
-	for (const auto& cell : cell_mesh->cells)
+	for (const auto& cell : mesh->cells)
 		aver += model->Cfp_next[cell_id * model->cellsNum + cell.id] * cell.V;
 	return aver / model->Volume;
 }
 double DualStochOilMethod::averValue_p2() const
 {
 	double aver = 0.0;
-	for (const auto& cell : cell_mesh->cells)
+	for (const auto& cell : mesh->cells)
 		aver += model->p2_next[cell.id] * cell.V;
 	return aver / model->Volume;
 }
 double DualStochOilMethod::averValue_Cp(const int cell_id, const size_t time_step) const
 {
 	double aver = 0.0;
-	for (const auto& cell : cell_mesh->cells)
+	for (const auto& cell : mesh->cells)
 		aver += model->Cp_next[time_step][cell_id * model->cellsNum + cell.id] * cell.V;
 	return aver / model->Volume;
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include "src/model/dual_stoch_oil/DualStochOil.hpp"
 #include "src/utils/ParalutionInterface.h"
 
+#include <mutex>
+
 namespace dual_stoch_oil
 {
 	class DualStochOilMethod : public AbstractDualGridMethod<DualStochOil>
@@ -12,29 +14,30 @@ namespace dual_stoch_oil
 	protected:
 		void control();
 		void writeData();
+		void prepare();
 
 		void solveStep();
 		void solveStep_p0();
+		// Cell and node covariance sweeps run concurrently
 		void solveStep_Cfp();
+		void solveStep_Cfp_cells();
+		void solveStep_Cfp_nodes();
 		void solveStep_p2();
 		void solveStep_Cp();
 
 		std::ofstream plot_P, plot_Q, pvd;
 		ParSolver solver0, solver1, solver_node;
-		int step_idx;
 		double averVal, averValPrev, dAverVal;
 
 		static const int var_size = 1;
-		
-		double* dmat;
-		int* offset;
-		int* col;
+
         // First solver
 		double** jac0;
 		double* y0;
 		int* ind_i0;
 		int* ind_j0;
-		double* a0;
+		// Jacobians of p0, Cfp, p2 & Cp tapes, values go to pinned CSR of the solvers
+		TapeJacobian jac_p0, jac_Cfp, jac_p2, jac_Cp;
 		int* ind_rhs0;
 		double* rhs0;
 		int* cols0;
@@ -44,48 +47,47 @@ namespace dual_stoch_oil
 		double* y1;
 		int* ind_i1;
 		int* ind_j1;
-		double* a1;
 		int* ind_rhs1;
 		double* rhs1;
 		int* cols1;
 		int elemNum1;
-        // Node solver
-        double** jac_node;
+        // Node solver with its own pattern and cached inverse
         double* y_node;
         int* ind_i_node;
         int* ind_j_node;
-        double* a_node;
+        TapeJacobian jac_Cfp_node;
         int* ind_rhs_node;
         double* rhs_node;
         int* cols_node;
         int elemNum_node;
+        double* dmat_node;
+        int* offset_node;
+        int* col_node;
 
-		bool avoidMatrixCalc;
+		bool avoidMatrixCalc_node;
+		// ADOL-C keeps global state, so taping and sparse_jac of both sweeps are serialized
+		std::mutex tapeMutex;
 
 		void computeJac_p0();
 		void computeJac_Cfp(const int cell_id);
+		void computeJac_Cfp_node(const int node_id);
 		void computeJac_p2();
 		void computeJac_Cp(const int cell_id, const size_t time_step);
 		void fillIndices();
 		void fill_p0();
 		void fill_Cfp(const int cell_id);
+		void fill_Cfp_node(const int node_id);
 		void fill_p2();
 		void fill_Cp(const int cell_id, const size_t time_step);
-		void copySolution_p0(const paralution::LocalVector<double>& sol);
 		void copySolution_Cfp(const int cell_id, const paralution::LocalVector<double>& sol);
 		void copySolution_Cfp(const int cell_id);
-		void copySolution_p2(const paralution::LocalVector<double>& sol);
+		void copySolution_Cfp_node(const int node_id);
 		void copySolution_Cp(const int cell_id, const paralution::LocalVector<double>& sol, const size_t time_step);
 		void copySolution_Cp(const int cell_id, const size_t time_step);
 		void checkInvertMatrix() const;
 
 
 		void copyTimeLayer();
-		void copyIterLayer_p0();
-		void copyIterLayer_p2();
-
-		double convergance_p0(int& ind, int& varInd);
-		double convergance_p2(int& ind, int& varInd);
 
 		double averValue_p0() const;
 		double averValue_Cfp(const int cell_id) const;
@@ -95,7 +97,7 @@ namespace dual_stoch_oil
 		DualStochOilMethod(Model* _model);
 		~DualStochOilMethod();
 
-		void start();
+		bool restart();
 	};
 };
 
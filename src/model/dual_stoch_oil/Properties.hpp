@@ -2,8 +2,11 @@
 #define DUAL_STOCH_OIL_PROPERTIES_HPP_
 
 #include <vector>
+#include <string>
 #include <utility>
 #include "src/Well.hpp"
+#include "src/utils/CovKernel.hpp"
+#include "src/utils/Checkpoint.hpp"
 
 #include "adolc/adouble.h"
 #include "adolc/taping.h"
@@ -20,6 +23,9 @@ namespace dual_stoch_oil
 		double perm;
         std::vector<double> perm_grd;
 		double sigma_f, l_f;
+        // Log-permeability covariance function and its support radius (0 - kernel default)
+        cov::KernelType kernel;
+        double cov_radius;
 	};
 	struct Oil_Props
 	{
@@ -60,8 +66,14 @@ namespace dual_stoch_oil
 
 		int num_x, num_y;
 		double hx, hy, hz;
+		// Threads of matrix assembly (0 - hardware concurrency)
+		int assembly_threads;
+		// Directory of snapshots, plots and CPS maps
+		std::string out_dir;
 
         std::vector<Measurement> conditions;
+        // Not supported by dual grid methods yet, kept for uniform scene setup
+        CheckpointProps checkpoint;
 	};
 };
 
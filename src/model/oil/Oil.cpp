@@ -12,6 +12,8 @@ Oil::~Oil()
 }
 void Oil::setProps(const Properties& props)
 {
+	if (!props.out_dir.empty())
+		out_dir = props.out_dir;
 	R_dim = props.R_dim;
 	t_dim = props.t_dim;
 	Q_dim = R_dim * R_dim * R_dim / t_dim;
@@ -22,6 +24,8 @@ void Oil::setProps(const Properties& props)
 	u_prev.resize(varNum);
 	u_iter.resize(varNum);
 	u_next.resize(varNum);
+	pvt_prev.resize(cellsNum);
+	pvt_iter.resize(cellsNum);
 	x = new TapeVariable[cellsNum];
 	h = new adouble[var_size * cellsNum];
 	Volume = mesh.get()->V;
@@ -29,6 +33,9 @@ void Oil::setProps(const Properties& props)
 	ht = props.ht;
 	ht_min = props.ht_min;
 	ht_max = props.ht_max;
+	checkpoint_props = props.checkpoint;
+	reference_dir = props.reference_dir;
+	reference_tol = props.reference_tol;
 
 	props_sk = props.props_sk;
 	props_sk.perm = MilliDarcyToM2(props_sk.perm);
@@ -37,14 +44,22 @@ void Oil::setProps(const Properties& props)
 	props_oil.visc = cPToPaSec(props_oil.visc);
 
 	wells = props.wells;
-	for (int i = 0; i < wells.back().periodsNum; i++)
-	{
-		auto& well = wells[i];
-		if (well.leftBoundIsRate[i])
-			well.rate[i] /= 86400.0;
-	}
+	for (auto& well : wells)
+		for (auto& rate : well.rate)
+			rate /= 86400.0;
 
 	makeDimLess();
+
+	auto b_data = props.b_data;
+	if (!props.b_file.empty())
+		setDataFromFile(b_data, props.b_file);
+	if (!b_data.empty())
+		props_oil.b_table.reset(setDataset(b_data, P_dim / BAR_TO_PA, 1.0, Interpolate::MONOTONE_CUBIC));
+	auto visc_data = props.visc_data;
+	if (!props.visc_file.empty())
+		setDataFromFile(visc_data, props.visc_file);
+	if (!visc_data.empty())
+		props_oil.visc_table.reset(setDataset(visc_data, P_dim / BAR_TO_PA, P_dim * t_dim / cPToPaSec(1.0), Interpolate::MONOTONE_CUBIC));
 }
 void Oil::makeDimLess()
 {
@@ -91,15 +106,32 @@ void Oil::setInitialState()
 }
 void Oil::setPeriod(const int period)
 {
-	for (auto& well : wells)
+	// Interval of merged schedule, every well follows its own period within it
+	for (int w = 0; w < wells.size(); w++)
 	{
-		well.cur_bound = well.leftBoundIsRate[period];
+		auto& well = wells[w];
+		well.cur_period = schedule.getPeriod(period, w);
+		well.cur_bound = well.leftBoundIsRate[well.cur_period];
 		if (well.cur_bound)
-			well.cur_rate = well.rate[period];
+			well.cur_rate = well.rate[well.cur_period];
 		else
-			well.cur_pwf = well.pwf[period];
+			well.cur_pwf = well.pwf[well.cur_period];
 	}
 }
+void Oil::saveState(Checkpoint& chk) const
+{
+	chk.add("ht", &ht, sizeof(ht));
+	chk.add("u_prev", &u_prev[0], varNum * sizeof(double));
+	chk.add("u_iter", &u_iter[0], varNum * sizeof(double));
+	chk.add("u_next", &u_next[0], varNum * sizeof(double));
+}
+void Oil::loadState(Checkpoint& chk)
+{
+	chk.get("ht", &ht, sizeof(ht));
+	chk.get("u_prev", &u_prev[0], varNum * sizeof(double));
+	chk.get("u_iter", &u_iter[0], varNum * sizeof(double));
+	chk.get("u_next", &u_next[0], varNum * sizeof(double));
+}
 double Oil::getRate(const Well& well) const
 {
 	if (well.cur_bound)
@@ -107,7 +139,7 @@ double Oil::getRate(const Well& well) const
 	else
 	{
 		double p_cell = (*this)[well.cell_id].u_next.p0;
-		return well.WI * (p_cell - well.cur_pwf) / props_oil.visc;
+		return well.WI * (p_cell - well.cur_pwf) / props_oil.getViscosity(p_cell);
 	}
 }
 double Oil::getPwf(const Well& well) const
@@ -115,7 +147,7 @@ double Oil::getPwf(const Well& well) const
 	if (well.cur_bound)
 	{
 		double p_cell = (*this)[well.cell_id].u_next.p0;
-		return p_cell - well.cur_rate * props_oil.visc / well.WI;
+		return p_cell - well.cur_rate * props_oil.getViscosity(p_cell) / well.WI;
 	}
 	else
 		return well.cur_pwf;
@@ -126,21 +158,18 @@ adouble Oil::solveInner(const Cell& cell) const
 	assert(cell.type == elem::QUAD);
 
 	const auto& next = x[cell.id];
-	const auto prev = (*this)[cell.id].u_prev;
-	adouble H = getPoro(cell) * props_oil.getDensity(next.p0) - getPoro(cell) * props_oil.getDensity(prev.p0);
+	adouble H = getPoro(cell) * getDensity(cell.id, next.p0) - getPoro(cell) * pvt_prev.rho[cell.id];
 	adouble interp_middle;
+	const adouble mob = getMobility(cell.id, next.p0);
 
 	for (int i = 0; i < 4; i++)
 	{
 		const Cell& beta = mesh->cells[cell.stencil[i + 1]];
 		const auto& nebr = x[cell.stencil[i + 1]];
 		if (abs(cell.id - beta.id) == 1)
-			interp_middle = linearInterp1d(props_oil.getDensity(next.p0) / props_oil.getViscosity(next.p0), cell.hy,
-				props_oil.getDensity(nebr.p0) / props_oil.getViscosity(nebr.p0), beta.hy);
+			interp_middle = linearInterp1d(mob, cell.hy, getMobility(beta.id, nebr.p0), beta.hy);
 		else
-			interp_middle = linearInterp1d(props_oil.getDensity(next.p0) / props_oil.getViscosity(next.p0), cell.hx,
-				props_oil.getDensity(nebr.p0) / props_oil.getViscosity(nebr.p0), beta.hx);
-		double inter = interp_middle.value();
+			interp_middle = linearInterp1d(mob, cell.hx, getMobility(beta.id, nebr.p0), beta.hx);
 		H += ht / cell.V * cell.trans[i] * interp_middle * (next.p0 - nebr.p0);
 	}
 
@@ -5,6 +5,7 @@
 #include "src/grid/Variables.hpp"
 #include "src/grid/Mesh.hpp"
 #include "src/model/oil/Properties.hpp"
+#include "src/utils/Checkpoint.hpp"
 #include "src/Well.hpp"
 
 namespace oil
@@ -13,7 +14,9 @@ namespace oil
 	class Oil : public AbstractModel<Properties, mesh::CellRectangularUniformGrid,Oil,var::BasicVariables,var::containers::Var1phase>
 	{
 		template<typename> friend class snapshotter::VTKSnapshotter;
-		template<typename> friend class AbstractMethod;
+		template<typename> friend class ::CellGridPolicy;
+		template<typename> friend class ::DualGridPolicy;
+		template<class, template <class> class, class> friend class ::MethodDriver;
 		friend class OilMethod;
 	protected:
 		void makeDimLess();
@@ -25,6 +28,36 @@ namespace oil
 		Skeleton_Props props_sk;
 		Oil_Props props_oil;
 		std::vector<Well> wells;
+		// Fluid properties at previous time layer and at current Newton iterate
+		PVTArrays pvt_prev, pvt_iter;
+		// Checkpointing of pressure layers and time step
+		CheckpointProps checkpoint_props;
+		// Plots of another run, e.g. with constant viscosity instead of the table
+		std::string reference_dir;
+		double reference_tol;
+		void saveState(Checkpoint& chk) const;
+		void loadState(Checkpoint& chk);
+
+		// Cells [begin, end), arrays are resized by setProps
+		inline void evaluatePVT(const std::valarray<double>& u, PVTArrays& res, const int begin, const int end) const
+		{
+			props_oil.evaluate(&u[0], begin, end, var_size, res);
+		};
+		// Property linearized about the iterate: exact value and derivative there
+		// make the same Newton step as the full expression with only one node on tape
+		inline adouble linearize(const double val, const double dval, const int id, const adouble& p) const
+		{
+			return val + dval * (p - pvt_iter.p[id]);
+		};
+		inline adouble getDensity(const int id, const adouble& p) const
+		{
+			return linearize(pvt_iter.rho[id], pvt_iter.drho[id], id, p);
+		};
+		inline adouble getMobility(const int id, const adouble& p) const
+		{
+			const double rho = pvt_iter.rho[id], visc = pvt_iter.visc[id];
+			return linearize(rho / visc, (pvt_iter.drho[id] * visc - rho * pvt_iter.dvisc[id]) / visc / visc, id, p);
+		};
 
 		inline double getPoro(const Cell& cell) const
 		{
@@ -34,6 +67,10 @@ namespace oil
 		{
 			return props_sk.perm;
 		};
+		inline double getGeomPerm(const Cell& cell) const
+		{
+			return getPerm(cell);
+		};
 		inline double getFavg(const Cell& cell) const
 		{
 			return log(getPerm(cell) / props_oil.visc);
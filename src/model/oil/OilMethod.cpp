@@ -1,6 +1,8 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <stdexcept>
 #include "src/model/oil/OilMethod.hpp"
 
 #include "adolc/sparse/sparsedrivers.h"
@@ -8,7 +10,7 @@
 
 using namespace oil;
 
-OilMethod::OilMethod(Model* _model) : AbstractMethod<Model>(_model)
+OilMethod::OilMethod(Model* _model) : AbstractMethod<Model, DeterministicMoments>(_model)
 {
 	const int strNum = var_size * model->cellsNum;
 
@@ -25,12 +27,15 @@ OilMethod::OilMethod(Model* _model) : AbstractMethod<Model>(_model)
 	//options[2] = 0;          /*              not required if options[0] = 0 */
 	//options[3] = 0;          /*                column compression (default) */
 
-	pvd.open("snaps/Oil.pvd", std::ofstream::out);
+	pvd.open(model->getOutDir() + "Oil.pvd", std::ofstream::out);
 	pvd << "<VTKFile type = \"Collection\" version = \"1.0\" byte_order = \"LittleEndian\" header_type = \"UInt64\">\n";
 	pvd << "\t<Collection>\n";
 
-	plot_P.open("snaps/P.dat", std::ofstream::out);
-	plot_Q.open("snaps/Q.dat", std::ofstream::out);
+	plot_P.open(model->getOutDir() + "P.dat", std::ofstream::out);
+	plot_Q.open(model->getOutDir() + "Q.dat", std::ofstream::out);
+	plot_P << std::setprecision(12);
+	plot_Q << std::setprecision(12);
+	loadReference();
 };
 OilMethod::~OilMethod()
 {
@@ -39,9 +44,12 @@ OilMethod::~OilMethod()
 	//	delete[] jac[i];
 	//delete[] jac;
 
-	delete[] ind_i, ind_j, ind_rhs;
+	delete[] ind_i;
+	delete[] ind_j;
+	delete[] ind_rhs;
 	//delete[] cols;
-	delete[] a, rhs;
+	delete[] a;
+	delete[] rhs;
 
 	plot_P.close();
 	plot_Q.close();
@@ -49,34 +57,127 @@ OilMethod::~OilMethod()
 	pvd << "</VTKFile>\n";
 	pvd.close();
 };
+void OilMethod::start()
+{
+	AbstractMethod<Model, DeterministicMoments>::start();
+	// Run stopped at checkpoint is compared after restart
+	if (cur_t < Tt)
+		return;
+	const double err = reportReference();
+	if (model->reference_tol > 0.0 && err > model->reference_tol)
+		throw std::runtime_error("Wells deviate from " + model->reference_dir + " by " + std::to_string(err) +
+								", more than reference_tol = " + std::to_string(model->reference_tol));
+}
 void OilMethod::writeData()
 {
-	double p = 0.0, q = 0;
-
 	plot_Q << cur_t * t_dim / 3600.0;
 	plot_P << cur_t * t_dim / 3600.0;
 
+	std::vector<double> P, Q;
 	for (const auto& well : model->wells)
 	{
-		plot_Q << "\t" << model->getRate(well) * model->Q_dim * 86400.0;
-		plot_P << "\t" << model->getPwf(well) * model->P_dim / BAR_TO_PA;
+		Q.push_back(model->getRate(well) * model->Q_dim * 86400.0);
+		P.push_back(model->getPwf(well) * model->P_dim / BAR_TO_PA);
+		plot_Q << "\t" << Q.back();
+		plot_P << "\t" << P.back();
 	}
+	compareReference(P, Q);
 
 	plot_Q << std::endl;
 	plot_P << std::endl;
 
-	pvd << "\t\t<DataSet part=\"0\" timestep=\"" + to_string(cur_t * t_dim / 3600.0) +
-		"0\" file=\"Oil_" + to_string(step_idx) + ".vtu\"/>\n";
+	pvd << "\t\t<DataSet part=\"0\" timestep=\"" + std::to_string(cur_t * t_dim / 3600.0) +
+		"0\" file=\"Oil_" + std::to_string(step_idx) + ".vtu\"/>\n";
+}
+void OilMethod::loadReference()
+{
+	ref_row = 0;
+	ref_time_mismatch = 0;
+	if (model->reference_dir.empty())
+		return;
+
+	const size_t wellsNum = model->wells.size();
+	auto read = [wellsNum](const std::string& fileName, std::vector<std::vector<double>>& rows)
+	{
+		std::ifstream file(fileName);
+		if (!file.is_open())
+			throw std::runtime_error("Cannot open reference plot " + fileName);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream ss(line);
+			std::vector<double> row;
+			double val;
+			while (ss >> val)
+				row.push_back(val);
+			if (row.empty())
+				continue;
+			if (row.size() != 1 + wellsNum)
+				throw std::runtime_error(fileName + ": columns do not match wells of the scenario");
+			rows.push_back(row);
+		}
+	};
+	read(model->reference_dir + "P.dat", ref_P);
+	read(model->reference_dir + "Q.dat", ref_Q);
+
+	ref_err_P.assign(wellsNum, 0.0);	ref_err_Q.assign(wellsNum, 0.0);
+	ref_max_P.assign(wellsNum, 0.0);	ref_max_Q.assign(wellsNum, 0.0);
+}
+void OilMethod::compareReference(const std::vector<double>& P, const std::vector<double>& Q)
+{
+	if (ref_row >= ref_P.size() || ref_row >= ref_Q.size())
+		return;
+
+	// Steps are matched by number, both runs take the same steps for the same schedule
+	const double t = cur_t * t_dim / 3600.0;
+	const auto& row_P = ref_P[ref_row];
+	const auto& row_Q = ref_Q[ref_row];
+	if (fabs(row_P[0] - t) > 1.E-6 * std::max(1.0, t))
+		ref_time_mismatch++;
+	for (size_t w = 0; w < P.size(); w++)
+	{
+		ref_err_P[w] = std::max(ref_err_P[w], fabs(P[w] - row_P[1 + w]));
+		ref_err_Q[w] = std::max(ref_err_Q[w], fabs(Q[w] - row_Q[1 + w]));
+		ref_max_P[w] = std::max(ref_max_P[w], fabs(row_P[1 + w]));
+		ref_max_Q[w] = std::max(ref_max_Q[w], fabs(row_Q[1 + w]));
+	}
+	ref_row++;
+}
+double OilMethod::reportReference() const
+{
+	if (ref_P.empty())
+		return 0.0;
+
+	// Deviations are scaled by the largest reference value of the well, zero values give absolute ones
+	std::cout << "Wells against " << model->reference_dir << ": " << ref_row << " steps compared";
+	if (ref_time_mismatch > 0)
+		std::cout << ", " << ref_time_mismatch << " of them at different times";
+	std::cout << std::endl;
+	double err = 0.0;
+	for (size_t w = 0; w < ref_err_P.size(); w++)
+	{
+		const double err_P = ref_err_P[w] / (ref_max_P[w] > 0.0 ? ref_max_P[w] : 1.0);
+		const double err_Q = ref_err_Q[w] / (ref_max_Q[w] > 0.0 ? ref_max_Q[w] : 1.0);
+		std::cout << "\twell " << w << ": pwf max rel. error = " << err_P << ", rate max rel. error = " << err_Q << std::endl;
+		err = std::max(err, std::max(err_P, err_Q));
+	}
+	// Runs of different length are not comparable
+	if (ref_time_mismatch > 0 || ref_row != ref_P.size())
+		err = std::max(err, 1.0);
+	return err;
 }
 void OilMethod::control()
 {
 	writeData();
 
-	if (cur_t >= model->wells[0].period[curTimePeriod])
+	const auto& schedule = model->schedule;
+	if (cur_t >= schedule.getTime(curTimePeriod))
 	{
 		curTimePeriod++;
-		model->ht = model->ht_min;
 		model->setPeriod(curTimePeriod);
+		// New rate or BHP needs small steps again, other events only split the step
+		if (schedule.isControlChange(curTimePeriod))
+			model->ht = model->ht_min;
 	}
 
 	model->ht *= 1.5;
@@ -85,32 +186,37 @@ void OilMethod::control()
 	//else if (iterations > 6 && model->ht > model->ht_min)
 	//	model->ht = model->ht / 1.5;
 
-	if (cur_t + model->ht > model->wells[0].period[curTimePeriod])
-		model->ht = model->wells[0].period[curTimePeriod] - cur_t;
-
-	cur_t += model->ht;
+	if (cur_t + model->ht >= schedule.getTime(curTimePeriod))
+	{
+		model->ht = schedule.getTime(curTimePeriod) - cur_t;
+		cur_t = schedule.getTime(curTimePeriod);
+	}
+	else
+		cur_t += model->ht;
 }
-void OilMethod::start()
+void OilMethod::prepare()
 {
-	step_idx = 0;
-
 	fillIndices();
 	solver.Init(Model::var_size * model->cellsNum, 1.e-15, 1.e-15);
+}
+void OilMethod::fillIndices()
+{
+	int counter = 0;
 
-	model->setPeriod(curTimePeriod);
-	while (cur_t < Tt)
+	for (int i = 0; i < size; i++)
 	{
-		control();
-		model->snapshot_all(step_idx++);
-		doNextStep();
-		copyTimeLayer();
-		cout << "---------------------NEW TIME STEP---------------------" << std::endl;
-		cout << std::setprecision(6);
-		cout << "time = " << cur_t << std::endl;
+		auto& cell = mesh->cells[i];
+		getMatrixStencil(cell);
+		counter += elem::dispatchCell(cell.type, [&](auto tag)
+		{
+			return elem::fillBlockRow<var_size>(tag, cell, ind_i + counter, ind_j + counter);
+		});
 	}
 
-	model->snapshot_all(step_idx);
-	writeData();
+	elemNum = counter;
+
+	for (int i = 0; i < var_size * model->cellsNum; i++)
+		ind_rhs[i] = i;
 }
 void OilMethod::solveStep()
 {
@@ -118,11 +224,14 @@ void OilMethod::solveStep()
 	double err_newton = 1.0;
 	averValue(averValPrev);
 	std::fill(dAverVal.begin(), dAverVal.end(), 1.0);
+	// Properties are evaluated by strips, taping below stays serial: ADOL-C tape is global
+	partition.run([this](const int begin, const int end) { model->evaluatePVT(model->u_prev, model->pvt_prev, begin, end); });
 	
 	iterations = 0;
 	while (err_newton > 1.e-4 && dAverVal[0] > 1.e-7 && iterations < 20)
 	{
 		copyIterLayer();
+		partition.run([this](const int begin, const int end) { model->evaluatePVT(model->u_next, model->pvt_iter, begin, end); });
 		computeJac();
 		fill();
 		solver.Assemble(ind_i, ind_j, a, elemNum, ind_rhs, rhs);
@@ -143,7 +252,7 @@ void OilMethod::copySolution(const paralution::LocalVector<double>& sol)
 {
 	for (int i = 0; i < size; i++)
 	{
-		auto& var = (*model)[i].u_next;
+		auto var = (*model)[i].u_next;
 		var.p0 += sol[Model::var_size * i];
 	}
 }
@@ -7,18 +7,29 @@
 
 namespace oil
 {
-	class OilMethod : public AbstractMethod<Oil>
+	class OilMethod : public AbstractMethod<Oil, DeterministicMoments>
 	{
 	protected:
 		void control();
+		void prepare();
 		void solveStep();
 		void writeData();
 
 		std::ofstream plot_P, plot_Q, pvd;
+		// Well rates and pressures against P.dat & Q.dat of the reference run: max deviations
+		// and max reference values per well, in units of the plots
+		std::vector<std::vector<double>> ref_P, ref_Q;
+		std::vector<double> ref_err_P, ref_err_Q, ref_max_P, ref_max_Q;
+		size_t ref_row;
+		int ref_time_mismatch;
+		void loadReference();
+		void compareReference(const std::vector<double>& P, const std::vector<double>& Q);
+		// Max of the relative deviations over wells
+		double reportReference() const;
 		ParSolver solver;
-		int step_idx;
 		std::array<double, var_size> averVal, averValPrev, dAverVal;
 
+		void fillIndices();
 		void computeJac();
 		void fill();
 		void copySolution(const paralution::LocalVector<double>& sol);
@@ -26,6 +37,7 @@ namespace oil
 		OilMethod(Model* _model);
 		~OilMethod();
 
+		// Run fails if wells deviate from the reference run more than reference_tol
 		void start();
 	};
 };
@@ -3,13 +3,30 @@
 
 #include <vector>
 #include <utility>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <cmath>
 #include "src/Well.hpp"
+#include "src/utils/Interpolate.h"
+#include "src/utils/Checkpoint.hpp"
 
 #include "adolc/adouble.h"
 #include "adolc/taping.h"
 
 namespace oil
 {
+	// Fluid properties and their pressure derivatives over cells
+	struct PVTArrays
+	{
+		std::vector<double> p, B, dB, rho, drho, visc, dvisc;
+		void resize(const size_t n)
+		{
+			p.resize(n);	B.resize(n);	dB.resize(n);
+			rho.resize(n);	drho.resize(n);
+			visc.resize(n);	dvisc.resize(n);
+		};
+	};
 	struct Skeleton_Props
 	{
 		double m;
@@ -25,8 +42,12 @@ namespace oil
 		double beta;
 
 		double p_ref;
+		// Tables of dimensionless B(p) and viscosity(p) replace closed forms when set
+		std::shared_ptr<Interpolate> b_table, visc_table;
 		inline adouble getB(adouble p) const
 		{
+			if (b_table)
+				return b_table->Solve(p);
 			return exp(-(adouble)beta * (p - p_ref));
 		};
 		inline adouble getDensity(adouble p) const
@@ -35,9 +56,56 @@ namespace oil
 		};
 		inline adouble getViscosity(const adouble p) const
 		{
+			if (visc_table)
+				return visc_table->Solve(p);
 			return (adouble)(visc);
 		};
+		inline double getViscosity(const double p) const
+		{
+			if (visc_table)
+				return visc_table->Solve(p);
+			return visc;
+		};
+		// B(p), density and viscosity with derivatives for pressures [begin, end) taken with stride,
+		// table lookups and exponents run as flat loops over whole ranges. res is sized by caller,
+		// disjoint ranges may be evaluated concurrently
+		inline void evaluate(const double* p_src, const size_t begin, const size_t end, const size_t stride, PVTArrays& res) const
+		{
+			const size_t n = end - begin;
+			for (size_t i = begin; i < end; i++)
+				res.p[i] = p_src[i * stride];
+
+			const double* p = res.p.data() + begin;
+			double* B = res.B.data() + begin;
+			double* dB = res.dB.data() + begin;
+			if (b_table)
+				b_table->Solve(p, B, dB, n);
+			else
+			{
+				for (size_t i = 0; i < n; i++)
+					B[i] = exp(-beta * (p[i] - p_ref));
+				for (size_t i = 0; i < n; i++)
+					dB[i] = -beta * B[i];
+			}
 
+			double* rho = res.rho.data() + begin;
+			double* drho = res.drho.data() + begin;
+			for (size_t i = 0; i < n; i++)
+			{
+				rho[i] = rho_stc / B[i];
+				drho[i] = -rho[i] * dB[i] / B[i];
+			}
+
+			double* visc_res = res.visc.data() + begin;
+			double* dvisc_res = res.dvisc.data() + begin;
+			if (visc_table)
+				visc_table->Solve(p, visc_res, dvisc_res, n);
+			else
+			{
+				std::fill(visc_res, visc_res + n, visc);
+				std::fill(dvisc_res, dvisc_res + n, 0.0);
+			}
+		};
 	};
 	struct Properties
 	{
@@ -51,6 +119,18 @@ namespace oil
 
 		int num_x, num_y;
 		double hx, hy, hz;
+		// Threads of matrix assembly (0 - hardware concurrency)
+		int assembly_threads;
+		// Directory of snapshots and plots
+		std::string out_dir;
+		CheckpointProps checkpoint;
+		// Plots of another run to compare with and max relative deviation of wells from them (0 - only reported)
+		std::string reference_dir;
+		double reference_tol;
+		// Tabulated B(p) [bar, -] and viscosity(p) [bar, cP], closed forms are used if empty
+		std::vector<std::pair<double, double>> b_data, visc_data;
+		// Two-column text files appended to the tables above
+		std::string b_file, visc_file;
 	};
 };
 
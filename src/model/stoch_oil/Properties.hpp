@@ -2,8 +2,13 @@
 #define STOCH_OIL_PROPERTIES_HPP_
 
 #include <vector>
+#include <string>
 #include <utility>
 #include "src/Well.hpp"
+#include "src/utils/CovKernel.hpp"
+#include "src/utils/MappedField.hpp"
+#include "src/utils/Checkpoint.hpp"
+#include "src/utils/StepController.hpp"
 
 #include "adolc/adouble.h"
 #include "adolc/taping.h"
@@ -20,6 +25,9 @@ namespace stoch_oil
 		double perm;
         std::vector<double> perm_grd;
 		double sigma_f, l_f;
+        // Log-permeability covariance function and its support radius (0 - kernel default)
+        cov::KernelType kernel;
+        double cov_radius;
 	};
 	struct Oil_Props
 	{
@@ -51,6 +59,7 @@ namespace stoch_oil
 	{
 		double ht, ht_min, ht_max;
 		int possible_steps_num, start_time_simple_approx;
+        StepControlProps step_control;
 
 		Skeleton_Props props_sk;
 		Oil_Props props_oil;
@@ -60,8 +69,23 @@ namespace stoch_oil
 
 		int num_x, num_y;
 		double hx, hy, hz;
+		// Threads of matrix assembly (0 - hardware concurrency)
+		int assembly_threads;
+		// Directory of snapshots, plots and CPS maps
+		std::string out_dir;
 
         std::vector<Measurement> conditions;
+        // Karhunen-Loeve truncation of Cf: fraction of total variance to be kept (0 disables expansion)
+        double kl_energy;
+        // Upper bound for the number of kept modes (0 - unbounded)
+        int kl_max_modes;
+        // Placement of Cfp & Cp
+        StoreProps storage;
+        // Dense Cf is kept in bfloat16 once conditioning and KL basis are built
+        bool cf_bf16;
+        // Directory of P.dat & Q.dat of a full precision run, variances are compared with them (empty - no comparison)
+        std::string reference_dir;
+        CheckpointProps checkpoint;
 	};
 };
 
@@ -1,6 +1,11 @@
 #include "src/model/stoch_oil/StochOil.hpp"
+#include "src/utils/CovFill.hpp"
 
 #include <valarray>
+#include <algorithm>
+#include <sstream>
+#include <cstdint>
+#include <stdexcept>
 
 #include <assert.h>
 #include <boost/math/special_functions/expint.hpp>
@@ -13,25 +18,15 @@ using boost::math::expint;
 StochOil::StochOil()
 {
     inv_cond_cov = NULL;
+    donor = NULL;
+    cov_threads = 0;
+    cf_bf16 = false;
+    isPriorAdopted = false;
 }
 StochOil::~StochOil()
 {
-	delete[] x, h;
-}
-void StochOil::loadPermAvg(const std::string fileName)
-{
-    std::ifstream file(fileName.c_str(), std::ifstream::in);
-    std::string buf;
-    std::string::size_type sz;
-    while(buf != "PERMX")
-        file >> buf;
-    file >> buf;
-    while (buf != "/")
-    {
-        props_sk.perm_grd.push_back(MilliDarcyToM2(std::stod(buf, &sz)));
-        file >> buf;
-    }
-    file.close();
+	delete[] x;
+	delete[] h;
 }
 void StochOil::writeCPS(const int i)
 {
@@ -51,7 +46,7 @@ void StochOil::writeCPS(const int i)
     };
     auto writePres = [&](const int i)
     {
-        const std::string filename = "snaps/Pres_" + std::to_string(i) + ".cps";
+        const std::string filename = out_dir + "Pres_" + std::to_string(i) + ".cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -73,7 +68,7 @@ void StochOil::writeCPS(const int i)
     };
     auto writePresStd = [&](const int i)
     {
-        const std::string filename = "snaps/Pres_std_" + std::to_string(i) + ".cps";
+        const std::string filename = out_dir + "Pres_std_" + std::to_string(i) + ".cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -84,7 +79,7 @@ void StochOil::writeCPS(const int i)
             {
                 //const int y_id = cell.id % (mesh->num_y + 2);
                 //const int x_id = cell.id / (mesh->num_y + 2);
-                file << "\t" << P_dim * sqrt(fmax(Cp_next[i][cell.id * cellsNum + cell.id], 0.0)) / BAR_TO_PA;
+                file << "\t" << P_dim * sqrt(fmax(getCp(&Cp_next[i][0], cell.id, cell.id), 0.0)) / BAR_TO_PA;
                 counter++;
 
                 if (counter % 5 == 0)
@@ -95,7 +90,7 @@ void StochOil::writeCPS(const int i)
     };
     auto writePerm = [&]()
     {
-        const std::string filename = "snaps/Perm.cps";
+        const std::string filename = out_dir + "Perm.cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -117,7 +112,7 @@ void StochOil::writeCPS(const int i)
     };
     auto writePermStd = [&]()
     {
-        const std::string filename = "snaps/Perm_std.cps";
+        const std::string filename = out_dir + "Perm_std.cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -142,7 +137,7 @@ void StochOil::writeCPS(const int i)
     };
     auto writeGeomPerm = [&]()
     {
-        const std::string filename = "snaps/Perm_geom.cps";
+        const std::string filename = out_dir + "Perm_geom.cps";
         std::ofstream file(filename.c_str(), std::ofstream::out);
         head(file);
 
@@ -173,21 +168,52 @@ void StochOil::writeCPS(const int i)
         writeGeomPerm();
     }
 }
+std::string StochOil::getPriorKey(const Properties& props) const
+{
+    std::ostringstream key;
+    key.precision(17);
+    key << props.num_x << " " << props.num_y << " " << props.hx << " " << props.hy << " " << props.hz << " " <<
+        props.R_dim << " " << props.t_dim << " " << props.props_sk.p_init << " " << props.props_sk.perm << " " <<
+        props.props_sk.sigma_f << " " << props.props_sk.l_f << " " << props.props_sk.kernel << " " <<
+        props.props_sk.cov_radius << " " << props.props_oil.visc << " " << props.kl_energy << " " << props.kl_max_modes << " " <<
+        props.cf_bf16;
+    for (const auto& cond : props.conditions)
+        key << " " << cond.id << " " << cond.perm;
+    // FNV-1a hash of the permeability grid
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(props.props_sk.perm_grd.data());
+    for (size_t i = 0; i < props.props_sk.perm_grd.size() * sizeof(double); i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    key << " " << props.props_sk.perm_grd.size() << " " << hash;
+    return key.str();
+}
+void StochOil::adopt(StochOil* done)
+{
+    donor = done;
+}
 void StochOil::setProps(const Properties& props)
 {
+	if (!props.out_dir.empty())
+		out_dir = props.out_dir;
 	R_dim = props.R_dim;
 	t_dim = props.t_dim;
 	Q_dim = R_dim * R_dim * R_dim / t_dim;
 
 	possible_steps_num = props.possible_steps_num;
+	last_period = -1;
 	start_time_simple_approx = props.start_time_simple_approx;
+    step_control_props = props.step_control;
 	ht = props.ht;
 	ht_min = props.ht_min;
 	ht_max = props.ht_max;
 
 	props_sk = props.props_sk;
 	props_sk.perm = MilliDarcyToM2(props_sk.perm);
-    //loadPermAvg("props/perm41");
+	if (!props_sk.perm_grd.empty() && props_sk.perm_grd.size() != (size_t)(props.num_x * props.num_y))
+		throw std::runtime_error("Permeability grid has " + std::to_string(props_sk.perm_grd.size()) + " values, " +
+									std::to_string(props.num_x * props.num_y) + " expected");
+	for (auto& perm : props_sk.perm_grd)
+		perm = MilliDarcyToM2(perm);
 
 	props_oil = props.props_oil;
 	props_oil.visc = cPToPaSec(props_oil.visc);
@@ -196,12 +222,23 @@ void StochOil::setProps(const Properties& props)
     for(auto& cond : conditions)
         cond.perm = MilliDarcyToM2(cond.perm);
 
+    kl_energy = props.kl_energy;
+    kl_max_modes = props.kl_max_modes;
+    checkpoint_props = props.checkpoint;
+    cf_bf16 = props.cf_bf16;
+    reference_dir = props.reference_dir;
+
 	wells = props.wells;
 	for (auto& well : wells)
 		for (auto& rate : well.rate)
 			rate /= 86400.0;
 
-	mesh = std::make_shared<Mesh>(*new Mesh(props.num_x, props.num_y, props.hx / R_dim, props.hy / R_dim, props.hz / R_dim));
+	prior_key = getPriorKey(props);
+	isPriorAdopted = (donor != NULL && donor->prior_key == prior_key);
+	if (isPriorAdopted)
+		mesh = donor->mesh;
+	else
+		mesh = std::make_shared<Mesh>(*new Mesh(props.num_x, props.num_y, props.hx / R_dim, props.hy / R_dim, props.hz / R_dim));
 	Volume = mesh.get()->V;
 	cellsNum = mesh.get()->num;
 
@@ -209,27 +246,40 @@ void StochOil::setProps(const Properties& props)
 	p0_iter.resize(cellsNum);	
 	p0_next.resize(cellsNum);
 
-	Cfp.resize(possible_steps_num);
-	for (auto& cfp : Cfp)
-		cfp.resize(cellsNum * cellsNum, 0.0);
+	// Border columns of Cfp and Cp are identically zero, only inner cells are stored
+	inner_idx.resize(cellsNum, -1);
+	inner_cells.clear();
+	for (const auto& cell : mesh->cells)
+		if (cell.type == elem::QUAD)
+		{
+			inner_idx[cell.id] = inner_cells.size();
+			inner_cells.push_back(cell.id);
+		}
+	innerNum = inner_cells.size();
+
+	// Layers of the finished scenario are dropped before new ones are allocated
+	if (donor != NULL)
+	{
+		donor->Cfp.release();
+		donor->Cp_prev.release();
+		donor->Cp_next.release();
+	}
+	Cfp.allocate(possible_steps_num, cellsNum * innerNum, props.storage, "Cfp");
 	Cfp_prev = &Cfp[0][0];	Cfp_next = &Cfp[1][0];
 
 	p2_prev.resize(cellsNum);	
 	p2_iter.resize(cellsNum);	
 	p2_next.resize(cellsNum);
 
-	Cp_prev.resize(possible_steps_num);	
-	Cp_next.resize(possible_steps_num);
-	for (size_t i = 0; i < possible_steps_num; i++)
-	{
-		Cp_prev[i].resize(cellsNum * cellsNum, 0.0);
-		Cp_next[i].resize(cellsNum * cellsNum, 0.0);
-	}
+	Cp_prev.allocate(possible_steps_num, innerNum * innerNum, props.storage, "Cp_prev");
+	Cp_next.allocate(possible_steps_num, innerNum * innerNum, props.storage, "Cp_next");
 
 	x = new adouble[cellsNum];		
 	h = new adouble[cellsNum]; 
 
 	makeDimLess();
+    kernel = cov::Kernel(props_sk.kernel, props_sk.sigma_f, props_sk.l_f, props_sk.cov_radius);
+    cov_threads = props.assembly_threads;
 }
 void StochOil::makeDimLess()
 {
@@ -244,6 +294,7 @@ void StochOil::makeDimLess()
 	props_sk.perm /= R_dim * R_dim;
 	props_sk.beta /= (1.0 / P_dim);
 	props_sk.l_f /= R_dim;
+	props_sk.cov_radius /= R_dim;
     for (auto& perm : props_sk.perm_grd)
         perm /= R_dim * R_dim;
 
@@ -272,21 +323,47 @@ void StochOil::setInitialState()
 		p2_prev[i] = p2_iter[i] = p2_next[i] = 0.0;
 	}
 
-	for (size_t i = 0; i < possible_steps_num; i++)
-		Cfp[i] = Cp_prev[i] = Cp_next[i] = 0.0;
+	Cfp = 0.0;
+	Cp_prev = 0.0;
+	Cp_next = 0.0;
 
-    Favg.resize(cellsNum, 0.0);
-    Cf.resize(cellsNum);
-    std::for_each(Cf.begin(), Cf.end(), [&](std::vector<double>& vec) { vec.resize(cellsNum, 0.0); });
-    for (int i = 0; i < cellsNum; i++)
+    calculatePermPrior();
+    if (isPriorAdopted)
     {
-        const Cell& cell1 = mesh->cells[i];
-        Favg[i] = getFavg_prior(cell1);
-        for (int j = 0; j < cellsNum; j++)
-            Cf[i][j] = getCf_prior(cell1, mesh->cells[j]);
+        Favg.swap(donor->Favg);
+        Cf.swap(donor->Cf);
+        Cf_packed.swap(donor->Cf_packed);
+        Cf_sparse.swap(donor->Cf_sparse);
+        cf_row.swap(donor->cf_row);
+        kl.swap(donor->kl);
+        std::swap(inv_cond_cov, donor->inv_cond_cov);
+        std::cout << "Mesh, conditioned Cf and KL basis are taken from the previous scenario" << std::endl;
     }
-    // Conditioning
-    calculateConditioning();
+    else
+    {
+        Favg.resize(cellsNum, 0.0);
+        for (int i = 0; i < cellsNum; i++)
+            Favg[i] = getFavg_prior(mesh->cells[i]);
+        if (isCfSparse())
+            buildSparseCf();
+        else
+        {
+            std::vector<point::Point> cent(cellsNum);
+            for (int i = 0; i < cellsNum; i++)
+                cent[i] = mesh->cells[i].cent;
+            const double err = cov::fillDense(kernel, cent, Cf, cov_threads);
+            std::cout << "Cf fill: max deviation from exact kernel = " << err << std::endl;
+        }
+        // Conditioning
+        calculateConditioning();
+    }
+    calculateKg();
+    calculateWellPerm();
+    cf_row_id = -1;
+    // Reduced stochastic basis
+    buildKL();
+    packCf();
+    donor = NULL;
 
     // WI calculation
     for (auto& well : wells)
@@ -296,16 +373,234 @@ void StochOil::setInitialState()
         well.WI = 2.0 * M_PI * well.perm * cell.hz / log(well.r_peaceman / well.rw);
     }
 }
+void StochOil::calculatePermPrior()
+{
+    perm_prior.resize(cellsNum);
+    if (props_sk.perm_grd.empty())
+    {
+        std::fill(perm_prior.begin(), perm_prior.end(), props_sk.perm);
+        return;
+    }
+    const int ny = mesh->num_y + 2;
+    for (int i = 0; i < cellsNum; i++)
+    {
+        // Border cells take values of their inner neighbours, rows of the grid file go from the top
+        const int ind_x = std::min(std::max(i / ny, 1), mesh->num_x);
+        const int ind_y = std::min(std::max(i % ny, 1), mesh->num_y);
+        perm_prior[i] = props_sk.perm_grd[(ind_x - 1) * mesh->num_y + (mesh->num_y - ind_y)];
+    }
+}
+void StochOil::calculateKg()
+{
+    Kg.resize(cellsNum);
+    for (int i = 0; i < cellsNum; i++)
+        Kg[i] = exp(Favg[i]);
+}
+void StochOil::findNeighbors(const Cell& cell, const double radius, std::vector<int>& nebrs) const
+{
+    const int ny = mesh->num_y + 2;
+    const int ind_x = cell.id / ny;
+    const int ind_y = cell.id % ny;
+    const int wx = int(radius / (mesh->hx / mesh->num_x)) + 1;
+    const int wy = int(radius / (mesh->hy / mesh->num_y)) + 1;
+
+    for (int i = std::max(0, ind_x - wx); i <= std::min(mesh->num_x + 1, ind_x + wx); i++)
+        for (int j = std::max(0, ind_y - wy); j <= std::min(mesh->num_y + 1, ind_y + wy); j++)
+            if (point::distance(cell.cent, mesh->cells[i * ny + j].cent) < radius)
+                nebrs.push_back(i * ny + j);
+}
+void StochOil::buildSparseCf()
+{
+    const double radius = kernel.getSupport();
+    std::vector<std::vector<int>> rows(cellsNum);
+
+    // Kriging correction couples every cell within support of a measurement with all neighbours of measurements
+    std::vector<int> cond_nebrs;
+    for (const auto& cond : conditions)
+        findNeighbors(mesh->cells[cond.id], radius, cond_nebrs);
+
+    for (int i = 0; i < cellsNum; i++)
+    {
+        const Cell& cell = mesh->cells[i];
+        findNeighbors(cell, radius, rows[i]);
+        for (const auto& cond : conditions)
+            if (point::distance(cell.cent, mesh->cells[cond.id].cent) < radius)
+            {
+                rows[i].insert(rows[i].end(), cond_nebrs.begin(), cond_nebrs.end());
+                break;
+            }
+    }
+    Cf_sparse.setPattern(rows);
+    rows.clear();
+
+    for (int i = 0; i < cellsNum; i++)
+    {
+        const Cell& cell1 = mesh->cells[i];
+        for (int k = Cf_sparse.rowBegin(i); k < Cf_sparse.rowEnd(i); k++)
+            Cf_sparse.getVal(k) = getCf_prior(cell1, mesh->cells[Cf_sparse.getCol(k)]);
+    }
+    cf_row.resize(cellsNum);
+    cf_row_id = -1;
+
+    reportCutoffError();
+}
+void StochOil::reportCutoffError() const
+{
+    // Error against untruncated form of the kernel on evenly spaced sample rows
+    const int stride = std::max(1, (int)cellsNum / 64);
+    double err2 = 0.0, norm2 = 0.0, max_err = 0.0;
+    for (int i = 0; i < cellsNum; i += stride)
+    {
+        const Cell& cell1 = mesh->cells[i];
+        for (int j = 0; j < cellsNum; j++)
+        {
+            const Cell& cell2 = mesh->cells[j];
+            const double ref = kernel.untruncated(point::distance(cell1.cent, cell2.cent));
+            const double diff = ref - Cf_sparse.get(i, j);
+            err2 += diff * diff;
+            norm2 += ref * ref;
+            max_err = std::max(max_err, fabs(diff));
+        }
+    }
+
+    const double dense_mem = (double)cellsNum * cellsNum * sizeof(double);
+    std::cout << "Cf cutoff: radius = " << kernel.radius * R_dim << " m, nnz = " << Cf_sparse.getNonZerosNum() <<
+        " (" << 100.0 * Cf_sparse.getNonZerosNum() / cellsNum / cellsNum << "% of dense), memory " <<
+        Cf_sparse.getMemory() / 1048576.0 << " MB instead of " << dense_mem / 1048576.0 << " MB" << std::endl;
+    std::cout << "Cf cutoff error: relative Frobenius = " << sqrt(err2 / norm2) <<
+        ", max abs = " << max_err << " (sigma_f^2 = " << kernel.sigma * kernel.sigma << ")" << std::endl;
+}
+void StochOil::buildKL()
+{
+    if (!isPriorAdopted)
+    {
+        double trace = 0.0;
+        for (int i = 0; i < cellsNum; i++)
+            trace += getSigma2f(mesh->cells[i]);
+
+        kl.build(cellsNum, [this](const double* v, double* res)
+        {
+            if (isCfSparse())
+            {
+                Cf_sparse.multiply(v, res);
+                return;
+            }
+            for (int i = 0; i < cellsNum; i++)
+            {
+                const auto& row = Cf[i];
+                double s = 0.0;
+                for (int j = 0; j < cellsNum; j++)
+                    s += row[j] * v[j];
+                res[i] = s;
+            }
+        }, trace, kl_energy, kl_max_modes);
+    }
+
+    p1_kl.resize(possible_steps_num);
+    for (auto& p1 : p1_kl)
+        p1.resize(kl.getModesNum() * cellsNum, 0.0);
+    if (kl.isActive())
+    {
+        p1_kl_prev = &p1_kl[0][0];     p1_kl_next = &p1_kl[1][0];
+        std::cout << "KL expansion: " << kl.getModesNum() << " modes of " << cellsNum << 
+                    " capture " << 100.0 * kl.getCapturedEnergy() << "% of variance" << std::endl;
+    }
+    else
+        p1_kl_prev = p1_kl_next = NULL;
+}
+void StochOil::packCf()
+{
+    // Conditioning and KL basis are built in double, only the stored field is rounded
+    if (!cf_bf16 || isCfSparse() || !Cf_packed.empty())
+        return;
+    Cf_packed.resize((size_t)cellsNum * cellsNum);
+    double max_err = 0.0;
+    for (int i = 0; i < cellsNum; i++)
+    {
+        bf16::bf16_t* row = &Cf_packed[(size_t)i * cellsNum];
+        bf16::encode(Cf[i].data(), row, cellsNum);
+        for (int j = 0; j < cellsNum; j++)
+            max_err = std::max(max_err, fabs(bf16::decode(row[j]) - Cf[i][j]));
+    }
+    std::vector<std::vector<double>>().swap(Cf);
+    cf_row.resize(cellsNum);
+    cf_row_id = -1;
+    std::cout << "Cf is kept in bfloat16: " << Cf_packed.size() * sizeof(bf16::bf16_t) / 1048576.0 << " MB, max abs rounding = " <<
+        max_err << " (bound " << bf16::REL_ERROR * kernel.sigma * kernel.sigma << ")" << std::endl;
+}
+void StochOil::saveState(Checkpoint& chk) const
+{
+    chk.add("ht", &ht, sizeof(ht));
+    chk.add("p0_prev", &p0_prev[0], cellsNum * sizeof(double));
+    chk.add("p0_iter", &p0_iter[0], cellsNum * sizeof(double));
+    chk.add("p0_next", &p0_next[0], cellsNum * sizeof(double));
+    chk.add("p2_prev", &p2_prev[0], cellsNum * sizeof(double));
+    chk.add("p2_iter", &p2_iter[0], cellsNum * sizeof(double));
+    chk.add("p2_next", &p2_next[0], cellsNum * sizeof(double));
+    chk.add("Favg", Favg.data(), cellsNum * sizeof(double));
+    if (isCfSparse())
+        chk.add("Cf", Cf_sparse.getValues(), Cf_sparse.getNonZerosNum() * sizeof(double));
+    else if (!Cf_packed.empty())
+        chk.add("Cf_bf16", Cf_packed.data(), Cf_packed.size() * sizeof(bf16::bf16_t));
+    else
+        for (int i = 0; i < cellsNum; i++)
+            chk.add("Cf#" + std::to_string(i), Cf[i].data(), cellsNum * sizeof(double));
+    // One chunk per time layer, so untouched layers are not rewritten
+    for (size_t k = 0; k < Cfp.size(); k++)
+    {
+        chk.add("Cfp#" + std::to_string(k), &Cfp[k][0], Cfp.getLayerSize() * sizeof(var::cov_t));
+        chk.add("Cp_prev#" + std::to_string(k), &Cp_prev[k][0], Cp_prev.getLayerSize() * sizeof(var::cov_t));
+        chk.add("Cp_next#" + std::to_string(k), &Cp_next[k][0], Cp_next.getLayerSize() * sizeof(var::cov_t));
+    }
+    if (kl.isActive())
+        for (size_t k = 0; k < p1_kl.size(); k++)
+            chk.add("p1_kl#" + std::to_string(k), &p1_kl[k][0], p1_kl[k].size() * sizeof(double));
+}
+void StochOil::loadState(Checkpoint& chk)
+{
+    chk.get("ht", &ht, sizeof(ht));
+    chk.get("p0_prev", &p0_prev[0], cellsNum * sizeof(double));
+    chk.get("p0_iter", &p0_iter[0], cellsNum * sizeof(double));
+    chk.get("p0_next", &p0_next[0], cellsNum * sizeof(double));
+    chk.get("p2_prev", &p2_prev[0], cellsNum * sizeof(double));
+    chk.get("p2_iter", &p2_iter[0], cellsNum * sizeof(double));
+    chk.get("p2_next", &p2_next[0], cellsNum * sizeof(double));
+    chk.get("Favg", Favg.data(), cellsNum * sizeof(double));
+    if (isCfSparse())
+        chk.get("Cf", Cf_sparse.getValues(), Cf_sparse.getNonZerosNum() * sizeof(double));
+    else if (!Cf_packed.empty())
+        chk.get("Cf_bf16", Cf_packed.data(), Cf_packed.size() * sizeof(bf16::bf16_t));
+    else
+        for (int i = 0; i < cellsNum; i++)
+            chk.get("Cf#" + std::to_string(i), Cf[i].data(), cellsNum * sizeof(double));
+    for (size_t k = 0; k < Cfp.size(); k++)
+    {
+        chk.get("Cfp#" + std::to_string(k), &Cfp[k][0], Cfp.getLayerSize() * sizeof(var::cov_t));
+        chk.get("Cp_prev#" + std::to_string(k), &Cp_prev[k][0], Cp_prev.getLayerSize() * sizeof(var::cov_t));
+        chk.get("Cp_next#" + std::to_string(k), &Cp_next[k][0], Cp_next.getLayerSize() * sizeof(var::cov_t));
+    }
+    if (kl.isActive())
+        for (size_t k = 0; k < p1_kl.size(); k++)
+            chk.get("p1_kl#" + std::to_string(k), &p1_kl[k][0], p1_kl[k].size() * sizeof(double));
+    calculateKg();
+    cf_row_id = -1;
+}
 void StochOil::setPeriod(const int period)
 {
-	for (auto& well : wells)
+	// Only wells switching their own period at this event are updated, all of them after a jump (restart)
+	const bool all = (period != last_period + 1);
+	last_period = period;
+	for (int w = 0; w < wells.size(); w++)
 	{
-		well.cur_period = period;
-		well.cur_bound = well.leftBoundIsRate[period];
+		if (!all && !std::binary_search(schedule.getChanged(period).begin(), schedule.getChanged(period).end(), w))
+			continue;
+		auto& well = wells[w];
+		well.cur_period = schedule.getPeriod(period, w);
+		well.cur_bound = well.leftBoundIsRate[well.cur_period];
 		if (well.cur_bound)
-			well.cur_rate = well.rate[period];
+			well.cur_rate = well.rate[well.cur_period];
 		else
-			well.cur_pwf = well.pwf[period];
+			well.cur_pwf = well.pwf[well.cur_period];
 	}
 }
 double StochOil::getRate(const Well& well) const
@@ -320,7 +615,7 @@ double StochOil::getRate(const Well& well) const
         else
         {
             const auto& cell = mesh->cells[well.cell_id];
-            return well.WI / well.perm * getKg(cell) * (exp(getSigma2f(cell) / 2.0) * (p_cell - well.cur_pwf) + Cfp_next[well.cell_id * cellsNum + well.cell_id]);
+            return well.WI / well.perm * getKg(cell) * (exp(getSigma2f(cell) / 2.0) * (p_cell - well.cur_pwf) + getCfp(Cfp_next, well.cell_id, well.cell_id));
         }
 	}
 }
@@ -331,14 +626,14 @@ double StochOil::getRateVar(const Well& well, const int step_idx) const
     else
     {
         const Cell& cell = mesh->cells[well.cell_id];
-        double Cp0 = Cp_next[step_idx][well.cell_id * cellsNum + well.cell_id];
+        double Cp0 = getCp(&Cp_next[step_idx][0], well.cell_id, well.cell_id);
         double tmp = well.WI / well.perm * getKg(cell);
         if (well.isCond)
             return tmp * tmp * Cp0;
         else
         {
             double dp = p0_next[well.cell_id] - well.cur_pwf;
-            double Cyp0 = Cfp[step_idx][well.cell_id * cellsNum + well.cell_id];
+            double Cyp0 = getCfp(&Cfp[step_idx][0], well.cell_id, well.cell_id);
             double buf = exp(getSigma2f(cell));
             return tmp * tmp * (Cp0 + 2.0 * dp * Cyp0 + dp * dp * buf * (buf - 1.0));
         }
@@ -363,13 +658,13 @@ double StochOil::getPwfVar(const Well& well, const int step_idx) const
     if (well.cur_bound)
     {
         const Cell& cell = mesh->cells[well.cell_id];
-        double Cp0 = Cp_next[step_idx][well.cell_id * cellsNum + well.cell_id];
+        double Cp0 = getCp(&Cp_next[step_idx][0], well.cell_id, well.cell_id);
         if (well.isCond)
             return Cp0;
         else
         {
             double tmp = well.cur_rate * well.perm / well.WI / getKg(cell);
-            double Cyp0 = Cfp[step_idx][well.cell_id * cellsNum + well.cell_id];
+            double Cyp0 = getCfp(&Cfp[step_idx][0], well.cell_id, well.cell_id);
             return Cp0 - 2.0 * tmp * Cyp0 + tmp * tmp * getSigma2f(cell);
         }
     }
@@ -377,12 +672,13 @@ double StochOil::getPwfVar(const Well& well, const int step_idx) const
         return 0.0;
 }
 
-adouble StochOil::solveInner_p0(const Cell& cell) const
+template <class T>
+T StochOil::solve_p0(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::QUAD);
-	const auto& next = x[cell.id];
+	const auto& next = p[cell.id];
 	const auto prev = p0_prev[cell.id];
-    adouble H, var_plus, var_minus;
+    T H, var_plus, var_minus;
 	H = getS(cell) * (next - prev) / getKg(cell);
 
 	const auto& beta_y_minus = mesh->cells[cell.stencil[1]];
@@ -390,10 +686,10 @@ adouble StochOil::solveInner_p0(const Cell& cell) const
 	const auto& beta_x_minus = mesh->cells[cell.stencil[3]];
 	const auto& beta_x_plus = mesh->cells[cell.stencil[4]];
 
-	const auto& nebr_y_minus = x[cell.stencil[1]];
-	const auto& nebr_y_plus = x[cell.stencil[2]];
-	const auto& nebr_x_minus = x[cell.stencil[3]];
-	const auto& nebr_x_plus = x[cell.stencil[4]];
+	const auto& nebr_y_minus = p[cell.stencil[1]];
+	const auto& nebr_y_plus = p[cell.stencil[2]];
+	const auto& nebr_x_minus = p[cell.stencil[3]];
+	const auto& nebr_x_plus = p[cell.stencil[4]];
 
 	H -= ht * ((nebr_x_plus - next) / (beta_x_plus.cent.x - cell.cent.x) -
 			(next - nebr_x_minus) / (cell.cent.x - beta_x_minus.cent.x)) / cell.hx;
@@ -413,30 +709,31 @@ adouble StochOil::solveInner_p0(const Cell& cell) const
 
 	return H;
 }
-adouble StochOil::solveBorder_p0(const Cell& cell) const
+template <class T>
+T StochOil::solve_p0(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::BORDER);
 	const auto& beta = mesh->cells[cell.stencil[1]];
 
-	const auto& cur = x[cell.id];
-	const auto& nebr = x[cell.stencil[1]];
+	const auto& cur = p[cell.id];
+	const auto& nebr = p[cell.stencil[1]];
 
-    return /*(cur - nebr) / P_dim;*/ (cur - (adouble)(props_sk.p_out)) / P_dim;
+    return /*(cur - nebr) / P_dim;*/ (cur - (T)(props_sk.p_out)) / P_dim;
 }
-adouble StochOil::solveSource_p0(const Well& well) const
+template <class T>
+T StochOil::solveSource_p0(const Well& well, const T* p) const
 {
 	const Cell& cell = mesh->cells[well.cell_id];
 	if(well.cur_bound == true)
 		return -well.cur_rate * ht / cell.V / getKg(cell);
     else
-        return -well.WI / well.perm * (well.cur_pwf - x[cell.id]) * ht / cell.V;
+        return -well.WI / well.perm * (well.cur_pwf - p[cell.id]) * ht / cell.V;
 }
 
-adouble StochOil::solveInner_Cfp(const Cell& cell, const Cell& cur_cell) const
+adouble StochOil::solve_Cfp(elem::TypeTag<elem::QUAD>, const Cell& cell, const double* cf, const double prev) const
 {
 	assert(cell.type == elem::QUAD);
     adouble next = x[cell.id];
-    const auto prev = Cfp_prev[cur_cell.id * cellsNum + cell.id];
 	adouble H, var_plus, var_minus;
     H = getS(cell) * (next - prev) / getKg(cell);
 
@@ -471,38 +768,46 @@ adouble StochOil::solveInner_Cfp(const Cell& cell, const Cell& cur_cell) const
 	H -= ht * (log(cell.trans[1]) - log(cell.trans[0])) / cell.hy *
 		(nebr_y_plus - nebr_y_minus) / (beta_y_plus.cent.y - beta_y_minus.cent.y);
 
+	// Source vanishes outside of covariance support
+	if (cf[cell.id] == 0.0 && cf[x_plus] == 0.0 && cf[x_minus] == 0.0 && cf[y_plus] == 0.0 && cf[y_minus] == 0.0)
+		return H / P_dim;
+
 	double H1 = -ht * ((p0_next[x_plus] - p0_next[x_minus]) / (beta_x_plus.cent.x - beta_x_minus.cent.x) *
-	(getCf(cur_cell, beta_x_plus) - getCf(cur_cell, beta_x_minus)) / (beta_x_plus.cent.x - beta_x_minus.cent.x) +
+	(cf[x_plus] - cf[x_minus]) / (beta_x_plus.cent.x - beta_x_minus.cent.x) +
 					(p0_next[y_plus] - p0_next[y_minus]) / (beta_y_plus.cent.y - beta_y_minus.cent.y) *
-	(getCf(cur_cell, beta_y_plus) - getCf(cur_cell, beta_y_minus)) / (beta_y_plus.cent.y - beta_y_minus.cent.y));
+	(cf[y_plus] - cf[y_minus]) / (beta_y_plus.cent.y - beta_y_minus.cent.y));
 	
-    double H2 = -getS(cell) / getKg(cell) * (p0_next[cell.id] - p0_prev[cell.id]) * getCf(cur_cell, cell);
+    double H2 = -getS(cell) / getKg(cell) * (p0_next[cell.id] - p0_prev[cell.id]) * cf[cell.id];
 
-    return H + H1 + H2;
+    return (H + H1 + H2) / P_dim;
 }
-adouble StochOil::solveBorder_Cfp(const Cell& cell, const Cell& cur_cell) const
+adouble StochOil::solve_Cfp(elem::TypeTag<elem::BORDER>, const Cell& cell, const double*, const double) const
 {
-	assert(cell.type == elem::BORDER || cur_cell.type == elem::BORDER);
-	const auto& beta = mesh->cells[cell.stencil[1]];
+	assert(cell.type == elem::BORDER);
     return /*(x[cell.id] - x[beta.id]) / P_dim;*/ x[cell.id] / P_dim;
 }
 adouble StochOil::solveSource_Cfp(const Well& well, const Cell& cur_cell) const
+{
+    return solveSource_Cfp(well, getCfRow(cur_cell.id));
+}
+adouble StochOil::solveSource_Cfp(const Well& well, const double* cf) const
 {
 	const Cell& cell = mesh->cells[well.cell_id];
     if (well.cur_bound == true)
-        return well.cur_rate * ht / cell.V / getKg(cell) * getCf(cur_cell, cell);
+        return well.cur_rate * ht / cell.V / getKg(cell) * cf[cell.id];
     else
         return well.WI / well.perm * x[cell.id] * ht / cell.V;
 }
 
-adouble StochOil::solveInner_p2(const Cell& cell) const
+template <class T>
+T StochOil::solve_p2(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::QUAD);
 
-	const auto& next = x[cell.id];
+	const auto& next = p[cell.id];
 	const auto prev = p2_prev[cell.id];
 
-	adouble H, var_plus, var_minus;
+	T H, var_plus, var_minus;
 	H = getS(cell) * (next - prev) / getKg(cell);
 
 	const int& y_minus = cell.stencil[1];
@@ -515,10 +820,10 @@ adouble StochOil::solveInner_p2(const Cell& cell) const
 	const auto& beta_x_minus = mesh->cells[x_minus];
 	const auto& beta_x_plus = mesh->cells[x_plus];
 
-	const auto& nebr_y_minus = x[y_minus];
-	const auto& nebr_y_plus = x[y_plus];
-	const auto& nebr_x_minus = x[x_minus];
-	const auto& nebr_x_plus = x[x_plus];
+	const auto& nebr_y_minus = p[y_minus];
+	const auto& nebr_y_plus = p[y_plus];
+	const auto& nebr_x_minus = p[x_minus];
+	const auto& nebr_x_plus = p[x_plus];
 
 	H -= ht * ((nebr_x_plus - next) / (beta_x_plus.cent.x - cell.cent.x) -
 		(next - nebr_x_minus) / (cell.cent.x - beta_x_minus.cent.x)) / cell.hx;
@@ -536,42 +841,43 @@ adouble StochOil::solveInner_p2(const Cell& cell) const
 	H -= ht * (log(cell.trans[1]) - log(cell.trans[0])) / cell.hy *
 		(nebr_y_plus - nebr_y_minus) / (beta_y_plus.cent.y - beta_y_minus.cent.y);
 
-	double H1 = -ht * ((Cfp_next[x_plus * cellsNum + x_plus] - Cfp_next[x_plus * cellsNum + x_minus]) -
-						(Cfp_next[x_minus * cellsNum + x_plus] - Cfp_next[x_minus * cellsNum + x_minus])) /
+	double H1 = -ht * ((getCfp(Cfp_next, x_plus, x_plus) - getCfp(Cfp_next, x_plus, x_minus)) -
+						(getCfp(Cfp_next, x_minus, x_plus) - getCfp(Cfp_next, x_minus, x_minus))) /
 						(beta_x_plus.cent.x - beta_x_minus.cent.x) / (beta_x_plus.cent.x - beta_x_minus.cent.x) - 
-				ht * ((Cfp_next[y_plus * cellsNum + y_plus] - Cfp_next[y_plus * cellsNum + y_minus]) -
-						(Cfp_next[y_minus * cellsNum + y_plus] - Cfp_next[y_minus * cellsNum + y_minus])) /
+				ht * ((getCfp(Cfp_next, y_plus, y_plus) - getCfp(Cfp_next, y_plus, y_minus)) -
+						(getCfp(Cfp_next, y_minus, y_plus) - getCfp(Cfp_next, y_minus, y_minus))) /
 						(beta_y_plus.cent.y - beta_y_minus.cent.y) / (beta_y_plus.cent.y - beta_y_minus.cent.y);
 
-	const size_t idx = cell.id * cellsNum + cell.id;
 	double H2 = getS(cell) / getKg(cell) * ((p0_next[cell.id] - p0_prev[cell.id]) * getSigma2f(cell) / 2.0 -
-							(Cfp_next[idx] - Cfp_prev[idx]));
+							(getCfp(Cfp_next, cell.id, cell.id) - getCfp(Cfp_prev, cell.id, cell.id)));
 	return H + H1 + H2;
 }
-adouble StochOil::solveBorder_p2(const Cell& cell) const
+template <class T>
+T StochOil::solve_p2(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const
 {
 	assert(cell.type == elem::BORDER);
 	const auto& beta = mesh->cells[cell.stencil[1]];
-    return /*(x[cell.id] - x[beta.id]) / P_dim;*/ x[cell.id] / P_dim;
+    return /*(p[cell.id] - p[beta.id]) / P_dim;*/ p[cell.id] / P_dim;
 }
-adouble StochOil::solveSource_p2(const Well& well) const
+template <class T>
+T StochOil::solveSource_p2(const Well& well, const T* p) const
 {
 	const Cell& cell = mesh->cells[well.cell_id];
     if (well.cur_bound == true)
         return -well.cur_rate * ht / cell.V / getKg(cell) * getSigma2f(cell) / 2.0;
     else
-        return 0.0;// -well.WI / props_oil.visc * (well.cur_pwf - x[cell.id]) * ht / cell.V / getKg(cell) * getSigma2f(cell) / 2.0;
+        return 0.0;// -well.WI / props_oil.visc * (well.cur_pwf - p[cell.id]) * ht / cell.V / getKg(cell) * getSigma2f(cell) / 2.0;
 }
 
-adouble StochOil::solveInner_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const
+adouble StochOil::solve_Cp(elem::TypeTag<elem::QUAD>, const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const
 {
 	assert(cell.type == elem::QUAD && cur_cell.type == elem::QUAD);
 	adouble next = x[cell.id];
 	double prev;
 	if(step_idx > start_time_simple_approx)
-		prev = Cp_prev[step_idx - 1][cur_cell.id * cellsNum + cell.id];
+		prev = getCp(&Cp_prev[step_idx - 1][0], cur_cell.id, cell.id);
 	else
-		prev = Cp_next[step_idx - 1][cur_cell.id * cellsNum + cell.id];
+		prev = getCp(&Cp_next[step_idx - 1][0], cur_cell.id, cell.id);
 
 	adouble H, var_plus, var_minus;
 	H = getS(cell) * (next - prev) / getKg(cell);
@@ -607,26 +913,39 @@ adouble StochOil::solveInner_Cp(const Cell& cell, const Cell& cur_cell, const si
 	H -= ht * (log(cell.trans[1]) - log(cell.trans[0])) / cell.hy *
 		(nebr_y_plus - nebr_y_minus) / (beta_y_plus.cent.y - beta_y_minus.cent.y);
 
+	const var::cov_t* cfp = &Cfp[step_idx][0];
+	if (getCfp(cfp, cell.id, cur_cell.id) == 0.0 &&
+		getCfp(cfp, x_plus, cur_cell.id) == 0.0 && getCfp(cfp, x_minus, cur_cell.id) == 0.0 &&
+		getCfp(cfp, y_plus, cur_cell.id) == 0.0 && getCfp(cfp, y_minus, cur_cell.id) == 0.0)
+		return H / P_dim;
+
 	double H1 = -ht * ((p0_next[x_plus] - p0_next[x_minus]) / (beta_x_plus.cent.x - beta_x_minus.cent.x) *
-		(Cfp[step_idx][x_plus * cellsNum + cur_cell.id] - Cfp[step_idx][x_minus * cellsNum + cur_cell.id]) / (beta_x_plus.cent.x - beta_x_minus.cent.x) +
+		(getCfp(&Cfp[step_idx][0], x_plus, cur_cell.id) - getCfp(&Cfp[step_idx][0], x_minus, cur_cell.id)) / (beta_x_plus.cent.x - beta_x_minus.cent.x) +
 		(p0_next[y_plus] - p0_next[y_minus]) / (beta_y_plus.cent.y - beta_y_minus.cent.y) *
-		(Cfp[step_idx][y_plus * cellsNum + cur_cell.id] - Cfp[step_idx][y_minus * cellsNum + cur_cell.id]) / (beta_y_plus.cent.y - beta_y_minus.cent.y));
+		(getCfp(&Cfp[step_idx][0], y_plus, cur_cell.id) - getCfp(&Cfp[step_idx][0], y_minus, cur_cell.id)) / (beta_y_plus.cent.y - beta_y_minus.cent.y));
 
-	double H2 = -getS(cell) / getKg(cell) * (p0_next[cell.id] - p0_prev[cell.id]) * Cfp[step_idx][cell.id * cellsNum + cur_cell.id];
+	double H2 = -getS(cell) / getKg(cell) * (p0_next[cell.id] - p0_prev[cell.id]) * getCfp(&Cfp[step_idx][0], cell.id, cur_cell.id);
 
-    return H + H1 + H2;
+    return (H + H1 + H2) / P_dim;
 }
-adouble StochOil::solveBorder_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx) const
+adouble StochOil::solve_Cp(elem::TypeTag<elem::BORDER>, const Cell& cell, const Cell&, const size_t, const size_t) const
 {
-	assert(cell.type == elem::BORDER || cur_cell.type == elem::BORDER);
-	const auto& beta = mesh->cells[cell.stencil[1]];
+	assert(cell.type == elem::BORDER);
     return /*(x[cell.id] - x[beta.id]) / P_dim;*/ x[cell.id] / P_dim;
 }
 adouble StochOil::solveSource_Cp(const Well& well, const Cell& cur_cell, const size_t step_idx) const
 {
 	const Cell& cell = mesh->cells[well.cell_id];
     if (well.cur_bound == true)
-        return well.cur_rate * ht / cell.V / getKg(cell) * Cfp[step_idx][cell.id * cellsNum + cur_cell.id];
+        return well.cur_rate * ht / cell.V / getKg(cell) * getCfp(&Cfp[step_idx][0], cell.id, cur_cell.id);
     else
-        return 0.0;// well.WI / props_oil.visc * (well.cur_pwf - x[cell.id]) * ht / cell.V / getKg(cell) * Cfp[step_idx][cell.id * cellsNum + cur_cell.id];
-}
\ No newline at end of file
+        return 0.0;// well.WI / props_oil.visc * (well.cur_pwf - x[cell.id]) * ht / cell.V / getKg(cell) * getCfp(&Cfp[step_idx][0], cell.id, cur_cell.id);
+}
+
+// Taped and plain evaluation of p0 / p2 equations
+template adouble stoch_oil::StochOil::solve_p0<adouble>(elem::TypeTag<elem::QUAD>, const Cell&, const adouble*) const;
+template adouble stoch_oil::StochOil::solve_p0<adouble>(elem::TypeTag<elem::BORDER>, const Cell&, const adouble*) const;
+template adouble stoch_oil::StochOil::solveSource_p0<adouble>(const Well&, const adouble*) const;
+template adouble stoch_oil::StochOil::solve_p2<adouble>(elem::TypeTag<elem::QUAD>, const Cell&, const adouble*) const;
+template adouble stoch_oil::StochOil::solve_p2<adouble>(elem::TypeTag<elem::BORDER>, const Cell&, const adouble*) const;
+template adouble stoch_oil::StochOil::solveSource_p2<adouble>(const Well&, const adouble*) const;
@@ -6,6 +6,10 @@
 #include "src/grid/Mesh.hpp"
 #include "src/model/stoch_oil/Properties.hpp"
 #include "src/Well.hpp"
+#include "src/utils/KLExpansion.hpp"
+#include "src/utils/SparseCov.hpp"
+#include "src/utils/BFloat16.hpp"
+#include "src/utils/Checkpoint.hpp"
 #include "paralution.hpp"
 
 namespace stoch_oil
@@ -18,7 +22,9 @@ namespace stoch_oil
 				var::containers::Var1phase>
 	{
 		template<typename> friend class snapshotter::VTKSnapshotter;
-		template<typename> friend class AbstractMethod;
+		template<typename> friend class ::CellGridPolicy;
+		template<typename> friend class ::DualGridPolicy;
+		template<class, template <class> class, class> friend class ::MethodDriver;
 		friend class StochOilMethod;
 	public:
 
@@ -30,6 +36,9 @@ namespace stoch_oil
 		adouble* h;
 
 		int possible_steps_num, start_time_simple_approx;
+		// Last applied schedule interval
+		int last_period;
+        StepControlProps step_control_props;
 		Skeleton_Props props_sk;
 		Oil_Props props_oil;
 		std::vector<Well> wells;
@@ -38,8 +47,45 @@ namespace stoch_oil
         double* inv_cond_cov;
         std::vector<double> Favg;
         std::vector<std::vector<double>> Cf;
+        // Compactly supported covariance is kept in CSR instead of dense Cf
+        cov::Kernel kernel;
+        // Threads of dense covariance fill (0 - hardware concurrency)
+        int cov_threads;
+        SparseCov Cf_sparse;
+        mutable std::vector<double> cf_row;
+        mutable int cf_row_id;
+        // Dense Cf in bfloat16, rows are decoded into cf_row
+        bool cf_bf16;
+        std::vector<bf16::bf16_t> Cf_packed;
+        void packCf();
+        inline bool isCfSparse() const { return kernel.isCompact(); };
+        void findNeighbors(const Cell& cell, const double radius, std::vector<int>& nebrs) const;
+        void buildSparseCf();
+        void reportCutoffError() const;
+        // Truncated Karhunen-Loeve basis of Cf
+        double kl_energy;
+        int kl_max_modes;
+        KLExpansion kl;
 
-        void loadPermAvg(const std::string fileName);
+        void buildKL();
+        // Mesh, Favg, Cf with conditioning and KL basis are defined by grid, prior, measurements and KL settings only.
+        // Scenarios of a batch with the same key take them over from the finished one instead of rebuilding
+        std::string prior_key;
+        StochOil* donor;
+        bool isPriorAdopted;
+        std::string getPriorKey(const Properties& props) const;
+        // Checkpointing of the whole stochastic state
+        CheckpointProps checkpoint_props;
+        // Plots of a full precision run for comparison of variances
+        std::string reference_dir;
+        void saveState(Checkpoint& chk) const;
+        void loadState(Checkpoint& chk);
+        // Prior mean permeability of cells, uniform or from the grid file
+        std::vector<double> perm_prior;
+        void calculatePermPrior();
+        // exp(Favg) of cells, kernels take it without exp per evaluation
+        std::vector<double> Kg;
+        void calculateKg();
         void writeCPS(const int i);
 		inline double getPoro(const Cell& cell) const
 		{
@@ -47,29 +93,7 @@ namespace stoch_oil
 		};
 		inline double getPerm_prior(const Cell& cell) const
 		{
-            /*int ind_x = int(cell.id / (mesh->num_y + 2));
-            int ind_y = cell.id % (mesh->num_y + 2);
-            int id = cell.id;
-            if (cell.type != elem::QUAD)
-            {
-                //if ((ind_x == 0 || ind_x == mesh->num_x + 1) && (ind_y == 0 || ind_y == mesh->num_y + 1))
-                //    return 1.0;
-                //else
-                //{
-                    if (ind_y == 0)
-                        id += 1;
-                    else if (ind_y == mesh->num_y + 1)
-                        id -= 1;
-                    if (ind_x == 0)
-                        id += mesh->num_y + 2;
-                    else if (ind_x == mesh->num_x + 1)
-                        id -= mesh->num_y + 2;
-                //}
-            }
-            ind_x = int(id / (mesh->num_y + 2));
-            ind_y = mesh->num_y + 1 - id % (mesh->num_y + 2);
-            return props_sk.perm_grd[(ind_x - 1) * mesh->num_y + (ind_y - 1)];*/
-            return props_sk.perm;
+            return perm_prior[cell.id];
 		};
         inline double getS(const Cell& cell) const
         {
@@ -83,17 +107,7 @@ namespace stoch_oil
         };
 		inline double getCf_prior(const Cell& cell, const Cell& beta) const
 		{
-			auto corrFoo1 = [this](const auto& p1, const auto& p2) -> double
-			{
-				return props_sk.sigma_f * props_sk.sigma_f * exp(-point::distance(p1, p2) / props_sk.l_f);
-			};
-			auto corrFoo2 = [this](const auto& p1, const auto& p2) -> double
-			{
-				const double dist = point::distance(p1, p2) / props_sk.l_f;
-				return props_sk.sigma_f * props_sk.sigma_f * exp(-dist * dist);
-			};
-
-			return corrFoo2(cell.cent, beta.cent);
+			return kernel(point::distance(cell.cent, beta.cent));
 		};
 		inline double getSigma2f_prior(const Cell& cell) const
 		{
@@ -152,7 +166,8 @@ namespace stoch_oil
                             assert(fabs(s) < EQUALITY_TOLERANCE);
                     }
                 }*/
-                delete[] ind_i, ind_j;
+                delete[] ind_i;
+                delete[] ind_j;
                 delete[] cond_cov;
 
                 std::vector<std::vector<double>> mult_mat;
@@ -184,6 +199,22 @@ namespace stoch_oil
                         Favg[i] += mult_mat[i][k2] * (log(cond.perm / props_oil.visc) - getFavg_prior(c_cell));
                     }
                     // Covariance
+                    if (isCfSparse())
+                    {
+                        for (int k = Cf_sparse.rowBegin(i); k < Cf_sparse.rowEnd(i); k++)
+                        {
+                            const Cell& cell2 = mesh->cells[Cf_sparse.getCol(k)];
+                            double& cf = Cf_sparse.getVal(k);
+                            for (int k2 = 0; k2 < conditions.size(); k2++)
+                            {
+                                const auto& cond = conditions[k2];
+                                cf -= mult_mat[i][k2] * getCf_prior(mesh->cells[cond.id], cell2);
+                            }
+                            if (cell2.id == i && cf < 0.0 && cf > -EQUALITY_TOLERANCE)
+                                cf = 0.0;
+                        }
+                        continue;
+                    }
                     for (int j = 0; j < cellsNum; j++)
                     {
                         const Cell& cell2 = mesh->cells[j];
@@ -198,6 +229,10 @@ namespace stoch_oil
                 }
             }
 
+        };
+        // Wells are set per scenario, so their permeabilities are found apart from conditioning
+        void calculateWellPerm()
+        {
             for (const auto& cond : conditions)
             {
                 auto it = find_if(wells.begin(), wells.end(), [&](const Well& well) {return well.cell_id == cond.id; });
@@ -223,35 +258,77 @@ namespace stoch_oil
         {
             //assert(fabs(Cf[cell.id][beta.id] - Cf[beta.id][cell.id]) < 1.E-6);
             //assert(fabs(Cf[cell.id][beta.id] - getCf_prior(cell, beta)) < 1.E-6);
+            if (isCfSparse())
+                return Cf_sparse.get(cell.id, beta.id);
+            if (!Cf_packed.empty())
+                return bf16::decode(Cf_packed[(size_t)cell.id * cellsNum + beta.id]);
             return Cf[cell.id][beta.id];
         };
+        // Dense row of Cf, sparse and bfloat16 rows are unpacked into buffer of the last requested row
+        inline const double* getCfRow(const int id) const
+        {
+            if (!isCfSparse() && Cf_packed.empty())
+                return &Cf[id][0];
+            if (cf_row_id != id)
+            {
+                if (isCfSparse())
+                    Cf_sparse.getRow(id, &cf_row[0]);
+                else
+                    bf16::decode(&Cf_packed[(size_t)id * cellsNum], &cf_row[0], cellsNum);
+                cf_row_id = id;
+            }
+            return &cf_row[0];
+        };
+        // Compressed storage: Cfp layer is [cellsNum x innerNum], Cp layer is [innerNum x innerNum]
+        std::vector<int> inner_idx, inner_cells;
+        int innerNum;
+        inline double getCfp(const var::cov_t* layer, const int cell_id, const int beta_id) const
+        {
+            const int j = inner_idx[beta_id];
+            return (j < 0 ? 0.0 : layer[cell_id * innerNum + j]);
+        };
+        inline double getCp(const var::cov_t* layer, const int cell_id, const int beta_id) const
+        {
+            const int i = inner_idx[cell_id], j = inner_idx[beta_id];
+            return (i < 0 || j < 0 ? 0.0 : layer[i * innerNum + j]);
+        };
         inline double getSigma2f(const Cell& cell) const
         {
             return getCf(cell, cell);
         };
         inline double getKg(const Cell& cell) const
         {
-            return exp(getFavg(cell));
+            return Kg[cell.id];
         };
         inline double getGeomPerm(const Cell& cell) const
         {
             return getKg(cell) * props_oil.visc;
         };
 
-		adouble solveInner_p0(const Cell& cell) const;
-		adouble solveBorder_p0(const Cell& cell) const;
-		adouble solveSource_p0(const Well& well) const;
+		// p0 equations templated on scalar type, adouble is instantiated for taping.
+		// Element type is resolved at compile time through elem::TypeTag
+		template <class T> T solve_p0(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const;
+		template <class T> T solve_p0(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const;
+		template <class T> T solveSource_p0(const Well& well, const T* p) const;
 
-		adouble solveInner_Cfp(const Cell& cell, const Cell& cur_cell) const;
-		adouble solveBorder_Cfp(const Cell& cell, const Cell& cur_cell) const;
+		// Cfp & Cp equations are overloaded on the element type as well, all rows are scaled by P_dim
+		template <elem::Type T>
+		inline adouble solve_Cfp(elem::TypeTag<T> tag, const Cell& cell, const Cell& cur_cell) const
+		{
+			return solve_Cfp(tag, cell, getCfRow(cur_cell.id), getCfp(Cfp_prev, cur_cell.id, cell.id));
+		};
 		adouble solveSource_Cfp(const Well& well, const Cell& cur_cell) const;
+		// Same equations with arbitrary log-permeability source 'cf' (row of Cf or KL mode) and previous value 'prev'
+		adouble solve_Cfp(elem::TypeTag<elem::QUAD>, const Cell& cell, const double* cf, const double prev) const;
+		adouble solve_Cfp(elem::TypeTag<elem::BORDER>, const Cell& cell, const double* cf, const double prev) const;
+		adouble solveSource_Cfp(const Well& well, const double* cf) const;
 
-		adouble solveInner_p2(const Cell& cell) const;
-		adouble solveBorder_p2(const Cell& cell) const;
-		adouble solveSource_p2(const Well& well) const;
+		template <class T> T solve_p2(elem::TypeTag<elem::QUAD>, const Cell& cell, const T* p) const;
+		template <class T> T solve_p2(elem::TypeTag<elem::BORDER>, const Cell& cell, const T* p) const;
+		template <class T> T solveSource_p2(const Well& well, const T* p) const;
 
-		adouble solveInner_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const;
-		adouble solveBorder_Cp(const Cell& cell, const Cell& cur_cell, const size_t step_idx) const;
+		adouble solve_Cp(elem::TypeTag<elem::QUAD>, const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const;
+		adouble solve_Cp(elem::TypeTag<elem::BORDER>, const Cell& cell, const Cell& cur_cell, const size_t step_idx, const size_t cur_step_idx) const;
 		adouble solveSource_Cp(const Well& well, const Cell& cur_cell, const size_t step_idx) const;
 
         double getRate(const Well& well) const;
@@ -264,6 +341,7 @@ namespace stoch_oil
 
 		void setProps(const Properties& props);
 		void setPeriod(const int period);
+		void adopt(StochOil* done);
 	};
 };
 
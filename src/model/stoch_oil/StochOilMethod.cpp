@@ -1,55 +1,62 @@
 #include <fstream>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <chrono>
 #include "src/model/stoch_oil/StochOilMethod.hpp"
+#include "src/utils/Comm.hpp"
 
 #include "adolc/sparse/sparsedrivers.h"
 #include "adolc/drivers/drivers.h"
 
 using namespace stoch_oil;
 
-StochOilMethod::StochOilMethod(Model* _model) : AbstractMethod<Model>(_model)
+StochOilMethod::StochOilMethod(Model* _model) : AbstractMethod<Model>(_model), jac_p0(0), jac_Cfp(1), jac_p2(2), jac_Cp(3)
 {
 	const int strNum0 = model->cellsNum;
-	y0 = new double[strNum0];
-	ind_i0 = new int[Mesh::stencil * strNum0];
-	ind_j0 = new int[Mesh::stencil * strNum0];
-	//cols = new int[strNum];
-	a0 = new double[Mesh::stencil * strNum0];
-	ind_rhs0 = new int[strNum0];
-	rhs0 = new double[strNum0];
+	workspace.add(y0, strNum0);
+	workspace.add(ind_i0, Mesh::stencil * strNum0);
+	workspace.add(ind_j0, Mesh::stencil * strNum0);
+	workspace.add(ind_rhs0, strNum0);
+	workspace.add(rhs0, strNum0);
 
 	const int strNum1 = model->cellsNum;
-	y1 = new double[strNum1];
-	ind_i1 = new int[Mesh::stencil * strNum1];
-	ind_j1 = new int[Mesh::stencil * strNum1];
-	//cols = new int[strNum];
-	a1 = new double[Mesh::stencil * strNum1];
-	ind_rhs1 = new int[strNum1];
-	rhs1 = new double[strNum1];
+	workspace.add(y1, strNum1);
+	workspace.add(ind_i1, Mesh::stencil * strNum1);
+	workspace.add(ind_j1, Mesh::stencil * strNum1);
+	workspace.add(ind_rhs1, strNum1);
+	workspace.add(rhs1, strNum1);
+	workspace.add(x1, strNum1);
+
+	workspace.allocate();
+	steady_allocs = 0;
+	steady_iters = 0;
 
 	//options[0] = 0;          /* sparsity pattern by index domains (default) */
 	//options[1] = 0;          /*                         safe mode (default) */
 	//options[2] = 0;          /*              not required if options[0] = 0 */
 	//options[3] = 0;          /*                column compression (default) */
 
-	pvd.open("snaps/StochOil.pvd", std::ofstream::out);
+	pvd.open(model->getOutDir() + "StochOil.pvd", std::ofstream::out);
 	pvd << "<VTKFile type = \"Collection\" version = \"1.0\" byte_order = \"LittleEndian\" header_type = \"UInt64\">\n";
 	pvd << "\t<Collection>\n";
 
-	plot_P.open("snaps/P.dat", std::ofstream::out);
-	plot_Q.open("snaps/Q.dat", std::ofstream::out);
+	plot_P.open(model->getOutDir() + "P.dat", std::ofstream::out);
+	plot_Q.open(model->getOutDir() + "Q.dat", std::ofstream::out);
+	// Enough digits to tell float storage from double in comparisons
+	plot_P << std::setprecision(12);
+	plot_Q << std::setprecision(12);
+	loadReference();
+
+	stepControl = StepController::create(model->step_control_props);
 };
 StochOilMethod::~StochOilMethod()
 {
-	delete[] y0, y1;
-
-	delete[] ind_i0, ind_j0, ind_rhs0;
-	delete[] a0, rhs0;
-
-	delete[] ind_i1, ind_j1, ind_rhs1;
-	delete[] a1, rhs1;
-
+	// Workspace buffers are released by workspace itself
+	reportReference();
+	reportDomain();
 	plot_P.close();
 	plot_Q.close();
 	pvd << "\t</Collection>\n";
@@ -58,14 +65,21 @@ StochOilMethod::~StochOilMethod()
 };
 void StochOilMethod::writeData()
 {
+	if (!comm::isRoot())
+		return;
+
 	plot_Q << cur_t * t_dim / 3600.0;
 	plot_P << cur_t * t_dim / 3600.0;
 
+	std::vector<double> std_P, std_Q;
 	for (const auto& well : model->wells)
 	{
-		plot_Q << "\t" << model->getRate(well) * model->Q_dim * 86400.0 << "\t" << sqrt(model->getRateVar(well, step_idx)) * model->Q_dim * 86400.0;
-		plot_P << "\t" << model->getPwf(well) * model->P_dim / BAR_TO_PA << "\t" << sqrt(model->getPwfVar(well, step_idx)) * model->P_dim / BAR_TO_PA;
+		std_Q.push_back(sqrt(model->getRateVar(well, step_idx)) * model->Q_dim * 86400.0);
+		std_P.push_back(sqrt(model->getPwfVar(well, step_idx)) * model->P_dim / BAR_TO_PA);
+		plot_Q << "\t" << model->getRate(well) * model->Q_dim * 86400.0 << "\t" << std_Q.back();
+		plot_P << "\t" << model->getPwf(well) * model->P_dim / BAR_TO_PA << "\t" << std_P.back();
 	}
+	compareReference(std_P, std_Q);
 
 	plot_Q << std::endl;
 	plot_P << std::endl;
@@ -75,50 +89,211 @@ void StochOilMethod::writeData()
 
     model->writeCPS(step_idx);
 }
+void StochOilMethod::loadReference()
+{
+	ref_row = 0;
+	ref_time_mismatch = 0;
+	if (model->reference_dir.empty())
+		return;
+
+	const size_t wellsNum = model->wells.size();
+	auto read = [wellsNum](const std::string& fileName, std::vector<std::vector<double>>& rows)
+	{
+		std::ifstream file(fileName);
+		if (!file.is_open())
+			throw std::runtime_error("Cannot open reference plot " + fileName);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream ss(line);
+			std::vector<double> row;
+			double val;
+			while (ss >> val)
+				row.push_back(val);
+			if (row.empty())
+				continue;
+			if (row.size() != 1 + 2 * wellsNum)
+				throw std::runtime_error(fileName + ": columns do not match wells of the scenario");
+			rows.push_back(row);
+		}
+	};
+	read(model->reference_dir + "P.dat", ref_P);
+	read(model->reference_dir + "Q.dat", ref_Q);
+
+	ref_err_P.assign(wellsNum, 0.0);	ref_err_Q.assign(wellsNum, 0.0);
+	ref_max_P.assign(wellsNum, 0.0);	ref_max_Q.assign(wellsNum, 0.0);
+}
+void StochOilMethod::compareReference(const std::vector<double>& std_P, const std::vector<double>& std_Q)
+{
+	if (ref_row >= ref_P.size() || ref_row >= ref_Q.size())
+		return;
+
+	// Steps are matched by number, adaptive stepping of the runs may still differ
+	const double t = cur_t * t_dim / 3600.0;
+	const auto& row_P = ref_P[ref_row];
+	const auto& row_Q = ref_Q[ref_row];
+	if (fabs(row_P[0] - t) > 1.E-6 * std::max(1.0, t))
+		ref_time_mismatch++;
+	for (size_t w = 0; w < std_P.size(); w++)
+	{
+		const double var_P = row_P[2 + 2 * w] * row_P[2 + 2 * w];
+		const double var_Q = row_Q[2 + 2 * w] * row_Q[2 + 2 * w];
+		ref_err_P[w] = std::max(ref_err_P[w], fabs(std_P[w] * std_P[w] - var_P));
+		ref_err_Q[w] = std::max(ref_err_Q[w], fabs(std_Q[w] * std_Q[w] - var_Q));
+		ref_max_P[w] = std::max(ref_max_P[w], var_P);
+		ref_max_Q[w] = std::max(ref_max_Q[w], var_Q);
+	}
+	ref_row++;
+}
+void StochOilMethod::reportReference() const
+{
+	if (ref_P.empty())
+		return;
+
+	// Deviations are scaled by the largest reference variance of the well, zero variances give absolute ones
+	std::cout << "Variances against " << model->reference_dir << ": " << ref_row << " steps compared";
+	if (ref_time_mismatch > 0)
+		std::cout << ", " << ref_time_mismatch << " of them at different times";
+	std::cout << std::endl;
+	for (size_t w = 0; w < ref_err_P.size(); w++)
+		std::cout << "\twell " << w << ": getPwfVar max rel. error = " << ref_err_P[w] / (ref_max_P[w] > 0.0 ? ref_max_P[w] : 1.0) <<
+			", getRateVar max rel. error = " << ref_err_Q[w] / (ref_max_Q[w] > 0.0 ? ref_max_Q[w] : 1.0) << std::endl;
+}
 void StochOilMethod::control()
 {
 	writeData();
 
-	if (cur_t >= model->wells[0].period[curTimePeriod])
+	const auto& schedule = model->schedule;
+	if (cur_t >= schedule.getTime(curTimePeriod))
 	{
 		curTimePeriod++;
-		model->ht = model->ht_min;
 		model->setPeriod(curTimePeriod);
+		// New rate or BHP needs small steps again, other events only split the step
+		if (schedule.isControlChange(curTimePeriod))
+		{
+			model->ht = model->ht_min;
+			stepControl->reset();
+		}
 	}
 
-	model->ht *= 2.0;
-	//if (model->ht <= model->ht_max && iterations < 6)
-	//	model->ht = model->ht * 1.5;
-	//else if (iterations > 6 && model->ht > model->ht_min)
-	//	model->ht = model->ht / 1.5;
-
-	if (cur_t + model->ht > model->wells[0].period[curTimePeriod])
-		model->ht = model->wells[0].period[curTimePeriod] - cur_t;
+	model->ht = stepControl->propose(model->ht, feedback);
+	// Doubling takes the steps of the original scheme, bounds and the history budget are applied to PID steps only
+	const bool isAdaptive = (model->step_control_props.type == StepControlProps::PID);
+	if (isAdaptive)
+	{
+		model->ht = std::max(model->ht_min, std::min(model->ht, model->ht_max));
+		// Every step takes a Cfp/Cp history layer
+		const double ht_budget = getMinStep();
+		if (model->ht < ht_budget)
+		{
+			if (ht_budget > model->ht_max)
+				std::cout << "Step " << ht_budget * t_dim << " s exceeds ht_max: possible_steps_num is too small" << std::endl;
+			model->ht = ht_budget;
+		}
+	}
 
-	cur_t += model->ht;
+	if (cur_t + model->ht >= schedule.getTime(curTimePeriod))
+	{
+		model->ht = schedule.getTime(curTimePeriod) - cur_t;
+		cur_t = schedule.getTime(curTimePeriod);
+	}
+	else
+	{
+		// Land on the event without a sliver step
+		const double rest = schedule.getTime(curTimePeriod) - cur_t;
+		if (isAdaptive && 2.0 * model->ht > rest)
+			model->ht = rest / 2.0;
+		cur_t += model->ht;
+	}
 }
-void StochOilMethod::start()
+double StochOilMethod::getMinStep() const
 {
-	step_idx = 0;
+	// One step per every following event is reserved
+	const auto& schedule = model->schedule;
+	const int stepsLeft = model->possible_steps_num - 1 - step_idx - (int(schedule.size()) - 1 - int(curTimePeriod));
+	const double rest = schedule.getTime(curTimePeriod) - cur_t;
+	return (stepsLeft > 1 ? rest / stepsLeft : rest);
+}
+void StochOilMethod::saveState()
+{
+	AbstractMethod<Model>::saveState();
+	checkpoint.add("step_feedback", &feedback, sizeof(feedback));
+	stepControl->saveState(checkpoint);
+}
+void StochOilMethod::loadState()
+{
+	AbstractMethod<Model>::loadState();
+	checkpoint.get("step_feedback", &feedback, sizeof(feedback));
+	stepControl->loadState(checkpoint);
+}
+bool StochOilMethod::restart()
+{
+	if (!AbstractMethod<Model>::restart())
+		return false;
 
+	// Time layer pointers follow the restored step
+	if (step_idx + 1 < model->possible_steps_num)
+	{
+		model->Cfp_prev = &model->Cfp[step_idx][0];
+		model->Cfp_next = &model->Cfp[step_idx + 1][0];
+		if (model->kl.isActive())
+		{
+			model->p1_kl_prev = &model->p1_kl[step_idx][0];
+			model->p1_kl_next = &model->p1_kl[step_idx + 1][0];
+		}
+	}
+	std::cout << "Restarted at time = " << cur_t << ", step = " << step_idx << std::endl;
+	return true;
+}
+void StochOilMethod::prepare()
+{
 	fillIndices();
 	solver0.Init(model->cellsNum, 1.e-15, 1.e-15);
 	solver1.Init(model->cellsNum, 1.e-15, 1.e-15);
-
-	model->setPeriod(curTimePeriod);
-	while (cur_t < Tt)
+	solver0.SetPattern(ind_i0, ind_j0, elemNum0);
+	solver1.SetPattern(ind_i1, ind_j1, elemNum1);
+	buildDomain();
+}
+void StochOilMethod::buildDomain()
+{
+	const int ranksNum = comm::getSize();
+	domain.build(model->cellsNum, mesh->num_y + 2, ranksNum);
+	// Ranks beyond the number of grid rows own nothing
+	cell_bounds.resize(ranksNum + 1);
+	inner_bounds.resize(ranksNum + 1);
+	for (int r = 0; r <= ranksNum; r++)
 	{
-		control();
-		model->snapshot_all(step_idx++);
-		doNextStep();
-		copyTimeLayer();
-		cout << "---------------------NEW TIME STEP---------------------" << std::endl;
-		cout << std::setprecision(6);
-		cout << "time = " << cur_t << std::endl;
+		cell_bounds[r] = (r < domain.getThreadsNum() ? domain.begin(r) : model->cellsNum);
+		// Cp rows go by inner indices, inner cells of a strip are contiguous in them
+		int inner = 0;
+		for (int i = 0; i < cell_bounds[r]; i++)
+			inner += (model->inner_idx[i] >= 0);
+		inner_bounds[r] = inner;
 	}
-
-	model->snapshot_all(step_idx);
-	writeData();
+	sweep_time = exchange_time = exchange_bytes = 0.0;
+	columns_solved = 0;
+	if (ranksNum > 1)
+		std::cout << "Distributed: " << ranksNum << " ranks, " << model->cellsNum << " cells in strips of " <<
+			mesh->num_y + 2 << "-cell grid rows" << std::endl;
+}
+void StochOilMethod::reportDomain() const
+{
+	const int ranksNum = comm::getSize();
+	if (ranksNum == 1)
+		return;
+
+	// Imbalance is the slowest rank against the mean one. Weak scaling keeps cells per rank fixed,
+	// so time per column and exchange per rank are what runs of different sizes compare
+	const double max_sweep = comm::maxAll(sweep_time), mean_sweep = comm::sumAll(sweep_time) / ranksNum;
+	const double max_exchange = comm::maxAll(exchange_time), max_bytes = comm::maxAll(exchange_bytes);
+	const double max_per_column = comm::maxAll(columns_solved > 0 ? sweep_time / columns_solved : 0.0);
+	int max_cells = 0;
+	for (int r = 0; r < ranksNum; r++)
+		max_cells = std::max(max_cells, cell_bounds[r + 1] - cell_bounds[r]);
+	std::cout << "Distributed: " << ranksNum << " ranks, " << model->cellsNum << " cells, up to " << max_cells <<
+		" per rank, Cfp/Cp sweeps " << max_sweep << " s (imbalance " << (mean_sweep > 0.0 ? max_sweep / mean_sweep : 1.0) <<
+		", " << max_per_column << " s per column), exchange " << max_exchange << " s, " << max_bytes / 1048576.0 <<
+		" MB received per rank" << std::endl;
 }
 void StochOilMethod::fillIndices()
 {
@@ -128,75 +303,206 @@ void StochOilMethod::fillIndices()
     {
         auto& cell = mesh->cells[i];
         getMatrixStencil(cell);
-
-        for (size_t i = 0; i < var_size; i++)
-            for (const int idx : cell.stencil)
-                for (size_t j = 0; j < var_size; j++)
-                {
-                    ind_i0[counter] = ind_i1[counter] = var_size * cell.id + i;
-                    ind_j0[counter] = ind_j1[counter] = var_size * idx + j;
-                    counter++;
-                }
+        // Border cells take only their used stencil entries
+        counter += elem::dispatchCell(cell.type, [&](auto tag)
+        {
+            return elem::fillBlockRow<var_size>(tag, cell, ind_i0 + counter, ind_j0 + counter);
+        });
         ind_rhs0[i] = ind_rhs1[i] = i;
     }
     elemNum0 = elemNum1 = counter;
+    std::copy_n(ind_i0, counter, ind_i1);
+    std::copy_n(ind_j0, counter, ind_j1);
 };
 
 void StochOilMethod::solveStep()
 {
-	col = offset = NULL;
-	dmat = NULL;
-	avoidMatrixCalc = false;
+	releaseInvert();
 
 	solveStep_p0();
-	solveStep_Cfp();
+	if (model->kl.isActive())
+		solveStep_Cfp_kl();
+	else
+		solveStep_Cfp();
 	solveStep_p2();
-	solveStep_Cp();
+	if (model->kl.isActive())
+		solveStep_Cp_kl();
+	else
+		solveStep_Cp();
 }
 void StochOilMethod::solveStep_p0()
 {
-	int cellIdx, varIdx, iterations;
+	int cellIdx, iterations, linearIterations = 0;
 	double err_newton = 1.0;
 	averValPrev = averValue_p0();
 
 	iterations = 0;	err_newton = 1;	dAverVal = 1.0;
+	size_t allocations = 0;
 	while (err_newton > 1.e-4 && dAverVal > 1.e-7 && iterations < 20)
 	{
-		copyIterLayer_p0();
-		computeJac_p0();
+		// Whole iteration is counted, the solver included
+		const size_t alloc_begin = alloc_counter::get();
+		// Tape of a step is reused by later iterates unless they branch off it
+		const bool isTraced = (iterations == 0 || !evalTape(jac_p0, model->cellsNum, &model->p0_next[0], y0));
+		if (isTraced)
+			computeJac_p0();
 		fill_p0();
-		solver0.Assemble(ind_i0, ind_j0, a0, elemNum0, ind_rhs0, rhs0);
+		solver0.AssembleValues(rhs0);
 		solver0.Solve(PRECOND::ILU_SIMPLE);
-		copySolution_p0(solver0.getSolution());
-
-		err_newton = convergance_p0(cellIdx, varIdx);
-		averVal = averValue_p0();
+		linearIterations += solver0.getIterations();
+		// Update, convergence check and average in one pass
+		double* dx = solver0.lendSolution();
+		const auto stats = applyNewtonUpdate(&model->p0_next[0], dx);
+		solver0.returnSolution(dx);
+
+		err_newton = stats.relErr;		cellIdx = stats.ind;
+		averVal = stats.volSum;
 		dAverVal = fabs(averVal - averValPrev);
 		averValPrev = averVal;
 
+		// Tracing and the first solve on a pattern allocate, later iterations must not
+		if (!isTraced)
+		{
+			allocations += alloc_counter::get() - alloc_begin;
+			steady_iters++;
+		}
 		iterations++;
 	}
 	std::cout << std::endl << "p0 Iterations = " << iterations << std::endl << std::endl;
+	if (alloc_counter::isEnabled())
+		std::cout << "p0: " << allocations << " heap allocations in steady-state iterations" << std::endl;
+	steady_allocs += allocations;
+
+	feedback.valid = true;
+	feedback.converged = (err_newton <= 1.e-4 || dAverVal <= 1.e-7);
+	feedback.newtonIters = iterations;
+	feedback.linearIters = (double)linearIterations / (double)iterations;
+	feedback.change = 0.0;
+	for (int i = 0; i < size; i++)
+		if (model->p0_prev[i] != 0.0)
+			feedback.change = std::max(feedback.change, fabs((model->p0_next[i] - model->p0_prev[i]) / model->p0_prev[i]));
 }
 void StochOilMethod::solveStep_Cfp()
 {
-	for (const auto& cell : mesh->cells)
+	int skipped = 0;
+	const int rank = comm::getRank();
+	const auto t0 = std::chrono::steady_clock::now();
+	for (int id = cell_bounds[rank]; id < cell_bounds[rank + 1]; id++)
 	{
+		const auto& cell = mesh->cells[id];
+		if (isZeroSource_Cfp(cell.id))
+		{
+			skipped++;
+			continue;
+		}
 		//if (cell.type == elem::QUAD)
 		//{
 			computeJac_Cfp(cell.id);
 			fill_Cfp(cell.id);
-			if (!avoidMatrixCalc)
-			{
-				solver1.getInvert(ind_i1, ind_j1, a1, elemNum1, offset, col, dmat);
-				//checkInvertMatrix();
-				avoidMatrixCalc = true;
-			}
+			buildInvert(solver1);
+			//checkInvertMatrix();
 			copySolution_Cfp(cell.id);
+			columns_solved++;
 			std::cout << "Cfp #" << cell.id << std::endl;
 			solver1.SetSameMatrix();
 		//}
 	}
+	const auto t1 = std::chrono::steady_clock::now();
+	comm::allgatherRows(model->Cfp_next, cell_bounds, model->innerNum);
+	exchange_bytes += (double)(model->cellsNum - (cell_bounds[rank + 1] - cell_bounds[rank])) * model->innerNum * sizeof(var::cov_t);
+	sweep_time += std::chrono::duration<double>(t1 - t0).count();
+	exchange_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+	std::cout << "Cfp: " << skipped << " zero columns skipped" << std::endl;
+}
+bool StochOilMethod::isZeroSource_Cfp(const int cell_id) const
+{
+	// Row keeps zero while log-permeability at cell_id is uncorrelated with the whole domain
+	const double tol = EQUALITY_TOLERANCE * model->kernel.sigma * model->kernel.sigma;
+	const double* cf = model->getCfRow(cell_id);
+	for (int i = 0; i < size; i++)
+		if (fabs(cf[i]) > tol)
+			return false;
+
+	const var::cov_t* prev = &model->Cfp_prev[cell_id * model->innerNum];
+	for (int j = 0; j < model->innerNum; j++)
+		if (prev[j] != 0.0)
+			return false;
+	return true;
+}
+bool StochOilMethod::isZeroSource_Cp(const int cell_id, const size_t time_step) const
+{
+	const var::cov_t* cfp = &model->Cfp[time_step][0];
+	for (int i = 0; i < size; i++)
+		if (model->getCfp(cfp, i, cell_id) != 0.0)
+			return false;
+
+	const var::cov_t* prev = (time_step > model->start_time_simple_approx ? &model->Cp_prev[time_step - 1][0] : &model->Cp_next[time_step - 1][0]);
+	const int row = model->inner_idx[cell_id] * model->innerNum;
+	for (int j = 0; j < model->innerNum; j++)
+		if (prev[row + j] != 0.0)
+			return false;
+	return true;
+}
+void StochOilMethod::solveStep_Cfp_kl()
+{
+	const int modesNum = model->kl.getModesNum();
+	for (int m = 0; m < modesNum; m++)
+	{
+		computeJac_Cfp_kl(m);
+		fill_Cfp_kl(m);
+		buildInvert(solver1);
+		copySolution_Cfp_kl(m);
+		solver1.SetSameMatrix();
+	}
+	std::cout << "Cfp: " << modesNum << " KL modes" << std::endl;
+
+	// Cfp(a, b) = sum_m psi_m(a) * p1_m(b)
+	// Sums go in double, storage type takes the final value only
+	const auto p1 = model->p1_kl_next;
+	const int innerNum = model->innerNum;
+	std::vector<double> acc(innerNum);
+	for (int a = 0; a < size; a++)
+	{
+		std::fill(acc.begin(), acc.end(), 0.0);
+		for (int m = 0; m < modesNum; m++)
+		{
+			const double psi = model->kl.getMode(m)[a];
+			const double* p1_m = &p1[m * size];
+			for (int j = 0; j < innerNum; j++)
+				acc[j] += psi * p1_m[model->inner_cells[j]];
+		}
+		std::copy(acc.begin(), acc.end(), &model->Cfp_next[a * innerNum]);
+	}
+}
+void StochOilMethod::solveStep_Cp_kl()
+{
+	int start_idx = 1;
+	if (step_idx > model->start_time_simple_approx)
+		start_idx = step_idx;
+
+	// Cp(p(t_ts, a), p(t, b)) = sum_m p1_m(t_ts, a) * p1_m(t, b)
+	const int modesNum = model->kl.getModesNum();
+	const int innerNum = model->innerNum;
+	const auto& p1_cur = model->p1_kl[step_idx];
+	std::vector<double> acc(innerNum);
+	for (int time_step = start_idx; time_step < step_idx + 1; time_step++)
+	{
+		const auto& p1_ts = model->p1_kl[time_step];
+		auto cp = model->Cp_next[time_step];
+		for (int i = 0; i < innerNum; i++)
+		{
+			std::fill(acc.begin(), acc.end(), 0.0);
+			for (int m = 0; m < modesNum; m++)
+			{
+				const double coef = p1_ts[m * size + model->inner_cells[i]];
+				const double* p1_m = &p1_cur[m * size];
+				for (int j = 0; j < innerNum; j++)
+					acc[j] += coef * p1_m[model->inner_cells[j]];
+			}
+			std::copy(acc.begin(), acc.end(), &cp[i * innerNum]);
+		}
+		std::cout << "time step = " << time_step << "\t Cp from " << modesNum << " KL modes" << std::endl;
+	}
 }
 void StochOilMethod::checkInvertMatrix() const 
 {
@@ -211,12 +517,12 @@ void StochOilMethod::checkInvertMatrix() const
 			//ind = end_idx;
 			for (size_t k = 0; k < size; k++)
 			{
-                if (ind_i1[ind0] == i && ind_j1[ind0] == k)
+                if (jac_Cfp.ind_i[ind0] == i && jac_Cfp.ind_j[ind0] == k)
                 {
                     for (int l = offset[k]; l < offset[k + 1]; l++)
                         if (col[l] == j)
                         {
-                            val += a1[ind0] * dmat[ind1];
+                            val += jac_Cfp.a[ind0] * dmat[ind1];
                             break;
                         }
                     ind0++;
@@ -238,28 +544,44 @@ void StochOilMethod::checkInvertMatrix() const
 }
 void StochOilMethod::solveStep_p2()
 {
-	int cellIdx, varIdx, iterations;
+	int cellIdx, iterations;
 	double err_newton = 1.0;
-	averValPrev = averValue_p0();
+	averValPrev = averValue_p2();
 
 	iterations = 0;	err_newton = 1;	dAverVal = 1.0;
+	size_t allocations = 0;
 	while (err_newton > 1.e-4 && dAverVal > 1.e-7 && iterations < 20)
 	{
-		copyIterLayer_p2();
-		computeJac_p2();
+		// Whole iteration is counted, the solver included
+		const size_t alloc_begin = alloc_counter::get();
+		const bool isTraced = (iterations == 0 || !evalTape(jac_p2, model->cellsNum, &model->p2_next[0], y0));
+		if (isTraced)
+			computeJac_p2();
 		fill_p2();
-		solver0.Assemble(ind_i0, ind_j0, a0, elemNum0, ind_rhs0, rhs0);
+		solver0.AssembleValues(rhs0);
 		solver0.Solve(PRECOND::ILU_SIMPLE);
-		copySolution_p2(solver0.getSolution());
+		// Update, convergence check and average in one pass
+		double* dx = solver0.lendSolution();
+		const auto stats = applyNewtonUpdate(&model->p2_next[0], dx);
+		solver0.returnSolution(dx);
 
-		err_newton = convergance_p2(cellIdx, varIdx);
-		averVal = averValue_p2();
+		err_newton = stats.relErr;		cellIdx = stats.ind;
+		averVal = stats.volSum;
 		dAverVal = fabs(averVal - averValPrev);
 		averValPrev = averVal;
 
+		// Tracing and the first solve on a pattern allocate, later iterations must not
+		if (!isTraced)
+		{
+			allocations += alloc_counter::get() - alloc_begin;
+			steady_iters++;
+		}
 		iterations++;
 	}
 	std::cout << std::endl << "p2 Iterations = " << iterations << std::endl << std::endl;
+	if (alloc_counter::isEnabled())
+		std::cout << "p2: " << allocations << " heap allocations in steady-state iterations" << std::endl;
+	steady_allocs += allocations;
 }
 void StochOilMethod::solveStep_Cp()
 {
@@ -267,26 +589,31 @@ void StochOilMethod::solveStep_Cp()
 	if (step_idx > model->start_time_simple_approx)
 		start_idx = step_idx;
 
+	const int rank = comm::getRank();
 	for (int time_step = start_idx; time_step < step_idx + 1; time_step++)
 	{
-		for (const auto& cell : mesh->cells)
+		const auto t0 = std::chrono::steady_clock::now();
+		for (int id = cell_bounds[rank]; id < cell_bounds[rank + 1]; id++)
 		{
-			if (cell.type == elem::QUAD)
+			const auto& cell = mesh->cells[id];
+			if (cell.type == elem::QUAD && !isZeroSource_Cp(cell.id, time_step))
 			{
 				computeJac_Cp(cell.id, time_step);
 				fill_Cp(cell.id, time_step);
+				buildInvert(solver1);
 				copySolution_Cp(cell.id, time_step);
+				columns_solved++;
 				std::cout << "time step = " << time_step << "\t Cp #" << cell.id << std::endl;
 			}
 		}
+		const auto t1 = std::chrono::steady_clock::now();
+		comm::allgatherRows(&model->Cp_next[time_step][0], inner_bounds, model->innerNum);
+		exchange_bytes += (double)(model->innerNum - (inner_bounds[rank + 1] - inner_bounds[rank])) * model->innerNum * sizeof(var::cov_t);
+		sweep_time += std::chrono::duration<double>(t1 - t0).count();
+		exchange_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
 	}
 }
 
-void StochOilMethod::copySolution_p0(const paralution::LocalVector<double>& sol)
-{
-	for (int i = 0; i < size; i++)
-		model->p0_next[i] += sol[i];
-}
 /*void StochOilMethod::copySolution_Cfp(const int cell_id, const paralution::LocalVector<double>& sol)
 {
 	for (int i = 0; i < size; i++)
@@ -294,19 +621,34 @@ void StochOilMethod::copySolution_p0(const paralution::LocalVector<double>& sol)
 }*/
 void StochOilMethod::copySolution_Cfp(const int cell_id)
 {
-	double s;
-	for (int i = 0; i < size; i++)
+	// Every strip owns its rows of the inverse and its entries of Cfp column
+	partition.run([this, cell_id](const int begin, const int end)
 	{
-		s = 0.0;
-		for (int j = offset[i]; j < offset[i + 1]; j++)
-			s += dmat[j] * rhs1[col[j]];
-		model->Cfp_next[cell_id * size + i] += s;
-	}
+		double s;
+		for (int i = begin; i < end; i++)
+		{
+			s = 0.0;
+			for (int j = offset[i]; j < offset[i + 1]; j++)
+				s += dmat[j] * rhs1[col[j]];
+			const int j = model->inner_idx[i];
+			if (j >= 0)
+				model->Cfp_next[cell_id * model->innerNum + j] += s;
+		}
+	});
 }
-void StochOilMethod::copySolution_p2(const paralution::LocalVector<double>& sol)
+void StochOilMethod::copySolution_Cfp_kl(const int mode)
 {
-	for (int i = 0; i < size; i++)
-		model->p2_next[i] += sol[i];
+	partition.run([this, mode](const int begin, const int end)
+	{
+		double s;
+		for (int i = begin; i < end; i++)
+		{
+			s = 0.0;
+			for (int j = offset[i]; j < offset[i + 1]; j++)
+				s += dmat[j] * rhs1[col[j]];
+			model->p1_kl_next[mode * size + i] += s;
+		}
+	});
 }
 /*void StochOilMethod::copySolution_Cp(const int cell_id, const paralution::LocalVector<double>& sol, const size_t time_step)
 {
@@ -315,14 +657,20 @@ void StochOilMethod::copySolution_p2(const paralution::LocalVector<double>& sol)
 }*/
 void StochOilMethod::copySolution_Cp(const int cell_id, const size_t time_step)
 {
-	double s;
-	for (size_t i = 0; i < size; i++)
+	const auto cp = model->Cp_next[time_step];
+	partition.run([this, cell_id, &cp](const int begin, const int end)
 	{
-		s = 0.0;
-		for (size_t j = offset[i]; j < offset[i + 1]; j++)
-			s += dmat[j] * rhs1[col[j]];
-		model->Cp_next[time_step][cell_id * size + i] += s;
-	}
+		double s;
+		for (int i = begin; i < end; i++)
+		{
+			s = 0.0;
+			for (int j = offset[i]; j < offset[i + 1]; j++)
+				s += dmat[j] * rhs1[col[j]];
+			const int j = model->inner_idx[i];
+			if (j >= 0)
+				cp[model->inner_idx[cell_id] * model->innerNum + j] += s;
+		}
+	});
 }
 
 void StochOilMethod::computeJac_p0()
@@ -335,20 +683,17 @@ void StochOilMethod::computeJac_p0()
 	for (int i = 0; i < size; i++)
 	{
 		const auto& cell = mesh->cells[i];
-
-		if (cell.type == elem::QUAD)
-			model->h[i * var_size] = model->solveInner_p0(cell);
-		else if (cell.type == elem::BORDER)
-			model->h[i * var_size] = model->solveBorder_p0(cell);
+		model->h[i * var_size] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_p0(tag, cell, model->x); });
 	}
 
     for (const auto& well : model->wells)
-        model->h[well.cell_id * var_size] += model->solveSource_p0(well);
+        model->h[well.cell_id * var_size] += model->solveSource_p0(well, model->x);
 
 	for (int i = 0; i < var_size * size; i++)
 		model->h[i] >>= y0[i];
 
 	trace_off();
+	jac_p0.retaped();
 }
 void StochOilMethod::computeJac_Cfp(const int cell_id)
 {
@@ -356,16 +701,15 @@ void StochOilMethod::computeJac_Cfp(const int cell_id)
 
 	const auto& cur_cell = mesh->cells[cell_id];
 	for (size_t i = 0; i < size; i++)
-		model->x[i] <<= model->Cfp_next[size * cell_id + i];
+	{
+		x1[i] = model->getCfp(model->Cfp_next, cell_id, i);
+		model->x[i] <<= x1[i];
+	}
 
 	for (int i = 0; i < size; i++)
 	{
 		const auto& cell = mesh->cells[i];
-
-		if (cell.type == elem::QUAD)
-			model->h[i] = model->solveInner_Cfp(cell, cur_cell) / model->P_dim;
-		else if (cell.type == elem::BORDER)
-			model->h[i] = model->solveBorder_Cfp(cell, cur_cell);
+		model->h[i] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_Cfp(tag, cell, cur_cell); });
 	}
     for (const auto& well : model->wells)
         model->h[well.cell_id] += model->solveSource_Cfp(well, cur_cell) / model->P_dim;
@@ -374,6 +718,30 @@ void StochOilMethod::computeJac_Cfp(const int cell_id)
 		model->h[i] >>= y1[i];
 
 	trace_off();
+	jac_Cfp.retaped();
+}
+void StochOilMethod::computeJac_Cfp_kl(const int mode)
+{
+	trace_on(1);
+
+	const double* psi = model->kl.getMode(mode);
+	const double* prev = &model->p1_kl_prev[size * mode];
+	for (size_t i = 0; i < size; i++)
+		model->x[i] <<= model->p1_kl_next[size * mode + i];
+
+	for (int i = 0; i < size; i++)
+	{
+		const auto& cell = mesh->cells[i];
+		model->h[i] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_Cfp(tag, cell, psi, prev[i]); });
+	}
+	for (const auto& well : model->wells)
+		model->h[well.cell_id] += model->solveSource_Cfp(well, psi) / model->P_dim;
+
+	for (int i = 0; i < size; i++)
+		model->h[i] >>= y1[i];
+
+	trace_off();
+	jac_Cfp.retaped();
 }
 void StochOilMethod::computeJac_p2()
 {
@@ -385,37 +753,34 @@ void StochOilMethod::computeJac_p2()
 	for (int i = 0; i < size; i++)
 	{
 		const auto& cell = mesh->cells[i];
-
-		if (cell.type == elem::QUAD)
-			model->h[i * var_size] = model->solveInner_p2(cell);
-		else if (cell.type == elem::BORDER)
-			model->h[i * var_size] = model->solveBorder_p2(cell);
+		model->h[i * var_size] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_p2(tag, cell, model->x); });
 	}
 
 	for (const auto& well : model->wells)
-		model->h[well.cell_id * var_size] += model->solveSource_p2(well);
+		model->h[well.cell_id * var_size] += model->solveSource_p2(well, model->x);
 
 	for (int i = 0; i < var_size * size; i++)
 		model->h[i] >>= y0[i];
 
 	trace_off();
+	jac_p2.retaped();
 }
 void StochOilMethod::computeJac_Cp(const int cell_id, const size_t time_step)
 {
 	trace_on(3);
 
 	const auto& cur_cell = mesh->cells[cell_id];
+	const var::cov_t* cp = &model->Cp_next[time_step][0];
 	for (size_t i = 0; i < size; i++)
-		model->x[i] <<= model->Cp_next[time_step][size * cell_id + i];
+	{
+		x1[i] = model->getCp(cp, cell_id, i);
+		model->x[i] <<= x1[i];
+	}
 
 	for (int i = 0; i < size; i++)
 	{
 		const auto& cell = mesh->cells[i];
-
-		if (cell.type == elem::QUAD)
-			model->h[i] = model->solveInner_Cp(cell, cur_cell, time_step, step_idx) / model->P_dim;
-		else if (cell.type == elem::BORDER)
-			model->h[i] = model->solveBorder_Cp(cell, cur_cell, time_step);
+		model->h[i] = elem::dispatchCell(cell.type, [&](auto tag) { return model->solve_Cp(tag, cell, cur_cell, time_step, step_idx); });
 	}
 	for (const auto& well : model->wells)
 		model->h[well.cell_id] += model->solveSource_Cp(well, cur_cell, time_step) / model->P_dim;
@@ -424,12 +789,12 @@ void StochOilMethod::computeJac_Cp(const int cell_id, const size_t time_step)
 		model->h[i] >>= y1[i];
 
 	trace_off();
+	jac_Cp.retaped();
 }
 
 void StochOilMethod::fill_p0()
 {
-	sparse_jac(0, model->cellsNum, model->cellsNum, repeat,
-		&model->p0_next[0], &elemNum0, (unsigned int**)(&ind_i0), (unsigned int**)(&ind_j0), &a0, options);
+	evalJacobian(jac_p0, model->cellsNum, &model->p0_next[0], solver0);
 
 	int counter = 0;
 	for (int j = 0; j < size; j++)
@@ -440,9 +805,8 @@ void StochOilMethod::fill_p0()
 }
 void StochOilMethod::fill_Cfp(const int cell_id)
 {
-	if(!avoidMatrixCalc)
-		sparse_jac(1, model->cellsNum, model->cellsNum, repeat,
-			&model->Cfp_next[cell_id * model->cellsNum], &elemNum1, (unsigned int**)(&ind_i1), (unsigned int**)(&ind_j1), &a1, options);
+	if (!avoidMatrixCalc)
+		evalJacobian(jac_Cfp, model->cellsNum, x1, solver1);
 
 	int counter = 0;
 	for (int j = 0; j < size; j++)
@@ -451,10 +815,17 @@ void StochOilMethod::fill_Cfp(const int cell_id)
 		rhs1[cell.id] = -y1[cell.id];
 	}
 }
+void StochOilMethod::fill_Cfp_kl(const int mode)
+{
+	if (!avoidMatrixCalc)
+		evalJacobian(jac_Cfp, model->cellsNum, &model->p1_kl_next[mode * model->cellsNum], solver1);
+
+	for (int j = 0; j < size; j++)
+		rhs1[j] = -y1[j];
+}
 void StochOilMethod::fill_p2()
 {
-	sparse_jac(2, model->cellsNum, model->cellsNum, repeat,
-		&model->p2_next[0], &elemNum0, (unsigned int**)(&ind_i0), (unsigned int**)(&ind_j0), &a0, options);
+	evalJacobian(jac_p2, model->cellsNum, &model->p2_next[0], solver0);
 
 	int counter = 0;
 	for (int j = 0; j < size; j++)
@@ -466,8 +837,7 @@ void StochOilMethod::fill_p2()
 void StochOilMethod::fill_Cp(const int cell_id, const size_t time_step)
 {
 	if (!avoidMatrixCalc)
-		sparse_jac(3, model->cellsNum, model->cellsNum, repeat,
-			&model->Cp_next[time_step][cell_id * model->cellsNum], &elemNum1, (unsigned int**)(&ind_i1), (unsigned int**)(&ind_j1), &a1, options);
+		evalJacobian(jac_Cp, model->cellsNum, x1, solver1);
 
 	int counter = 0;
 	for (int j = 0; j < size; j++)
@@ -486,44 +856,22 @@ void StochOilMethod::copyTimeLayer()
         model->Cfp[step_idx + 1] = model->Cfp[step_idx];
         model->Cfp_prev = &model->Cfp[step_idx][0];
         model->Cfp_next = &model->Cfp[step_idx + 1][0];
+        // Next sweep streams through the new layer row by row, older layers are needed only for Cp history
+        model->Cfp.advise(step_idx + 1, MappedField<var::cov_t>::SEQUENTIAL);
+        model->Cfp.advise(step_idx, MappedField<var::cov_t>::WILLNEED);
+        if (step_idx > model->start_time_simple_approx)
+            model->Cfp.advise(step_idx - 1, MappedField<var::cov_t>::COLD);
+        if (model->kl.isActive())
+        {
+            model->p1_kl[step_idx + 1] = model->p1_kl[step_idx];
+            model->p1_kl_prev = &model->p1_kl[step_idx][0];
+            model->p1_kl_next = &model->p1_kl[step_idx + 1][0];
+        }
     }
 	model->p2_prev = model->p2_iter = model->p2_next;
 
 	model->Cp_prev = model->Cp_next;
 }
-void StochOilMethod::copyIterLayer_p0()
-{
-	model->p0_iter = model->p0_next;
-}
-void StochOilMethod::copyIterLayer_p2()
-{
-	model->p2_iter = model->p2_next;
-}
-
-double StochOilMethod::convergance_p0(int& ind, int& varInd)
-{
-	double relErr = 0.0;
-	double cur_relErr = 0.0;
-
-	varInd = 0;
-	auto diff = std::abs((model->p0_next - model->p0_iter) / model->p0_next);
-	auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-	ind = std::distance(std::begin(diff), max_iter);
-
-	return *max_iter;
-}
-double StochOilMethod::convergance_p2(int& ind, int& varInd)
-{
-	double relErr = 0.0;
-	double cur_relErr = 0.0;
-
-	varInd = 0;
-	auto diff = std::abs((model->p2_next - model->p2_iter) / model->p2_next);
-	auto max_iter = std::max_element(std::begin(diff), std::end(diff));
-	ind = std::distance(std::begin(diff), max_iter);
-
-	return *max_iter;
-}
 
 double StochOilMethod::averValue_p0() const 
 {
@@ -536,7 +884,7 @@ double StochOilMethod::averValue_Cfp(const int cell_id) const
 {
 	double aver = 0.0;
 	for (const auto& cell : mesh->cells)
-		aver += model->Cfp_next[cell_id * model->cellsNum + cell.id] * cell.V;
+		aver += model->getCfp(model->Cfp_next, cell_id, cell.id) * cell.V;
 	return aver / model->Volume;
 }
 double StochOilMethod::averValue_p2() const
@@ -550,6 +898,6 @@ double StochOilMethod::averValue_Cp(const int cell_id, const size_t time_step) c
 {
 	double aver = 0.0;
 	for (const auto& cell : mesh->cells)
-		aver += model->Cp_next[time_step][cell_id * model->cellsNum + cell.id] * cell.V;
+		aver += model->getCp(&model->Cp_next[time_step][0], cell_id, cell.id) * cell.V;
 	return aver / model->Volume;
 }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "src/model/AbstractMethod.hpp"
 #include "src/model/stoch_oil/StochOil.hpp"
 #include "src/utils/ParalutionInterface.h"
+#include "src/utils/StepController.hpp"
+#include "src/utils/RowPartition.hpp"
 
 namespace stoch_oil
 {
@@ -12,29 +14,62 @@ namespace stoch_oil
 	protected:
 		void control();
 		void writeData();
+		void prepare();
 
 		void solveStep();
 		void solveStep_p0();
 		void solveStep_Cfp();
 		void solveStep_p2();
 		void solveStep_Cp();
+		// Reduced (Karhunen-Loeve) versions of Cfp & Cp sweeps
+		void solveStep_Cfp_kl();
+		void solveStep_Cp_kl();
 
 		std::ofstream plot_P, plot_Q, pvd;
+		// Well variances against P.dat & Q.dat of a full precision run: max deviations and max reference variances
+		// per well, in units of the plots
+		std::vector<std::vector<double>> ref_P, ref_Q;
+		std::vector<double> ref_err_P, ref_err_Q, ref_max_P, ref_max_Q;
+		size_t ref_row;
+		int ref_time_mismatch;
+		void loadReference();
+		void compareReference(const std::vector<double>& std_P, const std::vector<double>& std_Q);
+		void reportReference() const;
 		ParSolver solver0, solver1;
-		int step_idx;
 		double averVal, averValPrev, dAverVal;
+		// Time step selection
+		std::unique_ptr<StepController> stepControl;
+		StepFeedback feedback;
+		// Smallest step that finishes the run within possible_steps_num history layers
+		double getMinStep() const;
+		// Controller history and feedback of the last step are checkpointed with the fields
+		void saveState();
+		void loadState();
 
 		static const int var_size = 1;
-		
-		double* dmat;
-		int* offset;
-		int* col;
+
+		// Distributed run: Cfp/Cp sweeps over cell_id are split among ranks by strips of grid rows,
+		// owned rows of Cfp & Cp layers are gathered by all ranks after every sweep.
+		// Every column is a solve over the whole grid, so strips need no stencil halo.
+		// p0 & p2 systems are of grid size and solved by every rank. Layers stay replicated:
+		// Cp columns read whole Cfp columns, snapshots read well rows of both layers
+		RowPartition domain;
+		std::vector<int> cell_bounds, inner_bounds;
+		// Rank totals for the scaling report
+		double sweep_time, exchange_time, exchange_bytes;
+		int columns_solved;
+		// Heap allocations of steady-state p0 & p2 iterations and their number, over the run
+		size_t steady_allocs;
+		int steady_iters;
+		void buildDomain();
+		void reportDomain() const;
 
 		double** jac0;
 		double* y0;
 		int* ind_i0;
 		int* ind_j0;
-		double* a0;
+		// Jacobians of p0, Cfp (Cfp_kl), p2 & Cp tapes, values go to pinned CSR of the solvers
+		TapeJacobian jac_p0, jac_Cfp, jac_p2, jac_Cp;
 		int* ind_rhs0;
 		double* rhs0;
 		int* cols0;
@@ -43,40 +78,39 @@ namespace stoch_oil
 
 		double** jac1;
 		double* y1;
+		// Dense point of linearization for Cfp/Cp stored in compressed layout
+		double* x1;
 		int* ind_i1;
 		int* ind_j1;
-		double* a1;
 		int* ind_rhs1;
 		double* rhs1;
 		int* cols1;
 		// Number of non-zero elements in sparse matrix
 		int elemNum1;
-		bool avoidMatrixCalc;
 
 		void computeJac_p0();
 		void computeJac_Cfp(const int cell_id);
 		void computeJac_p2();
 		void computeJac_Cp(const int cell_id, const size_t time_step);
+		void computeJac_Cfp_kl(const int mode);
 		void fillIndices();
 		void fill_p0();
 		void fill_Cfp(const int cell_id);
 		void fill_p2();
 		void fill_Cp(const int cell_id, const size_t time_step);
-		void copySolution_p0(const paralution::LocalVector<double>& sol);
+		void fill_Cfp_kl(const int mode);
 		void copySolution_Cfp(const int cell_id, const paralution::LocalVector<double>& sol);
 		void copySolution_Cfp(const int cell_id);
-		void copySolution_p2(const paralution::LocalVector<double>& sol);
 		void copySolution_Cp(const int cell_id, const paralution::LocalVector<double>& sol, const size_t time_step);
 		void copySolution_Cp(const int cell_id, const size_t time_step);
+		void copySolution_Cfp_kl(const int mode);
 		void checkInvertMatrix() const;
+		// Columns with identically zero source and history need not be solved
+		bool isZeroSource_Cfp(const int cell_id) const;
+		bool isZeroSource_Cp(const int cell_id, const size_t time_step) const;
 
 
 		void copyTimeLayer();
-		void copyIterLayer_p0();
-		void copyIterLayer_p2();
-
-		double convergance_p0(int& ind, int& varInd);
-		double convergance_p2(int& ind, int& varInd);
 
 		double averValue_p0() const;
 		double averValue_Cfp(const int cell_id) const;
@@ -86,7 +120,11 @@ namespace stoch_oil
 		StochOilMethod(Model* _model);
 		~StochOilMethod();
 
-		void start();
+		bool restart();
+		// Heap allocations of p0 & p2 iterations that reuse the tape and the number of such iterations over the run,
+		// see alloc_counter
+		inline size_t getSteadyAllocations() const { return steady_allocs; };
+		inline int getSteadyIterations() const { return steady_iters; };
 	};
 };
 
@@ -0,0 +1,45 @@
+#ifndef BFLOAT16_HPP_
+#define BFLOAT16_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// bfloat16: upper half of IEEE float, 8 exponent and 7 mantissa bits (relative rounding error <= 2^-8).
+// Storage only, values are decoded to double for arithmetic
+namespace bf16
+{
+	typedef uint16_t bf16_t;
+	const double REL_ERROR = 1.0 / 256.0;
+
+	// Round to nearest even, NaN stays NaN
+	inline bf16_t encode(const double val)
+	{
+		const float f = (float)val;
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		if ((bits & 0x7fffffffu) > 0x7f800000u)
+			return (bf16_t)((bits >> 16) | 0x40u);
+		bits += 0x7fffu + ((bits >> 16) & 1u);
+		return (bf16_t)(bits >> 16);
+	};
+	inline double decode(const bf16_t val)
+	{
+		const uint32_t bits = (uint32_t)val << 16;
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return (double)f;
+	};
+	inline void encode(const double* src, bf16_t* dst, const size_t n)
+	{
+		for (size_t i = 0; i < n; i++)
+			dst[i] = encode(src[i]);
+	};
+	inline void decode(const bf16_t* src, double* dst, const size_t n)
+	{
+		for (size_t i = 0; i < n; i++)
+			dst[i] = decode(src[i]);
+	};
+};
+
+#endif /* BFLOAT16_HPP_ */
@@ -0,0 +1,243 @@
+#include "src/utils/Checkpoint.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#define fseek64 _fseeki64
+#define fsync_file(file) _commit(_fileno(file))
+#else
+#include <unistd.h>
+#define fseek64 fseeko
+#define fsync_file(file) fsync(fileno(file))
+#endif
+
+static const char checkpoint_magic[8] = { 'S', 'T', 'O', 'C', 'H', 'C', 'H', 'K' };
+
+Checkpoint::Checkpoint() : generation(0)
+{
+	tableKnown[0] = tableKnown[1] = false;
+}
+Checkpoint::~Checkpoint()
+{
+}
+uint64_t Checkpoint::checksum(const void* data, const size_t bytes)
+{
+	const unsigned char* ptr = static_cast<const unsigned char*>(data);
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ bytes;
+	uint64_t word;
+	auto mix = [&h](const uint64_t w)
+	{
+		h ^= w;
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 32;
+	};
+
+	const size_t words = bytes / sizeof(uint64_t);
+	for (size_t i = 0; i < words; i++)
+	{
+		memcpy(&word, ptr + i * sizeof(uint64_t), sizeof(uint64_t));
+		mix(word);
+	}
+	word = 0;
+	memcpy(&word, ptr + words * sizeof(uint64_t), bytes - words * sizeof(uint64_t));
+	mix(word);
+
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+std::string Checkpoint::getFileName(const int file) const
+{
+	return path + "." + std::to_string(file) + ".chk";
+}
+void Checkpoint::setPath(const std::string& _path)
+{
+	path = _path;
+	generation = 0;
+	chunks.clear();
+
+	// Continue numbering of existing files and reuse their tables for incremental writing
+	Header header;
+	for (int f = 0; f < 2; f++)
+	{
+		tableKnown[f] = (isEnabled() && readTable(f, header, tables[f]));
+		if (tableKnown[f])
+			generation = std::max(generation, header.generation);
+	}
+}
+void Checkpoint::add(const std::string& name, const void* data, const size_t bytes)
+{
+	chunks.push_back({ name.substr(0, sizeof(Entry::name) - 1), data, NULL, bytes });
+}
+void Checkpoint::get(const std::string& name, void* data, const size_t bytes)
+{
+	chunks.push_back({ name.substr(0, sizeof(Entry::name) - 1), NULL, data, bytes });
+}
+void Checkpoint::layout(std::vector<Entry>& table) const
+{
+	table.resize(chunks.size());
+	uint64_t offset = page + chunks.size() * sizeof(Entry);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		const auto& chunk = chunks[i];
+		auto& entry = table[i];
+		memset(entry.name, 0, sizeof(entry.name));
+		memcpy(entry.name, chunk.name.c_str(), chunk.name.size());
+		offset = (offset + page - 1) / page * page;
+		entry.offset = offset;
+		entry.bytes = chunk.bytes;
+		entry.checksum = (chunk.src != NULL ? checksum(chunk.src, chunk.bytes) : 0);
+		offset += chunk.bytes;
+	}
+}
+size_t Checkpoint::commit()
+{
+	if (!isEnabled())
+	{
+		chunks.clear();
+		return 0;
+	}
+
+	const int f = (generation + 1) % 2;
+	std::vector<Entry> table;
+	layout(table);
+
+	bool incremental = tableKnown[f] && tables[f].size() == table.size();
+	for (size_t i = 0; incremental && i < table.size(); i++)
+		incremental = (strncmp(table[i].name, tables[f][i].name, sizeof(Entry::name)) == 0 &&
+						table[i].offset == tables[f][i].offset && table[i].bytes == tables[f][i].bytes);
+
+	FILE* file = (incremental ? fopen(getFileName(f).c_str(), "r+b") : NULL);
+	if (file == NULL)
+	{
+		incremental = false;
+		file = fopen(getFileName(f).c_str(), "w+b");
+	}
+	if (file == NULL)
+	{
+		std::cout << "Cannot open checkpoint " << getFileName(f) << std::endl;
+		chunks.clear();
+		return 0;
+	}
+
+	// File stays invalid until all chunks are in place
+	Header header;
+	memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+	header.version = version;
+	header.chunksNum = table.size();
+	header.generation = 0;
+	header.tableChecksum = 0;
+	fseek64(file, 0, SEEK_SET);
+	fwrite(&header, sizeof(Header), 1, file);
+	fflush(file);
+	tableKnown[f] = false;
+
+	size_t written = 0;
+	bool ok = true;
+	for (size_t i = 0; i < table.size() && ok; i++)
+	{
+		if (incremental && table[i].checksum == tables[f][i].checksum)
+			continue;
+		ok = (fseek64(file, table[i].offset, SEEK_SET) == 0 && fwrite(chunks[i].src, 1, chunks[i].bytes, file) == chunks[i].bytes);
+		written += chunks[i].bytes;
+	}
+	ok = ok && fseek64(file, page, SEEK_SET) == 0 && fwrite(table.data(), sizeof(Entry), table.size(), file) == table.size();
+	ok = ok && fflush(file) == 0 && fsync_file(file) == 0;
+	if (ok)
+	{
+		header.generation = generation + 1;
+		header.tableChecksum = checksum(table.data(), table.size() * sizeof(Entry));
+		fseek64(file, 0, SEEK_SET);
+		ok = fwrite(&header, sizeof(Header), 1, file) == 1 && fflush(file) == 0 && fsync_file(file) == 0;
+	}
+	fclose(file);
+	chunks.clear();
+
+	if (!ok)
+	{
+		std::cout << "Failed to write checkpoint " << getFileName(f) << std::endl;
+		return 0;
+	}
+	generation++;
+	tables[f].swap(table);
+	tableKnown[f] = true;
+	return written;
+}
+bool Checkpoint::readTable(const int file, Header& header, std::vector<Entry>& table) const
+{
+	FILE* f = fopen(getFileName(file).c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	bool ok = fread(&header, sizeof(Header), 1, f) == 1 &&
+				memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) == 0 &&
+				header.version == version && header.generation > 0;
+	if (ok)
+	{
+		table.resize(header.chunksNum);
+		ok = fseek64(f, page, SEEK_SET) == 0 && fread(table.data(), sizeof(Entry), table.size(), f) == table.size() &&
+				checksum(table.data(), table.size() * sizeof(Entry)) == header.tableChecksum;
+	}
+	fclose(f);
+	return ok;
+}
+bool Checkpoint::validate(const int file, const std::vector<Entry>& table) const
+{
+	FILE* f = fopen(getFileName(file).c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	bool ok = true;
+	for (const auto& chunk : chunks)
+	{
+		const auto it = std::find_if(table.begin(), table.end(), [&](const Entry& entry)
+		{
+			return strncmp(entry.name, chunk.name.c_str(), sizeof(Entry::name)) == 0;
+		});
+		ok = (it != table.end() && it->bytes == chunk.bytes &&
+				fseek64(f, it->offset, SEEK_SET) == 0 && fread(chunk.dst, 1, chunk.bytes, f) == chunk.bytes &&
+				checksum(chunk.dst, chunk.bytes) == it->checksum);
+		if (!ok)
+		{
+			std::cout << "Checkpoint " << getFileName(file) << ": chunk " << chunk.name << " is missing or corrupted" << std::endl;
+			break;
+		}
+	}
+	fclose(f);
+	return ok;
+}
+bool Checkpoint::load()
+{
+	Header headers[2];
+	bool valid[2];
+	for (int f = 0; f < 2; f++)
+		valid[f] = isEnabled() && readTable(f, headers[f], tables[f]);
+
+	// Newest file first, the other one is a fallback
+	const int order[2] = { (valid[1] && (!valid[0] || headers[1].generation > headers[0].generation) ? 1 : 0),
+							(valid[1] && (!valid[0] || headers[1].generation > headers[0].generation) ? 0 : 1) };
+	int loaded = -1;
+	for (const int f : order)
+	{
+		tableKnown[f] = valid[f];
+		if (loaded < 0 && valid[f] && validate(f, tables[f]))
+		{
+			loaded = f;
+			std::cout << "Restarted from " << getFileName(f) << " (checkpoint #" << headers[f].generation << ")" << std::endl;
+		}
+	}
+	chunks.clear();
+	if (loaded < 0)
+		return false;
+
+	// Next checkpoint must not overwrite the file just restarted from
+	generation = std::max(valid[0] ? headers[0].generation : 0, valid[1] ? headers[1].generation : 0);
+	if ((int)((generation + 1) % 2) == loaded)
+		generation++;
+	return true;
+}
@@ -0,0 +1,92 @@
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CheckpointProps
+{
+	// Base name of checkpoint files, empty disables checkpointing
+	std::string path;
+	// Write every step_period time steps and/or every time_period seconds of wall time (0 - never)
+	int step_period;
+	double time_period;
+	// Resume from the newest valid checkpoint on load
+	bool restart;
+
+	CheckpointProps() : step_period(0), time_period(0.0), restart(false) {};
+};
+
+// Binary checkpoint made of named chunks.
+// Two files <path>.0.chk / <path>.1.chk are written in turn, so the previous checkpoint survives a crash during writing.
+// Every chunk starts at page boundary (file can be mapped as is) and carries its own checksum;
+// a chunk is rewritten only if its checksum differs from the one stored in the file being overwritten.
+//
+// File layout:
+//		Header (one page): magic, version, generation, chunks number, checksum of the table
+//		Table: chunksNum x Entry
+//		Chunks
+class Checkpoint
+{
+public:
+	static const uint32_t version = 1;
+	static const size_t page = 4096;
+
+	struct Entry
+	{
+		char name[40];
+		uint64_t offset;
+		uint64_t bytes;
+		uint64_t checksum;
+	};
+protected:
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t chunksNum;
+		uint64_t generation;
+		uint64_t tableChecksum;
+	};
+	struct Chunk
+	{
+		std::string name;
+		const void* src;
+		void* dst;
+		size_t bytes;
+	};
+
+	std::string path;
+	uint64_t generation;
+	// Chunks registered for the current write/read
+	std::vector<Chunk> chunks;
+	// Tables stored in both files
+	std::vector<Entry> tables[2];
+	bool tableKnown[2];
+
+	std::string getFileName(const int file) const;
+	bool readTable(const int file, Header& header, std::vector<Entry>& table) const;
+	bool validate(const int file, const std::vector<Entry>& table) const;
+	void layout(std::vector<Entry>& table) const;
+public:
+	Checkpoint();
+	~Checkpoint();
+
+	static uint64_t checksum(const void* data, const size_t bytes);
+
+	void setPath(const std::string& _path);
+	inline bool isEnabled() const { return !path.empty(); };
+	inline uint64_t getGeneration() const { return generation; };
+
+	// Writing: register chunks and commit them, returns number of bytes actually written
+	void add(const std::string& name, const void* data, const size_t bytes);
+	size_t commit();
+
+	// Reading: register destinations and load them from the newest valid file
+	void get(const std::string& name, void* data, const size_t bytes);
+	bool load();
+};
+
+#endif /* CHECKPOINT_HPP_ */
@@ -0,0 +1,121 @@
+#include "src/utils/Comm.hpp"
+
+#include <stdexcept>
+
+#ifdef USE_MPI
+#include <mpi.h>
+
+namespace comm
+{
+	void init(int* argc, char*** argv)
+	{
+		int isInit;
+		MPI_Initialized(&isInit);
+		if (!isInit)
+			MPI_Init(argc, argv);
+	}
+	void finalize()
+	{
+		int isDone;
+		MPI_Finalized(&isDone);
+		if (!isDone)
+			MPI_Finalize();
+	}
+	int getRank()
+	{
+		int rank;
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		return rank;
+	}
+	int getSize()
+	{
+		int size;
+		MPI_Comm_size(MPI_COMM_WORLD, &size);
+		return size;
+	}
+
+	template <class T>
+	static void allgatherRows(T* data, const std::vector<int>& bounds, const int rowSize, MPI_Datatype type)
+	{
+		const int size = getSize();
+		if ((int)bounds.size() != size + 1)
+			throw std::runtime_error("allgatherRows: bounds do not match number of ranks");
+		if (size == 1)
+			return;
+
+		// Counts and displacements go in whole rows: in elements they overflow int
+		// once a layer holds more than 2^31 entries (cellsNum x innerNum of a 200 x 200 grid)
+		MPI_Datatype row;
+		MPI_Type_contiguous(rowSize, type, &row);
+		MPI_Type_commit(&row);
+		std::vector<int> counts(size), displs(size);
+		for (int r = 0; r < size; r++)
+		{
+			counts[r] = bounds[r + 1] - bounds[r];
+			displs[r] = bounds[r];
+		}
+		MPI_Allgatherv(MPI_IN_PLACE, 0, row, data, counts.data(), displs.data(), row, MPI_COMM_WORLD);
+		MPI_Type_free(&row);
+	}
+	void allgatherRows(double* data, const std::vector<int>& bounds, const int rowSize)
+	{
+		allgatherRows(data, bounds, rowSize, MPI_DOUBLE);
+	}
+	void allgatherRows(float* data, const std::vector<int>& bounds, const int rowSize)
+	{
+		allgatherRows(data, bounds, rowSize, MPI_FLOAT);
+	}
+
+	double maxAll(const double val)
+	{
+		double res;
+		MPI_Allreduce(&val, &res, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		return res;
+	}
+	double sumAll(const double val)
+	{
+		double res;
+		MPI_Allreduce(&val, &res, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		return res;
+	}
+	void barrier()
+	{
+		MPI_Barrier(MPI_COMM_WORLD);
+	}
+};
+#else
+namespace comm
+{
+	void init(int*, char***)
+	{
+	}
+	void finalize()
+	{
+	}
+	int getRank()
+	{
+		return 0;
+	}
+	int getSize()
+	{
+		return 1;
+	}
+	void allgatherRows(double*, const std::vector<int>&, const int)
+	{
+	}
+	void allgatherRows(float*, const std::vector<int>&, const int)
+	{
+	}
+	double maxAll(const double val)
+	{
+		return val;
+	}
+	double sumAll(const double val)
+	{
+		return val;
+	}
+	void barrier()
+	{
+	}
+};
+#endif
@@ -0,0 +1,27 @@
+#ifndef COMM_HPP_
+#define COMM_HPP_
+
+#include <vector>
+
+// Ranks of a distributed run. Built with USE_MPI it works over MPI_COMM_WORLD,
+// otherwise it is a single rank stand-in and callers need no #ifdefs
+namespace comm
+{
+	void init(int* argc, char*** argv);
+	void finalize();
+
+	int getRank();
+	int getSize();
+	inline bool isRoot() { return getRank() == 0; };
+
+	// Rank r owns rows [bounds[r], bounds[r + 1]) of row-major array with rowSize columns,
+	// after the call every rank has rows of all owners. bounds.size() = getSize() + 1
+	void allgatherRows(double* data, const std::vector<int>& bounds, const int rowSize);
+	void allgatherRows(float* data, const std::vector<int>& bounds, const int rowSize);
+
+	double maxAll(const double val);
+	double sumAll(const double val);
+	void barrier();
+};
+
+#endif /* COMM_HPP_ */
@@ -0,0 +1,289 @@
+#include "src/utils/Config.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+
+static inline bool isBlank(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+static std::string trim(const char* begin, const char* end)
+{
+	while (begin < end && isBlank(*begin))
+		begin++;
+	while (end > begin && isBlank(*(end - 1)))
+		end--;
+	return std::string(begin, end);
+}
+static std::string lower(std::string str)
+{
+	for (auto& c : str)
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+	return str;
+}
+static std::vector<std::string> split(const std::string& str)
+{
+	std::vector<std::string> items;
+	const char* p = str.c_str();
+	const char* end = p + str.size();
+	while (p <= end)
+	{
+		const char* sep = p;
+		while (sep < end && *sep != ',')
+			sep++;
+		items.push_back(trim(p, sep));
+		p = sep + 1;
+	}
+	if (items.size() == 1 && items[0].empty())
+		items.clear();
+	return items;
+}
+
+Config::Config()
+{
+}
+Config::Config(const std::string& _fileName)
+{
+	load(_fileName);
+}
+Config::~Config()
+{
+}
+void Config::load(const std::string& _fileName)
+{
+	fileName = _fileName;
+	sections.clear();
+
+	std::ifstream file(fileName.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!file)
+		throw std::runtime_error("Cannot open scenario file " + fileName);
+	std::ostringstream buf;
+	buf << file.rdbuf();
+	parse(buf.str());
+}
+void Config::parse(const std::string& text)
+{
+	// Keys before the first header go to the unnamed section
+	sections.push_back({ "", 0, {} });
+
+	const char* p = text.c_str();
+	const char* const end = p + text.size();
+	int line = 0;
+	while (p < end)
+	{
+		line++;
+		const char* eol = p;
+		while (eol < end && *eol != '\n')
+			eol++;
+		// Comment starts a line or follows a blank, so values like paths may hold ';' and '#'
+		const char* stop = p;
+		while (stop < eol && !((*stop == ';' || *stop == '#') && (stop == p || isBlank(*(stop - 1)))))
+			stop++;
+		const std::string str = trim(p, stop);
+		p = eol + 1;
+
+		if (str.empty())
+			continue;
+		if (str.front() == '[')
+		{
+			if (str.back() != ']')
+				fail(line, "", "unclosed section header");
+			const std::string name = lower(trim(str.c_str() + 1, str.c_str() + str.size() - 1));
+			if (name.empty())
+				fail(line, "", "empty section name");
+			sections.push_back({ name, line, {} });
+			continue;
+		}
+
+		const size_t eq = str.find('=');
+		if (eq == std::string::npos)
+			fail(line, str, "'key = value' expected");
+		const std::string key = lower(trim(str.c_str(), str.c_str() + eq));
+		if (key.empty())
+			fail(line, "", "empty key");
+		auto& entries = sections.back().entries;
+		if (entries.find(key) != entries.end())
+			fail(line, key, "duplicated key, first defined at line " + std::to_string(entries[key].line));
+		entries[key] = { trim(str.c_str() + eq + 1, str.c_str() + str.size()), line, false };
+	}
+}
+void Config::fail(const int line, const std::string& key, const std::string& msg) const
+{
+	std::string where = fileName;
+	if (line > 0)
+		where += ":" + std::to_string(line);
+	if (!key.empty())
+		where += " '" + key + "'";
+	throw std::runtime_error(where + ": " + msg);
+}
+std::string Config::getDir() const
+{
+	const size_t pos = fileName.find_last_of("/\\");
+	return (pos == std::string::npos ? "" : fileName.substr(0, pos + 1));
+}
+const Config::Section* Config::findSection(const std::string& section) const
+{
+	const size_t pos = section.find('#');
+	const std::string name = section.substr(0, pos);
+	const int idx = (pos == std::string::npos ? 0 : atoi(section.c_str() + pos + 1));
+	int counter = 0;
+	for (const auto& sec : sections)
+		if (sec.name == name && counter++ == idx)
+			return &sec;
+	return NULL;
+}
+const Config::Entry* Config::find(const std::string& section, const std::string& key) const
+{
+	const Section* sec = findSection(section);
+	if (sec == NULL)
+		return NULL;
+	auto it = sec->entries.find(key);
+	if (it == sec->entries.end())
+		return NULL;
+	it->second.used = true;
+	return &it->second;
+}
+const Config::Entry& Config::require(const std::string& section, const std::string& key) const
+{
+	const Entry* entry = find(section, key);
+	if (entry == NULL)
+	{
+		const Section* sec = findSection(section);
+		fail(sec ? sec->line : 0, "", "missing key '" + key + "' in [" + section + "]");
+	}
+	return *entry;
+}
+bool Config::hasSection(const std::string& section) const
+{
+	return findSection(section) != NULL;
+}
+int Config::count(const std::string& section) const
+{
+	int counter = 0;
+	for (const auto& sec : sections)
+		if (sec.name == section)
+			counter++;
+	return counter;
+}
+bool Config::has(const std::string& section, const std::string& key) const
+{
+	const Section* sec = findSection(section);
+	return sec != NULL && sec->entries.find(key) != sec->entries.end();
+}
+
+std::string Config::getString(const std::string& section, const std::string& key) const
+{
+	return require(section, key).value;
+}
+double Config::getDouble(const std::string& section, const std::string& key) const
+{
+	const auto& entry = require(section, key);
+	const char* begin = entry.value.c_str();
+	char* stop;
+	errno = 0;
+	const double val = strtod(begin, &stop);
+	if (stop == begin || *stop != '\0' || errno == ERANGE)
+		fail(entry.line, key, "number expected, got '" + entry.value + "'");
+	return val;
+}
+int Config::getInt(const std::string& section, const std::string& key) const
+{
+	const auto& entry = require(section, key);
+	const char* begin = entry.value.c_str();
+	char* stop;
+	errno = 0;
+	const long val = strtol(begin, &stop, 10);
+	if (stop == begin || *stop != '\0' || errno == ERANGE || val != (int)val)
+		fail(entry.line, key, "integer expected, got '" + entry.value + "'");
+	return (int)val;
+}
+bool Config::getBool(const std::string& section, const std::string& key) const
+{
+	const auto& entry = require(section, key);
+	const std::string val = lower(entry.value);
+	if (val == "true" || val == "yes" || val == "on" || val == "1")
+		return true;
+	if (val == "false" || val == "no" || val == "off" || val == "0")
+		return false;
+	fail(entry.line, key, "boolean expected, got '" + entry.value + "'");
+}
+std::vector<double> Config::getDoubles(const std::string& section, const std::string& key) const
+{
+	const auto& entry = require(section, key);
+	std::vector<double> vals;
+	for (const auto& item : split(entry.value))
+	{
+		char* stop;
+		errno = 0;
+		vals.push_back(strtod(item.c_str(), &stop));
+		if (item.empty() || *stop != '\0' || errno == ERANGE)
+			fail(entry.line, key, "list of numbers expected, got '" + item + "'");
+	}
+	return vals;
+}
+std::vector<std::string> Config::getStrings(const std::string& section, const std::string& key) const
+{
+	return split(require(section, key).value);
+}
+int Config::getChoice(const std::string& section, const std::string& key, const std::vector<std::string>& words) const
+{
+	const auto& entry = require(section, key);
+	const std::string val = lower(entry.value);
+	std::string allowed;
+	for (size_t i = 0; i < words.size(); i++)
+	{
+		if (val == words[i])
+			return (int)i;
+		allowed += (i ? ", " : "") + words[i];
+	}
+	fail(entry.line, key, "'" + entry.value + "' is not one of: " + allowed);
+}
+
+std::string Config::getString(const std::string& section, const std::string& key, const std::string& def) const
+{
+	return (has(section, key) ? getString(section, key) : def);
+}
+double Config::getDouble(const std::string& section, const std::string& key, const double def) const
+{
+	return (has(section, key) ? getDouble(section, key) : def);
+}
+int Config::getInt(const std::string& section, const std::string& key, const int def) const
+{
+	return (has(section, key) ? getInt(section, key) : def);
+}
+bool Config::getBool(const std::string& section, const std::string& key, const bool def) const
+{
+	return (has(section, key) ? getBool(section, key) : def);
+}
+int Config::getChoice(const std::string& section, const std::string& key, const std::vector<std::string>& words, const int def) const
+{
+	return (has(section, key) ? getChoice(section, key, words) : def);
+}
+
+bool Config::ignore(const std::string& section, const std::string& key) const
+{
+	bool isGiven = false;
+	for (const auto& sec : sections)
+		if (sec.name == section)
+			for (const auto& entry : sec.entries)
+				if (key.empty() || entry.first == key)
+				{
+					entry.second.used = true;
+					isGiven = true;
+				}
+	return isGiven;
+}
+void Config::checkUnused() const
+{
+	std::string msg;
+	for (const auto& sec : sections)
+		for (const auto& entry : sec.entries)
+			if (!entry.second.used)
+				msg += "\n\t" + fileName + ":" + std::to_string(entry.second.line) + " [" + sec.name + "] " + entry.first;
+	if (!msg.empty())
+		throw std::runtime_error("Unknown keys in scenario:" + msg);
+}
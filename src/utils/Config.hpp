@@ -0,0 +1,78 @@
+#ifndef CONFIG_HPP_
+#define CONFIG_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+
+// Scenario file in INI format:
+//	[section]
+//	key = value		; comment (also #), only at line start or after a blank
+// Repeated sections (e.g. [well]) are kept in order, the k-th one is addressed as "well#k" (see indexed()).
+// Lists are comma separated. Values are parsed on request, every error names file, line and key;
+// keys which were never requested are reported by checkUnused(), so typos do not pass silently
+class Config
+{
+protected:
+	struct Entry
+	{
+		std::string value;
+		int line;
+		mutable bool used;
+	};
+	struct Section
+	{
+		std::string name;
+		int line;
+		std::map<std::string, Entry> entries;
+	};
+
+	std::string fileName;
+	std::vector<Section> sections;
+
+	void parse(const std::string& text);
+	const Section* findSection(const std::string& section) const;
+	const Entry* find(const std::string& section, const std::string& key) const;
+	const Entry& require(const std::string& section, const std::string& key) const;
+	[[noreturn]] void fail(const int line, const std::string& key, const std::string& msg) const;
+public:
+	Config();
+	Config(const std::string& _fileName);
+	~Config();
+
+	void load(const std::string& _fileName);
+	inline const std::string& getFileName() const { return fileName; };
+	// Directory of the file with trailing separator, relative paths in the file are taken from here
+	std::string getDir() const;
+
+	static inline std::string indexed(const std::string& section, const int idx) { return section + "#" + std::to_string(idx); };
+	bool hasSection(const std::string& section) const;
+	// Number of sections with this name
+	int count(const std::string& section) const;
+	bool has(const std::string& section, const std::string& key) const;
+
+	// Required values
+	std::string getString(const std::string& section, const std::string& key) const;
+	double getDouble(const std::string& section, const std::string& key) const;
+	int getInt(const std::string& section, const std::string& key) const;
+	bool getBool(const std::string& section, const std::string& key) const;
+	std::vector<double> getDoubles(const std::string& section, const std::string& key) const;
+	std::vector<std::string> getStrings(const std::string& section, const std::string& key) const;
+	// One of given words, index of the word is returned
+	int getChoice(const std::string& section, const std::string& key, const std::vector<std::string>& words) const;
+
+	// Optional values
+	std::string getString(const std::string& section, const std::string& key, const std::string& def) const;
+	double getDouble(const std::string& section, const std::string& key, const double def) const;
+	int getInt(const std::string& section, const std::string& key, const int def) const;
+	bool getBool(const std::string& section, const std::string& key, const bool def) const;
+	int getChoice(const std::string& section, const std::string& key, const std::vector<std::string>& words, const int def) const;
+
+	// Marks keys which the issue does not use as requested (all keys of the sections if key is empty),
+	// returns true if any were given
+	bool ignore(const std::string& section, const std::string& key = "") const;
+	// Throws if some keys or sections were never requested
+	void checkUnused() const;
+};
+
+#endif /* CONFIG_HPP_ */
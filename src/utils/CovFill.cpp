@@ -0,0 +1,179 @@
+#include "src/utils/CovFill.hpp"
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace cov
+{
+	static const double LOG2E = 1.4426950408889634074;
+	// ln2 split so that k * LN2_HI is exact for |k| < 2^11
+	static const double LN2_HI = 6.93147180369123816490E-01;
+	static const double LN2_LO = 1.90821492927058770002E-10;
+	// 1.5 * 2^52: adding it rounds to integer kept in low bits of mantissa
+	static const double SHIFTER = 6755399441055744.0;
+
+	static inline double expKernel(double x)
+	{
+		x = (x < -708.0 ? -708.0 : (x > 709.0 ? 709.0 : x));
+		const double t = x * LOG2E + SHIFTER;
+		const double k = t - SHIFTER;
+		const double r = (x - k * LN2_HI) - k * LN2_LO;
+
+		// Taylor series of e^r up to r^13, |r| <= ln2 / 2
+		double p = 1.0 / 6227020800.0;
+		p = p * r + 1.0 / 479001600.0;
+		p = p * r + 1.0 / 39916800.0;
+		p = p * r + 1.0 / 3628800.0;
+		p = p * r + 1.0 / 362880.0;
+		p = p * r + 1.0 / 40320.0;
+		p = p * r + 1.0 / 5040.0;
+		p = p * r + 1.0 / 720.0;
+		p = p * r + 1.0 / 120.0;
+		p = p * r + 1.0 / 24.0;
+		p = p * r + 1.0 / 6.0;
+		p = p * r + 0.5;
+		p = p * r + 1.0;
+		p = p * r + 1.0;
+
+		// Low 12 bits of mantissa of t are k modulo 2^12, biased k goes straight into exponent field
+		uint64_t bits;
+		memcpy(&bits, &t, sizeof(bits));
+		bits = (bits + 1023) << 52;
+		double scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		return p * scale;
+	}
+	double fastExp(double x)
+	{
+		return expKernel(x);
+	}
+
+	static const int TILE = 64;
+
+	// Kernel values for squared distances d2[0..n), written over d2
+	static void evalKernel(const Kernel& kernel, double* d2, const int n)
+	{
+		const double s2 = kernel.sigma * kernel.sigma;
+		const double inv_l = 1.0 / kernel.l, inv_l2 = inv_l * inv_l;
+		const bool isCompact = kernel.isCompact();
+		const double R = (isCompact ? kernel.radius : 1.0), inv_R = 1.0 / R, R2 = R * R;
+
+		switch (kernel.type)
+		{
+		case GAUSS:
+			for (int j = 0; j < n; j++)
+				d2[j] = (isCompact && d2[j] >= R2 ? 0.0 : s2 * expKernel(-d2[j] * inv_l2));
+			break;
+		case EXPONENTIAL:
+			for (int j = 0; j < n; j++)
+				d2[j] = (isCompact && d2[j] >= R2 ? 0.0 : s2 * expKernel(-sqrt(d2[j]) * inv_l));
+			break;
+		case WENDLAND:
+			for (int j = 0; j < n; j++)
+			{
+				const double r = sqrt(d2[j]) * inv_R;
+				const double q = (r < 1.0 ? 1.0 - r : 0.0);
+				d2[j] = s2 * q * q * q * q * (4.0 * r + 1.0);
+			}
+			break;
+		case SPHERICAL:
+			for (int j = 0; j < n; j++)
+			{
+				const double r = sqrt(d2[j]) * inv_R;
+				d2[j] = (r < 1.0 ? s2 * (1.0 - 1.5 * r + 0.5 * r * r * r) : 0.0);
+			}
+			break;
+		case TAPERED_GAUSS:
+			for (int j = 0; j < n; j++)
+			{
+				const double r = sqrt(d2[j]) * inv_R;
+				const double q = (r < 1.0 ? 1.0 - r : 0.0);
+				d2[j] = s2 * expKernel(-d2[j] * inv_l2) * q * q * q * q * (4.0 * r + 1.0);
+			}
+			break;
+		}
+	}
+
+	double fillDense(const Kernel& kernel, const std::vector<point::Point>& cent,
+					std::vector<std::vector<double>>& cov, const int threadsNum)
+	{
+		const int n = (int)cent.size();
+		cov.resize(n);
+		for (auto& row : cov)
+			row.resize(n);
+		if (n == 0)
+			return 0.0;
+
+		// Coordinates as separate arrays
+		std::vector<double> xs(n), ys(n), zs(n);
+		for (int i = 0; i < n; i++)
+		{
+			xs[i] = cent[i].x;	ys[i] = cent[i].y;	zs[i] = cent[i].z;
+		}
+
+		// Tiles (bi, bj) of upper triangle, bi <= bj
+		const int tilesNum = (n + TILE - 1) / TILE;
+		std::vector<std::pair<int, int>> tiles;
+		tiles.reserve(tilesNum * (tilesNum + 1) / 2);
+		for (int bi = 0; bi < tilesNum; bi++)
+			for (int bj = bi; bj < tilesNum; bj++)
+				tiles.push_back(std::make_pair(bi, bj));
+
+		std::atomic<int> next(0);
+		auto work = [&]()
+		{
+			// Tile is kept to be written transposed row by row, its mirror is not filled by column strides
+			std::vector<double> buf(TILE * TILE);
+			for (int t = next++; t < (int)tiles.size(); t = next++)
+			{
+				const int i0 = tiles[t].first * TILE, i1 = std::min(i0 + TILE, n);
+				const int j0 = tiles[t].second * TILE, j1 = std::min(j0 + TILE, n);
+				const int len = j1 - j0;
+				for (int i = i0; i < i1; i++)
+				{
+					double* row = &buf[(i - i0) * TILE];
+					const double xi = xs[i], yi = ys[i], zi = zs[i];
+					const double *px = &xs[j0], *py = &ys[j0], *pz = &zs[j0];
+					for (int j = 0; j < len; j++)
+					{
+						const double dx = px[j] - xi, dy = py[j] - yi, dz = pz[j] - zi;
+						row[j] = dx * dx + dy * dy + dz * dz;
+					}
+					evalKernel(kernel, row, len);
+					std::copy(row, row + len, &cov[i][j0]);
+				}
+				// Diagonal tiles are symmetric already
+				if (i0 == j0)
+					continue;
+				for (int j = j0; j < j1; j++)
+				{
+					double* dst = &cov[j][0];
+					const double* src = &buf[j - j0];
+					for (int i = i0; i < i1; i++)
+						dst[i] = src[(i - i0) * TILE];
+				}
+			}
+		};
+
+		int num = (threadsNum > 0 ? threadsNum : (int)std::max(1u, std::thread::hardware_concurrency()));
+		num = std::max(1, std::min(num, (int)tiles.size()));
+		std::vector<std::thread> threads;
+		threads.reserve(num - 1);
+		for (int t = 1; t < num; t++)
+			threads.emplace_back(work);
+		work();
+		for (auto& thread : threads)
+			thread.join();
+
+		// Check against scalar kernel on evenly spaced sample rows
+		const int stride = std::max(1, n / 16);
+		double max_err = 0.0;
+		for (int i = 0; i < n; i += stride)
+			for (int j = 0; j < n; j++)
+				max_err = std::max(max_err, fabs(cov[i][j] - kernel(point::distance(cent[i], cent[j]))));
+		return max_err;
+	}
+};
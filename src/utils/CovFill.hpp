@@ -0,0 +1,23 @@
+#ifndef COVFILL_HPP_
+#define COVFILL_HPP_
+
+#include <vector>
+#include "src/grid/Point.hpp"
+#include "src/utils/CovKernel.hpp"
+
+namespace cov
+{
+	// exp(x) with calls and branches replaced by arithmetic, so loops over it vectorize.
+	// x = k ln2 + r, e^r by degree 13 Taylor polynomial on |r| <= ln2 / 2, 2^k put into exponent bits.
+	// Arguments are clamped to [-708, 709]
+	double fastExp(double x);
+
+	// Dense symmetric covariance cov[i][j] = kernel(|cent_i - cent_j|), rows are resized.
+	// Upper triangle is split into square tiles taken by threadsNum threads (0 - hardware concurrency),
+	// off-diagonal tiles are written to their mirrors as well. Distances run over coordinate arrays, kernel type is
+	// resolved outside of inner loops. Returns max abs deviation from scalar kernel on sampled rows
+	double fillDense(const Kernel& kernel, const std::vector<point::Point>& cent,
+					std::vector<std::vector<double>>& cov, const int threadsNum = 0);
+};
+
+#endif /* COVFILL_HPP_ */
@@ -0,0 +1,76 @@
+#ifndef COVKERNEL_HPP_
+#define COVKERNEL_HPP_
+
+#include <cmath>
+#include <cfloat>
+
+namespace cov
+{
+	// GAUSS & EXPONENTIAL are globally supported unless radius > 0 (hard cutoff),
+	// the others vanish identically beyond radius
+	enum KernelType { GAUSS, EXPONENTIAL, WENDLAND, SPHERICAL, TAPERED_GAUSS };
+
+	struct Kernel
+	{
+		KernelType type;
+		double sigma, l;
+		double radius;
+
+		Kernel() : type(GAUSS), sigma(0.0), l(1.0), radius(0.0) {};
+		Kernel(const KernelType _type, const double _sigma, const double _l, const double _radius) :
+			type(_type), sigma(_sigma), l(_l), radius(_radius)
+		{
+			// Compactly supported kernels default to the range where gaussian falls below 1.E-4
+			if (radius <= 0.0 && type != GAUSS && type != EXPONENTIAL)
+				radius = 3.0 * l;
+		};
+
+		inline bool isCompact() const { return radius > 0.0; };
+		inline double getSupport() const { return (isCompact() ? radius : DBL_MAX); };
+		// Reference (untruncated) gaussian kernel
+		inline double gauss(const double dist) const
+		{
+			const double r = dist / l;
+			return sigma * sigma * exp(-r * r);
+		};
+		// Kernel without its cutoff: GAUSS & EXPONENTIAL ignore radius, TAPERED_GAUSS drops the taper,
+		// WENDLAND & SPHERICAL have no other form
+		inline double untruncated(const double dist) const
+		{
+			switch (type)
+			{
+			case GAUSS:
+			case TAPERED_GAUSS:
+				return gauss(dist);
+			case EXPONENTIAL:
+				return sigma * sigma * exp(-dist / l);
+			default:
+				return (*this)(dist);
+			}
+		};
+		inline double operator()(const double dist) const
+		{
+			if (isCompact() && dist >= radius)
+				return 0.0;
+
+			const double r = dist / radius;
+			switch (type)
+			{
+			case GAUSS:
+				return gauss(dist);
+			case EXPONENTIAL:
+				return sigma * sigma * exp(-dist / l);
+			case WENDLAND:
+				// Wendland C2, positive definite in 3D
+				return sigma * sigma * (1.0 - r) * (1.0 - r) * (1.0 - r) * (1.0 - r) * (4.0 * r + 1.0);
+			case SPHERICAL:
+				return sigma * sigma * (1.0 - 1.5 * r + 0.5 * r * r * r);
+			case TAPERED_GAUSS:
+				return gauss(dist) * (1.0 - r) * (1.0 - r) * (1.0 - r) * (1.0 - r) * (4.0 * r + 1.0);
+			}
+			return 0.0;
+		};
+	};
+};
+
+#endif /* COVKERNEL_HPP_ */
@@ -0,0 +1,385 @@
+#include "src/utils/EclipseReader.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& _fileName) : fileName(_fileName), data(NULL), size(0), hFile(NULL), hMap(NULL)
+{
+	hFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		hFile = NULL;
+		throw std::runtime_error("Cannot open " + fileName);
+	}
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(hFile, &fileSize);
+	size = (size_t)fileSize.QuadPart;
+	if (size == 0)
+		return;
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap != NULL)
+		data = static_cast<const char*>(MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0));
+	if (data == NULL)
+	{
+		if (hMap != NULL)
+			CloseHandle(hMap);
+		CloseHandle(hFile);
+		throw std::runtime_error("Cannot map " + fileName);
+	}
+}
+MappedFile::~MappedFile()
+{
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (hMap != NULL)
+		CloseHandle(hMap);
+	if (hFile != NULL)
+		CloseHandle(hFile);
+}
+#else
+MappedFile::MappedFile(const std::string& _fileName) : fileName(_fileName), data(NULL), size(0), fd(-1)
+{
+	fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open " + fileName);
+	struct stat st;
+	fstat(fd, &st);
+	size = (size_t)st.st_size;
+	if (size == 0)
+		return;
+	void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED)
+	{
+		close(fd);
+		throw std::runtime_error("Cannot map " + fileName);
+	}
+	madvise(ptr, size, MADV_SEQUENTIAL);
+	data = static_cast<const char*>(ptr);
+}
+MappedFile::~MappedFile()
+{
+	if (data != NULL)
+		munmap((void*)data, size);
+	if (fd >= 0)
+		close(fd);
+}
+#endif
+int MappedFile::getLine(const char* pos) const
+{
+	return 1 + (int)std::count(begin(), std::min(pos, end()), '\n');
+}
+
+namespace eclipse
+{
+	static inline bool isSpace(const char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+	static inline bool isDigit(const char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+	// Skips blanks and '--' comments
+	static inline const char* skip(const char* p, const char* end)
+	{
+		while (p < end)
+		{
+			if (isSpace(*p))
+				p++;
+			else if (*p == '-' && p + 1 < end && p[1] == '-')
+			{
+				p = static_cast<const char*>(memchr(p, '\n', end - p));
+				if (p == NULL)
+					return end;
+			}
+			else
+				break;
+		}
+		return p;
+	}
+	static inline const char* tokenEnd(const char* p, const char* end)
+	{
+		while (p < end && !isSpace(*p))
+			p++;
+		return p;
+	}
+	// Repeat count N of 'N*value' given by [p, star), -1 if it is malformed
+	static inline int parseRepeat(const char* p, const char* star)
+	{
+		long num = 0;
+		for (const char* c = p; c < star; c++)
+		{
+			if (!isDigit(*c) || num > 100000000)
+				return -1;
+			num = num * 10 + (*c - '0');
+		}
+		return (star == p || num == 0 ? -1 : (int)num);
+	}
+
+	static const double pow10[] = { 1.E+0, 1.E+1, 1.E+2, 1.E+3, 1.E+4, 1.E+5, 1.E+6, 1.E+7, 1.E+8, 1.E+9, 1.E+10, 1.E+11,
+									1.E+12, 1.E+13, 1.E+14, 1.E+15, 1.E+16, 1.E+17, 1.E+18, 1.E+19, 1.E+20, 1.E+21, 1.E+22 };
+
+	const char* parseDouble(const char* p, const char* end, double& val)
+	{
+		const char* const start = p;
+		bool neg = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			neg = (*p++ == '-');
+
+		uint64_t mant = 0;
+		int digits = 0, exp10 = 0;
+		bool any = false;
+		for (; p < end && isDigit(*p); p++)
+		{
+			any = true;
+			if (digits < 19)
+			{
+				mant = mant * 10 + (*p - '0');
+				digits += (mant != 0);
+			}
+			else
+				exp10++;
+		}
+		if (p < end && *p == '.')
+			for (p++; p < end && isDigit(*p); p++)
+			{
+				any = true;
+				if (digits < 19)
+				{
+					mant = mant * 10 + (*p - '0');
+					digits += (mant != 0);
+					exp10--;
+				}
+			}
+		if (!any)
+			return start;
+		// Fortran 'D' exponent is accepted as well
+		if (p < end && (*p == 'e' || *p == 'E' || *p == 'd' || *p == 'D'))
+		{
+			const char* q = p + 1;
+			bool exp_neg = false;
+			if (q < end && (*q == '-' || *q == '+'))
+				exp_neg = (*q++ == '-');
+			if (q < end && isDigit(*q))
+			{
+				int e = 0;
+				for (; q < end && isDigit(*q); q++)
+					if (e < 100000)
+						e = e * 10 + (*q - '0');
+				exp10 += (exp_neg ? -e : e);
+				p = q;
+			}
+		}
+
+		if (digits <= 15 && exp10 >= -22 && exp10 <= 22)
+			val = (exp10 < 0 ? (double)mant / pow10[-exp10] : (double)mant * pow10[exp10]);
+		else
+		{
+			char buf[128];
+			const size_t len = std::min((size_t)(p - start), sizeof(buf) - 1);
+			memcpy(buf, start, len);
+			buf[len] = '\0';
+			for (size_t i = 0; i < len; i++)
+				if (buf[i] == 'd' || buf[i] == 'D')
+					buf[i] = 'e';
+			val = strtod(buf, NULL);
+			return p;
+		}
+		if (neg)
+			val = -val;
+		return p;
+	}
+
+	// Position right after keyword standing first on its line, NULL if there is no such
+	static const char* findKeyword(const char* p, const char* end, const std::string& keyword)
+	{
+		const size_t len = keyword.size();
+		while (p < end)
+		{
+			while (p < end && (*p == ' ' || *p == '\t'))
+				p++;
+			if ((size_t)(end - p) >= len && memcmp(p, keyword.c_str(), len) == 0 && (p + len == end || isSpace(p[len])))
+				return p + len;
+			p = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (p == NULL)
+				return NULL;
+			p++;
+		}
+		return NULL;
+	}
+	// Closing '/' out of comments, NULL if there is none
+	static const char* findTerminator(const char* p, const char* end)
+	{
+		const char* line = p;
+		while (p < end)
+		{
+			const char* slash = static_cast<const char*>(memchr(p, '/', end - p));
+			if (slash == NULL)
+				return NULL;
+			// Comment on the line of the slash hides it
+			for (const char* nl; (nl = static_cast<const char*>(memchr(line, '\n', slash - line))) != NULL; )
+				line = nl + 1;
+			const char* c = line;
+			while (c + 1 < slash && !(c[0] == '-' && c[1] == '-'))
+				c++;
+			if (c + 1 >= slash)
+				return slash;
+			p = slash + 1;
+		}
+		return NULL;
+	}
+
+	// Chunk of whole lines with the first error met in it
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		size_t count;
+		const char* error;
+	};
+	template <class Func>
+	static void runChunks(std::vector<Chunk>& chunks, const Func& f)
+	{
+		std::vector<std::thread> threads;
+		threads.reserve(chunks.size() - 1);
+		for (size_t t = 1; t < chunks.size(); t++)
+			threads.emplace_back([&f, &chunks, t]() { f(chunks[t]); });
+		f(chunks[0]);
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	void readKeyword(const MappedFile& file, const std::string& keyword, std::vector<double>& vals,
+					const size_t expected, const int threadsNum)
+	{
+		const char* begin = findKeyword(file.begin(), file.end(), keyword);
+		if (begin == NULL)
+			throw std::runtime_error(file.getFileName() + ": keyword " + keyword + " is not found");
+		const char* end = findTerminator(begin, file.end());
+		if (end == NULL)
+			throw std::runtime_error(file.getFileName() + ":" + std::to_string(file.getLine(begin)) + ": " + keyword + " is not closed by '/'");
+
+		// Small sections are not worth threads
+		const size_t minChunk = 1 << 20;
+		const size_t bytes = end - begin;
+		size_t chunksNum = (threadsNum > 0 ? threadsNum : std::max(1u, std::thread::hardware_concurrency()));
+		chunksNum = std::max((size_t)1, std::min(chunksNum, bytes / minChunk));
+		std::vector<Chunk> chunks(chunksNum);
+		const char* p = begin;
+		for (size_t t = 0; t < chunksNum; t++)
+		{
+			chunks[t].begin = p;
+			if (t + 1 < chunksNum)
+			{
+				const char* from = std::max(p, begin + bytes * (t + 1) / chunksNum);
+				const char* nl = static_cast<const char*>(memchr(from, '\n', end - from));
+				p = (nl == NULL ? end : nl + 1);
+			}
+			else
+				p = end;
+			chunks[t].end = p;
+			chunks[t].count = 0;
+			chunks[t].error = NULL;
+		}
+
+		auto check = [&]()
+		{
+			for (const auto& chunk : chunks)
+				if (chunk.error != NULL)
+					throw std::runtime_error(file.getFileName() + ":" + std::to_string(file.getLine(chunk.error)) +
+											": bad value '" + std::string(chunk.error, tokenEnd(chunk.error, end)) + "' in " + keyword);
+		};
+
+		// Counting: only repeats are decoded
+		runChunks(chunks, [](Chunk& chunk)
+		{
+			for (const char* p = skip(chunk.begin, chunk.end); p < chunk.end; p = skip(p, chunk.end))
+			{
+				const char* star = NULL;
+				const char* tok = p;
+				for (; tok < chunk.end && !isSpace(*tok); tok++)
+					if (*tok == '*')
+						star = tok;
+				if (star == NULL)
+					chunk.count++;
+				else
+				{
+					const int repeat = parseRepeat(p, star);
+					if (repeat < 0)
+					{
+						chunk.error = p;
+						return;
+					}
+					chunk.count += repeat;
+				}
+				p = tok;
+			}
+		});
+		check();
+
+		size_t total = 0;
+		std::vector<size_t> offsets(chunksNum);
+		for (size_t t = 0; t < chunksNum; t++)
+		{
+			offsets[t] = total;
+			total += chunks[t].count;
+		}
+		if (expected > 0 && total != expected)
+			throw std::runtime_error(file.getFileName() + ": " + keyword + " has " + std::to_string(total) +
+									" values, " + std::to_string(expected) + " expected");
+		vals.resize(total);
+
+		// Parsing straight into place
+		double* const dst = vals.data();
+		runChunks(chunks, [dst, &chunks, &offsets](Chunk& chunk)
+		{
+			double* out = dst + offsets[&chunk - &chunks[0]];
+			for (const char* p = skip(chunk.begin, chunk.end); p < chunk.end; p = skip(p, chunk.end))
+			{
+				double val;
+				const char* q = parseDouble(p, chunk.end, val);
+				int repeat = 1;
+				if (q < chunk.end && *q == '*')
+				{
+					// Count was validated while counting
+					repeat = parseRepeat(p, q);
+					const char* value = q + 1;
+					q = parseDouble(value, chunk.end, val);
+					if (q == value)
+						q = p;
+				}
+				if (q == p || (q < chunk.end && !isSpace(*q)))
+				{
+					chunk.error = p;
+					return;
+				}
+				if (repeat == 1)
+					*out++ = val;
+				else
+					out = std::fill_n(out, repeat, val);
+				p = q;
+			}
+		});
+		check();
+	}
+	void readKeyword(const std::string& fileName, const std::string& keyword, std::vector<double>& vals,
+					const size_t expected, const int threadsNum)
+	{
+		MappedFile file(fileName);
+		readKeyword(file, keyword, vals, expected, threadsNum);
+	}
+};
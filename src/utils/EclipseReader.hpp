@@ -0,0 +1,55 @@
+#ifndef ECLIPSEREADER_HPP_
+#define ECLIPSEREADER_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only memory mapped file, the text is not null-terminated
+class MappedFile
+{
+protected:
+	std::string fileName;
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	void* hFile;
+	void* hMap;
+#else
+	int fd;
+#endif
+public:
+	MappedFile(const std::string& _fileName);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	inline const std::string& getFileName() const { return fileName; };
+	inline const char* begin() const { return data; };
+	inline const char* end() const { return data + size; };
+	// Line number of position for error messages
+	int getLine(const char* pos) const;
+};
+
+// Input of Eclipse-style property grids
+//	PERMX
+//	-- comment
+//	100.0 3*250.5 12.0
+//	/
+namespace eclipse
+{
+	// Locale independent number parsing: returns position after the number, 'p' itself if there is none.
+	// Exact fast path for up to 15 significant digits and |exponent| <= 22, strtod otherwise
+	const char* parseDouble(const char* p, const char* end, double& val);
+
+	// Values of the keyword up to the closing '/', 'N*value' repeats are expanded.
+	// Large sections are parsed by threadsNum threads (0 - hardware concurrency) in chunks of whole lines:
+	// values are counted first, then every chunk parses straight into its place in 'vals'.
+	// expected = 0 takes any number of values
+	void readKeyword(const MappedFile& file, const std::string& keyword, std::vector<double>& vals,
+					const size_t expected = 0, const int threadsNum = 0);
+	void readKeyword(const std::string& fileName, const std::string& keyword, std::vector<double>& vals,
+					const size_t expected = 0, const int threadsNum = 0);
+};
+
+#endif /* ECLIPSEREADER_HPP_ */
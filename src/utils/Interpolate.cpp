@@ -1,164 +1,192 @@
 #include "src/utils/Interpolate.h"
-#include <iostream>
 
-Interpolate::Interpolate()
+#include <algorithm>
+#include <stdexcept>
+
+Interpolate::Interpolate() : method(LINEAR), isUniform(false), inv_h(0.0)
 {
 }
-
+Interpolate::Interpolate(const double* ptx, const double* pty, const size_t N, const Method _method) :
+	x(ptx, ptx + N), y(pty, pty + N), method(_method)
+{
+	build();
+}
+Interpolate::Interpolate(std::vector<double> _x, std::vector<double> _y, const Method _method) : method(_method)
+{
+	x.swap(_x);
+	y.swap(_y);
+	build();
+}
 Interpolate::~Interpolate()
 {
 }
-
-Interpolate::Interpolate(double *ptx, double *pty, size_t _N)
+void Interpolate::build()
 {
-	Nf = 1000000;
-	Flag = new int[Nf+1];
-	N  = _N;
-	x = new double[N];
-	y = new double[N];
-
-	for (int i= 0; i < N; i++){
-		x[i] = ptx[i];
-		y[i] = pty[i];
+	const size_t N = x.size();
+	if (N < 2 || y.size() != N)
+		throw std::runtime_error("Interpolate: table needs at least 2 nodes and equal sizes of x and y");
+	for (size_t i = 0; i + 1 < N; i++)
+		if (!(x[i] < x[i + 1]))
+			throw std::runtime_error("Interpolate: nodes have to increase");
+
+	const double h = (x[N - 1] - x[0]) / (double)(N - 1);
+	isUniform = true;
+	for (size_t i = 1; i + 1 < N && isUniform; i++)
+		isUniform = (fabs(x[i] - (x[0] + (double)i * h)) <= 1.E-10 * h);
+	inv_h = 1.0 / h;
+
+	if (!isUniform)
+	{
+		eytz.resize(N + 1);
+		eytz_idx.resize(N + 1);
+		size_t src = 0;
+		buildEytzinger(src, 1);
 	}
-	
-	xmin = x[0];
-	xmax = x[N-1];
-	int j;
-	temp = (xmax - xmin)/Nf;
-	
-	for (int i = 0; i < N-1; i++)
-		for (j = (int)floor((x[i] - xmin)/temp); j <= (int)floor((x[i+1] - xmin)/temp); j++)
-			Flag[j] = i;
-	
-	IsSetDiff = false;
 
-}
+	slope.resize(N - 1);
+	for (size_t i = 0; i + 1 < N; i++)
+		slope[i] = (y[i + 1] - y[i]) / (x[i + 1] - x[i]);
 
-Interpolate::Interpolate(double *ptx, double *pty, double *dpty, size_t N)
+	// Harmonic mean of neighbouring secants (Fritsch-Butland), zero slope at extrema keeps monotonicity
+	if (method == MONOTONE_CUBIC)
+	{
+		m.resize(N);
+		const auto& d = slope;
+		m[0] = d[0];
+		m[N - 1] = d[N - 2];
+		for (size_t i = 1; i + 1 < N; i++)
+		{
+			if (d[i - 1] * d[i] <= 0.0)
+				m[i] = 0.0;
+			else
+			{
+				const double h0 = x[i] - x[i - 1], h1 = x[i + 1] - x[i];
+				const double w1 = 2.0 * h1 + h0, w2 = h1 + 2.0 * h0;
+				m[i] = (w1 + w2) / (w1 / d[i - 1] + w2 / d[i]);
+			}
+		}
+	}
+}
+void Interpolate::buildEytzinger(size_t& src, const size_t k)
 {
-	Nf = 10000;
-	Flag = new int[Nf+1];
-	x = new double[N];
-	y = new double[N];
-	dy = new double[N];
-	for (int i= 0; i < N; i++){
-		x[i] = ptx[i];
-		y[i] = pty[i];
-		dy[i] = dpty[i];
+	// In-order walk of implicit tree puts sorted nodes into breadth-first order
+	if (k < eytz.size())
+	{
+		buildEytzinger(src, 2 * k);
+		eytz[k] = x[src];
+		eytz_idx[k] = (int)src++;
+		buildEytzinger(src, 2 * k + 1);
 	}
-	xmin = x[0];
-	xmax = x[N-1];
-	temp = (xmax - xmin)/Nf;
-	for (int i = 0; i < N-1; i++){
-		for (int j = (int)floor((x[i] - xmin)/temp); j <= (int)floor((x[i+1] - xmin)/temp); j++)
-		Flag[j] = i;
+}
+size_t Interpolate::findInterval(const double arg) const
+{
+	const size_t last = x.size() - 2;
+	if (isUniform)
+	{
+		const size_t i = (size_t)((arg - x[0]) * inv_h);
+		return (i > last ? last : i);
 	}
-	IsSetDiff = true;
 
+	// First node greater than arg, descent has no unpredictable branches
+	const size_t n = x.size();
+	size_t k = 1;
+	while (k <= n)
+		k = 2 * k + (eytz[k] <= arg);
+	while (k & 1)
+		k >>= 1;
+	k >>= 1;
+	const size_t upper = (k == 0 ? n : (size_t)eytz_idx[k]);
+	return (upper == 0 ? 0 : std::min(upper - 1, last));
 }
-
-Interpolate::Interpolate(double *ptx, double *pty, double *dpty, double *d2pty, size_t N)
+void Interpolate::evaluate(const size_t i, const double arg, double& val, double& dval, double& d2val) const
 {
-	Nf = 10000;
-	Flag = new int[Nf+1];
-	x = new double[N];
-	y = new double[N];
-	dy = new double[N];
-	d2y = new double[N];
-
-	for (int i= 0; i < N; i++){
-		x[i] = ptx[i];
-		y[i] = pty[i];
-		dy[i] = dpty[i];
-		d2y[i]  = d2pty[i];
-	}
-	xmin = x[0];
-	xmax = x[N-1];
-	temp = (xmax - xmin)/Nf;
-	for (int i = 0; i < N-1; i++){
-		for (int j = (int)floor((x[i] - xmin)/temp); j <= (int)floor((x[i+1] - xmin)/temp); j++)
-		Flag[j] = i;
+	if (method == LINEAR)
+	{
+		dval = slope[i];
+		val = y[i] + dval * (arg - x[i]);
+		d2val = 0.0;
+		return;
 	}
-	IsSetDiff = true;
-	IsSetDiff2 = true;
+	const double h = x[i + 1] - x[i];
+	const double t = (arg - x[i]) / h;
+	// Hermite cubic in powers of t
+	const double a1 = h * m[i];
+	const double a2 = 3.0 * (y[i + 1] - y[i]) - h * (2.0 * m[i] + m[i + 1]);
+	const double a3 = 2.0 * (y[i] - y[i + 1]) + h * (m[i] + m[i + 1]);
+	val = y[i] + t * (a1 + t * (a2 + t * a3));
+	dval = (a1 + t * (2.0 * a2 + 3.0 * t * a3)) / h;
+	d2val = (2.0 * a2 + 6.0 * t * a3) / h / h;
 }
 
-double Interpolate::Solve(double arg)
+double Interpolate::Solve(double arg) const
 {
-	if (arg < xmin ) 
-		arg = xmin;
-	else if(arg > xmax) 
-		arg = xmax;
-
-	int index = (int)floor( (arg - xmin) / temp );
-	double dx = x[Flag[index]+1] - x[Flag[index]];
-	double dy = y[Flag[index]+1] - y[Flag[index]];
-	
-	return (arg - x[Flag[index]])/dx*dy + y[Flag[index]];
+	arg = std::min(std::max(arg, x.front()), x.back());
+	double val, dval, d2val;
+	evaluate(findInterval(arg), arg, val, dval, d2val);
+	return val;
 }
-
-adouble Interpolate::Solve(adouble arg)
+adouble Interpolate::Solve(adouble arg) const
 {
-	double tmp = arg.value();
-	if (tmp < xmin)
-		tmp = xmin;
-	else if (tmp > xmax)
-		tmp = xmax;
-		
-	int i = Flag[int((tmp - xmin) / temp)];
-	return (adouble)(DSolve(tmp)) * (arg - (adouble)(x[i])) + (adouble)y[i];
+	const double tmp = arg.value();
+	if (tmp <= x.front())
+		return (adouble)y.front();
+	else if (tmp >= x.back())
+		return (adouble)y.back();
+
+	const size_t i = findInterval(tmp);
+	if (method == LINEAR)
+		return (adouble)y[i] + slope[i] * (arg - x[i]);
+
+	const double h = x[i + 1] - x[i];
+	const double a1 = h * m[i];
+	const double a2 = 3.0 * (y[i + 1] - y[i]) - h * (2.0 * m[i] + m[i + 1]);
+	const double a3 = 2.0 * (y[i] - y[i + 1]) + h * (m[i] + m[i + 1]);
+	adouble t = (arg - x[i]) / h;
+	return y[i] + t * (a1 + t * (a2 + t * a3));
 }
-
-double Interpolate::DSolve(double arg)
+double Interpolate::DSolve(double arg) const
 {
-	double result;
-	double dx;
-	double dcy;
-	
-	if(arg < xmin)
-		return 0;
-	else if(arg > xmax)
-		return 0;
-
-	int i = (int)floor((arg - xmin)/temp);
-	int index = Flag[i];
-	
-	if (IsSetDiff)
-	{
-		 dx = x[index+1] - x[index];
-		 dcy = dy[index+1] - dy[index];
-		 result = (arg - x[index])/dx*dcy + dy[index];
-	} else {
-		dx = (x[index] - x[index + 1]);
-		dcy = (y[index] - y[index + 1]);
-		result = dcy/dx;
-	}
-
-	return result;
+	if (arg < x.front() || arg > x.back())
+		return 0.0;
+	double val, dval, d2val;
+	evaluate(findInterval(arg), arg, val, dval, d2val);
+	return dval;
 }
-
-double Interpolate::D2Solve(double arg)
+double Interpolate::D2Solve(double arg) const
+{
+	if (arg < x.front() || arg > x.back())
+		return 0.0;
+	double val, dval, d2val;
+	evaluate(findInterval(arg), arg, val, dval, d2val);
+	return d2val;
+}
+void Interpolate::Solve(const double* args, double* res, double* dres, const size_t n) const
 {
-	double result;
-	double dx;
-	double dcy;
-	
-	int i = (int)floor((arg - xmin)/temp);
-	if (i > Nf)
-		i = (int)Nf;
-	if (i < 0)
-		i = 0;
-    int index = Flag[i];
-	
-	if (IsSetDiff2)
+	const double xmin = x.front(), xmax = x.back();
+	// Evenly spaced linear table: index arithmetic only, the loop has no calls
+	if (isUniform && method == LINEAR)
 	{
-		 dx = x[index+1] - x[index];
-		 dcy = d2y[index+1] - d2y[index];
-		 result = (arg - x[index])/dx*dcy + d2y[index];
-	} else 
-		result = 0;
-	
-	return result;
+		const size_t last = x.size() - 2;
+		const double *px = x.data(), *py = y.data(), *ps = slope.data();
+		for (size_t j = 0; j < n; j++)
+		{
+			const double arg = std::min(std::max(args[j], xmin), xmax);
+			size_t i = (size_t)((arg - xmin) * inv_h);
+			i = (i > last ? last : i);
+			res[j] = py[i] + ps[i] * (arg - px[i]);
+			if (dres != NULL)
+				dres[j] = (args[j] < xmin || args[j] > xmax ? 0.0 : ps[i]);
+		}
+		return;
+	}
 
-}
\ No newline at end of file
+	double val, dval, d2val;
+	for (size_t j = 0; j < n; j++)
+	{
+		const double arg = std::min(std::max(args[j], xmin), xmax);
+		evaluate(findInterval(arg), arg, val, dval, d2val);
+		res[j] = val;
+		if (dres != NULL)
+			dres[j] = (args[j] < xmin || args[j] > xmax ? 0.0 : dval);
+	}
+}
@@ -2,32 +2,52 @@
 #define INTERPOLATE_H_
 
 #include <math.h>
+#include <cstddef>
+#include <vector>
 #include "adolc/adouble.h"
 
+// Interpolation of a table y(x) given at increasing nodes.
+// Interval is found directly for evenly spaced nodes and by branch-free search over
+// Eytzinger (breadth-first) layout of nodes otherwise. Out of [xmin, xmax] the end values are kept,
+// derivatives are zero there. Derivatives are the analytic ones of the interpolant
 class Interpolate
 {
-	public:
+public:
+	enum Method { LINEAR, MONOTONE_CUBIC };
+protected:
+	std::vector<double> x, y;
+	// Secants of intervals
+	std::vector<double> slope;
+	// Slopes at nodes of monotone cubic
+	std::vector<double> m;
+	// Nodes in Eytzinger order (1-based) and their original indices
+	std::vector<double> eytz;
+	std::vector<int> eytz_idx;
+	Method method;
+	bool isUniform;
+	double inv_h;
+
+	void build();
+	void buildEytzinger(size_t& src, const size_t k);
+	size_t findInterval(const double arg) const;
+	// Value, first and second derivatives on interval i at clamped argument
+	void evaluate(const size_t i, const double arg, double& val, double& dval, double& d2val) const;
+public:
 	Interpolate();
-	Interpolate(double *ptx, double *pty, size_t N);
-	Interpolate(double *ptx, double *pty, double *dpty, size_t N);
-	Interpolate(double *ptx, double *pty, double *dpty,double *d2pty, size_t N);
+	Interpolate(const double* ptx, const double* pty, const size_t N, const Method _method = LINEAR);
+	Interpolate(std::vector<double> _x, std::vector<double> _y, const Method _method = LINEAR);
 	~Interpolate();
-	
-	double Solve(double arg);
-	adouble Solve(adouble arg);
-	double DSolve(double arg);
-	double D2Solve(double arg);
-	
-	double *x;
-	double *y;
-	double *dy;
-	double *d2y;
-	int *Flag;
-	size_t N;
-	size_t Nf;
-	double xmin, xmax, temp;
-	bool IsSetDiff;
-	bool IsSetDiff2;
+
+	double Solve(double arg) const;
+	adouble Solve(adouble arg) const;
+	double DSolve(double arg) const;
+	double D2Solve(double arg) const;
+	// Batch evaluation over arrays, dres may be NULL
+	void Solve(const double* args, double* res, double* dres, const size_t n) const;
+
+	inline size_t size() const { return x.size(); };
+	inline double getMin() const { return x.front(); };
+	inline double getMax() const { return x.back(); };
 };
 
-#endif /* INTERPOLATE_H_ */
\ No newline at end of file
+#endif /* INTERPOLATE_H_ */
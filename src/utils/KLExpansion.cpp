@@ -0,0 +1,214 @@
+#include "src/utils/KLExpansion.hpp"
+
+#include <cmath>
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+KLExpansion::KLExpansion()
+{
+	n = modesNum = 0;
+	trace = captured = 0.0;
+}
+KLExpansion::~KLExpansion()
+{
+}
+void KLExpansion::clear()
+{
+	modesNum = 0;
+	captured = 0.0;
+	lambda.clear();
+	modes.clear();
+}
+size_t KLExpansion::orthonormalize(std::vector<double>& Q, const size_t cols) const
+{
+	size_t rank = 0;
+	for (size_t j = 0; j < cols; j++)
+	{
+		double* q = &Q[j * n];
+		double norm0 = 0.0;
+		for (size_t i = 0; i < n; i++)
+			norm0 += q[i] * q[i];
+		norm0 = sqrt(norm0);
+		if (norm0 == 0.0)
+			continue;
+
+		// Modified Gram-Schmidt, repeated once to restore orthogonality lost in cancellation
+		for (int pass = 0; pass < 2; pass++)
+			for (size_t k = 0; k < rank; k++)
+			{
+				const double* qk = &Q[k * n];
+				double s = 0.0;
+				for (size_t i = 0; i < n; i++)
+					s += qk[i] * q[i];
+				for (size_t i = 0; i < n; i++)
+					q[i] -= s * qk[i];
+			}
+
+		double norm = 0.0;
+		for (size_t i = 0; i < n; i++)
+			norm += q[i] * q[i];
+		norm = sqrt(norm);
+		if (norm < 1.E-10 * norm0)
+			continue;
+
+		double* dst = &Q[rank * n];
+		for (size_t i = 0; i < n; i++)
+			dst[i] = q[i] / norm;
+		rank++;
+	}
+	return rank;
+}
+void KLExpansion::jacobiEigen(std::vector<double>& A, const size_t m, std::vector<double>& eig, std::vector<double>& vec)
+{
+	std::vector<double> V(m * m, 0.0);
+	for (size_t i = 0; i < m; i++)
+		V[i * m + i] = 1.0;
+
+	double total = 0.0;
+	for (const auto& val : A)
+		total += val * val;
+
+	for (int sweep = 0; sweep < 100; sweep++)
+	{
+		double off = 0.0;
+		for (size_t p = 0; p < m; p++)
+			for (size_t q = p + 1; q < m; q++)
+				off += A[p * m + q] * A[p * m + q];
+		if (off <= 1.E-24 * total)
+			break;
+
+		for (size_t p = 0; p < m; p++)
+			for (size_t q = p + 1; q < m; q++)
+			{
+				const double apq = A[p * m + q];
+				if (fabs(apq) <= 1.E-300)
+					continue;
+
+				const double theta = (A[q * m + q] - A[p * m + p]) / (2.0 * apq);
+				const double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				const double c = 1.0 / sqrt(t * t + 1.0);
+				const double s = t * c;
+
+				for (size_t k = 0; k < m; k++)
+				{
+					const double akp = A[k * m + p], akq = A[k * m + q];
+					A[k * m + p] = c * akp - s * akq;
+					A[k * m + q] = s * akp + c * akq;
+				}
+				for (size_t k = 0; k < m; k++)
+				{
+					const double apk = A[p * m + k], aqk = A[q * m + k];
+					A[p * m + k] = c * apk - s * aqk;
+					A[q * m + k] = s * apk + c * aqk;
+				}
+				for (size_t k = 0; k < m; k++)
+				{
+					const double vkp = V[k * m + p], vkq = V[k * m + q];
+					V[k * m + p] = c * vkp - s * vkq;
+					V[k * m + q] = s * vkp + c * vkq;
+				}
+			}
+	}
+
+	std::vector<size_t> order(m);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](const size_t i, const size_t j) { return A[i * m + i] > A[j * m + j]; });
+
+	eig.resize(m);
+	vec.resize(m * m);
+	for (size_t j = 0; j < m; j++)
+	{
+		eig[j] = A[order[j] * m + order[j]];
+		for (size_t i = 0; i < m; i++)
+			vec[j * m + i] = V[i * m + order[j]];
+	}
+}
+void KLExpansion::build(const size_t _n, const MatVec& matvec, const double _trace, const double energy,
+						const size_t max_modes, const int power_iters)
+{
+	clear();
+	n = _n;
+	trace = _trace;
+	if (energy <= 0.0 || n == 0 || trace <= 0.0)
+		return;
+
+	const size_t oversampling = 10;
+	const size_t cap = (max_modes > 0 ? std::min(max_modes, n) : n);
+	size_t l = std::min(n, std::min(cap, size_t(32)) + oversampling);
+
+	std::mt19937 gen(20170101);
+	std::normal_distribution<double> normal(0.0, 1.0);
+	std::vector<double> Q, CQ, B, eig, vec;
+	size_t cols, kept;
+
+	auto apply = [&](const size_t num)
+	{
+		CQ.resize(num * n);
+		for (size_t j = 0; j < num; j++)
+			matvec(&Q[j * n], &CQ[j * n]);
+	};
+
+	while (true)
+	{
+		// Randomized range finder with power iterations
+		Q.resize(l * n);
+		for (auto& val : Q)
+			val = normal(gen);
+
+		apply(l);
+		Q.swap(CQ);
+		cols = orthonormalize(Q, l);
+		for (int it = 0; it < power_iters; it++)
+		{
+			apply(cols);
+			Q.swap(CQ);
+			cols = orthonormalize(Q, cols);
+		}
+
+		// Rayleigh-Ritz projection B = Q^T C Q
+		apply(cols);
+		B.assign(cols * cols, 0.0);
+		for (size_t i = 0; i < cols; i++)
+			for (size_t j = i; j < cols; j++)
+			{
+				double s = 0.0;
+				for (size_t k = 0; k < n; k++)
+					s += Q[i * n + k] * CQ[j * n + k];
+				B[i * cols + j] = s;
+			}
+		for (size_t i = 0; i < cols; i++)
+			for (size_t j = 0; j < i; j++)
+				B[i * cols + j] = B[j * cols + i];
+		jacobiEigen(B, cols, eig, vec);
+
+		captured = 0.0;
+		kept = 0;
+		while (kept < cols && kept < cap && eig[kept] > 0.0 && captured < energy * trace)
+			captured += eig[kept++];
+
+		// Subspace is too small to resolve requested energy - enlarge it
+		if (captured < energy * trace && kept < cap && cols == l && l < n && eig[cols - 1] > 0.0)
+		{
+			l = std::min(n, 2 * l);
+			continue;
+		}
+		break;
+	}
+
+	modesNum = kept;
+	lambda.assign(eig.begin(), eig.begin() + kept);
+	modes.assign(modesNum * n, 0.0);
+	for (size_t m = 0; m < modesNum; m++)
+	{
+		double* mode = &modes[m * n];
+		const double scale = sqrt(lambda[m]);
+		for (size_t j = 0; j < cols; j++)
+		{
+			const double coef = scale * vec[m * cols + j];
+			const double* q = &Q[j * n];
+			for (size_t i = 0; i < n; i++)
+				mode[i] += coef * q[i];
+		}
+	}
+}
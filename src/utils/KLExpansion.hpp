@@ -0,0 +1,55 @@
+#ifndef KLEXPANSION_HPP_
+#define KLEXPANSION_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <utility>
+
+// Truncated Karhunen-Loeve expansion of a covariance operator
+//		C ~ sum_m lambda_m * phi_m * phi_m^T
+// built by randomized subspace iteration with Rayleigh-Ritz refinement.
+// Only the matrix-vector product with C is required, so dense and sparse storages are treated alike.
+class KLExpansion
+{
+public:
+	typedef std::function<void(const double*, double*)> MatVec;
+protected:
+	size_t n;
+	size_t modesNum;
+	// Eigenvalues in descending order
+	std::vector<double> lambda;
+	// Scaled modes sqrt(lambda_m) * phi_m, stored row by row [modesNum x n]
+	std::vector<double> modes;
+	double trace, captured;
+
+	// Orthonormalizes 'cols' columns of Q [cols x n] in place, returns number of independent columns
+	size_t orthonormalize(std::vector<double>& Q, const size_t cols) const;
+	// Cyclic Jacobi eigensolver for dense symmetric m x m matrix A (destroyed)
+	static void jacobiEigen(std::vector<double>& A, const size_t m, std::vector<double>& eig, std::vector<double>& vec);
+public:
+	KLExpansion();
+	~KLExpansion();
+
+	// energy - fraction of trace(C) to be captured by kept modes, max_modes - upper bound on kept modes
+	void build(const size_t _n, const MatVec& matvec, const double _trace, const double energy,
+				const size_t max_modes, const int power_iters = 2);
+	void clear();
+	inline void swap(KLExpansion& other)
+	{
+		std::swap(n, other.n);
+		std::swap(modesNum, other.modesNum);
+		lambda.swap(other.lambda);
+		modes.swap(other.modes);
+		std::swap(trace, other.trace);
+		std::swap(captured, other.captured);
+	};
+
+	inline bool isActive() const { return modesNum > 0; };
+	inline size_t getModesNum() const { return modesNum; };
+	inline double getEigenvalue(const size_t m) const { return lambda[m]; };
+	inline const double* getMode(const size_t m) const { return &modes[m * n]; };
+	inline double getCapturedEnergy() const { return (trace > 0.0 ? captured / trace : 0.0); };
+};
+
+#endif /* KLEXPANSION_HPP_ */
@@ -0,0 +1,167 @@
+#include "src/utils/MappedField.hpp"
+
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+template <typename T>
+MappedField<T>::MappedField() : layersNum(0), layerSize(0), stride(0), data(NULL), isMapped(false)
+{
+#ifdef _WIN32
+	hFile = hMap = NULL;
+#else
+	fd = -1;
+#endif
+}
+template <typename T>
+MappedField<T>::~MappedField()
+{
+	release();
+}
+template <typename T>
+void MappedField<T>::release()
+{
+	if (isMapped)
+		unmap();
+	else
+		delete[] data;
+
+	data = NULL;
+	isMapped = false;
+	layersNum = layerSize = stride = 0;
+}
+template <typename T>
+void MappedField<T>::allocate(const size_t _layersNum, const size_t _layerSize, const StoreProps& props, const std::string& name)
+{
+	release();
+	layersNum = _layersNum;
+	layerSize = _layerSize;
+	const size_t tile_elems = tile / sizeof(T);
+	stride = (layerSize + tile_elems - 1) / tile_elems * tile_elems;
+	const size_t bytes = getMemory();
+	fileName = props.dir + "/" + name + ".bin";
+
+	if (props.mem_limit == 0 || bytes <= props.mem_limit)
+	{
+		data = new (std::nothrow) T[layersNum * stride]();
+		if (data != NULL)
+			return;
+		std::cout << name << ": " << bytes / 1048576.0 << " MB do not fit into memory" << std::endl;
+	}
+
+	if (!map(bytes))
+	{
+		layersNum = layerSize = stride = 0;
+		throw std::runtime_error("Cannot allocate " + name + " neither in memory nor in " + fileName);
+	}
+	isMapped = true;
+	std::cout << name << ": " << bytes / 1048576.0 << " MB mapped to " << fileName << std::endl;
+}
+#ifdef _WIN32
+template <typename T>
+bool MappedField<T>::map(const size_t bytes)
+{
+	hFile = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+						FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		hFile = NULL;
+		return false;
+	}
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)bytes >> 32), (DWORD)(bytes & 0xFFFFFFFF), NULL);
+	if (hMap != NULL)
+		data = static_cast<T*>(MapViewOfFile(hMap, FILE_MAP_ALL_ACCESS, 0, 0, bytes));
+	if (data == NULL)
+	{
+		unmap();
+		return false;
+	}
+	return true;
+}
+template <typename T>
+void MappedField<T>::unmap()
+{
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (hMap != NULL)
+		CloseHandle(hMap);
+	if (hFile != NULL)
+		CloseHandle(hFile);
+	hFile = hMap = NULL;
+	data = NULL;
+}
+template <typename T>
+void MappedField<T>::advise(const size_t layer, const Access access) const
+{
+	// Windows pager has no per-range hints
+}
+#else
+template <typename T>
+bool MappedField<T>::map(const size_t bytes)
+{
+	fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return false;
+	// File lives until unmapping, sparse file reads as zeros
+	unlink(fileName.c_str());
+	if (ftruncate(fd, bytes) != 0)
+	{
+		unmap();
+		return false;
+	}
+	void* ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+	{
+		unmap();
+		return false;
+	}
+	data = static_cast<T*>(ptr);
+	return true;
+}
+template <typename T>
+void MappedField<T>::unmap()
+{
+	if (data != NULL)
+		munmap(data, getMemory());
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+	data = NULL;
+}
+template <typename T>
+void MappedField<T>::advise(const size_t layer, const Access access) const
+{
+	// Heap pages must not be dropped
+	if (!isMapped || layer >= layersNum)
+		return;
+
+	const int advice = (access == SEQUENTIAL ? MADV_SEQUENTIAL : (access == WILLNEED ? MADV_WILLNEED : MADV_DONTNEED));
+	madvise(data + layer * stride, stride * sizeof(T), advice);
+}
+#endif
+template <typename T>
+MappedField<T>& MappedField<T>::operator=(const MappedField<T>& rhs)
+{
+	assert(layersNum == rhs.layersNum && stride == rhs.stride);
+	for (size_t i = 0; i < layersNum; i++)
+		(*this)[i] = rhs[i];
+	return *this;
+}
+template <typename T>
+MappedField<T>& MappedField<T>::operator=(const T val)
+{
+	for (size_t i = 0; i < layersNum; i++)
+		(*this)[i] = val;
+	return *this;
+}
+
+template class MappedField<double>;
+template class MappedField<float>;
@@ -0,0 +1,86 @@
+#ifndef MAPPEDFIELD_HPP_
+#define MAPPEDFIELD_HPP_
+
+#include <cstddef>
+#include <string>
+#include <algorithm>
+#include <assert.h>
+
+// Placement of large fields
+struct StoreProps
+{
+	// Fields larger than mem_limit bytes are backed by scratch file (0 - keep in memory while it is possible)
+	size_t mem_limit;
+	// Directory for scratch files
+	std::string dir;
+
+	StoreProps() : mem_limit(0), dir("snaps") {};
+};
+
+// Set of equally sized layers [layersNum x layerSize] with every layer starting at tile boundary.
+// Kept either in heap or in memory mapped scratch file, heap allocation failure falls back to the file.
+template <typename T>
+class MappedField
+{
+public:
+	// Expected access pattern of a layer
+	enum Access { SEQUENTIAL, WILLNEED, COLD };
+	// Tile is a multiple of page size and of Windows allocation granularity
+	static const size_t tile = 65536;
+
+	class Layer
+	{
+	protected:
+		T* ptr;
+		size_t n;
+	public:
+		Layer(T* _ptr, const size_t _n) : ptr(_ptr), n(_n) {};
+
+		inline T& operator[](const size_t i) const { return ptr[i]; };
+		inline size_t size() const { return n; };
+		inline Layer& operator=(const Layer& rhs)
+		{
+			assert(n == rhs.n);
+			std::copy(rhs.ptr, rhs.ptr + n, ptr);
+			return *this;
+		};
+		inline Layer& operator=(const T val)
+		{
+			std::fill(ptr, ptr + n, val);
+			return *this;
+		};
+	};
+protected:
+	size_t layersNum, layerSize, stride;
+	T* data;
+	bool isMapped;
+	std::string fileName;
+#ifdef _WIN32
+	void* hFile;
+	void* hMap;
+#else
+	int fd;
+#endif
+
+	bool map(const size_t bytes);
+	void unmap();
+public:
+	MappedField();
+	~MappedField();
+	MappedField(const MappedField&) = delete;
+	// Copies contents of equally shaped field
+	MappedField& operator=(const MappedField& rhs);
+	MappedField& operator=(const T val);
+
+	void allocate(const size_t _layersNum, const size_t _layerSize, const StoreProps& props, const std::string& name);
+	void release();
+	void advise(const size_t layer, const Access access) const;
+
+	inline size_t size() const { return layersNum; };
+	inline size_t getLayerSize() const { return layerSize; };
+	inline size_t getMemory() const { return layersNum * stride * sizeof(T); };
+	inline bool isOnDisk() const { return isMapped; };
+	inline Layer operator[](const size_t i) const { return Layer(data + i * stride, layerSize); };
+};
+
+#endif /* MAPPEDFIELD_HPP_ */
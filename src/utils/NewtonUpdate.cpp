@@ -0,0 +1,55 @@
+#include "src/utils/NewtonUpdate.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace newton;
+
+// Entries are handled in cache-sized blocks: the block maximum is found by a branch-free loop over independent lanes
+// (left to the compiler to vectorize), and the block is rescanned for the index only if it improves the running maximum
+static const int block = 256;
+static const int lanes = 4;
+
+UpdateStats newton::applyUpdate(double* x, const double* dx, const double* V, const int begin, const int end)
+{
+	UpdateStats res = { 0.0, begin, 0.0 };
+	for (int b = begin; b < end; b += block)
+	{
+		const int e = std::min(b + block, end);
+		double bmax[lanes] = { 0.0 }, bsum[lanes] = { 0.0 };
+		int i = b;
+		for (; i + lanes <= e; i += lanes)
+			for (int l = 0; l < lanes; l++)
+			{
+				const double xi = x[i + l] + dx[i + l];
+				const double r = fabs(dx[i + l] / xi);
+				x[i + l] = xi;
+				bmax[l] = (r > bmax[l] ? r : bmax[l]);
+				bsum[l] += xi * V[i + l];
+			}
+		for (; i < e; i++)
+		{
+			const double xi = x[i] + dx[i];
+			const double r = fabs(dx[i] / xi);
+			x[i] = xi;
+			bmax[0] = (r > bmax[0] ? r : bmax[0]);
+			bsum[0] += xi * V[i];
+		}
+
+		double m = bmax[0];
+		for (int l = 0; l < lanes; l++)
+		{
+			m = (bmax[l] > m ? bmax[l] : m);
+			res.volSum += bsum[l];
+		}
+		if (m > res.relErr)
+		{
+			for (i = b; i < e; i++)
+				if (fabs(dx[i] / x[i]) == m)
+					break;
+			res.relErr = m;
+			res.ind = i;
+		}
+	}
+	return res;
+}
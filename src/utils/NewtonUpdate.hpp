@@ -0,0 +1,20 @@
+#ifndef NEWTONUPDATE_HPP_
+#define NEWTONUPDATE_HPP_
+
+namespace newton
+{
+	struct UpdateStats
+	{
+		// Max of |dx / x| over updated entries and where it is reached
+		double relErr;
+		int ind;
+		// Sum of x * V over updated entries
+		double volSum;
+	};
+
+	// Applies Newton update x += dx over [begin, end) and collects convergence and volume average data in the same pass,
+	// so x, dx and V are streamed through memory once per iteration
+	UpdateStats applyUpdate(double* x, const double* dx, const double* V, const int begin, const int end);
+};
+
+#endif /* NEWTONUPDATE_HPP_ */
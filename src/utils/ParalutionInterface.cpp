@@ -2,6 +2,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
 
 using namespace paralution;
 using std::ifstream;
@@ -14,6 +16,9 @@ ParSolver::ParSolver() : resHistoryFile("snaps/resHistory.dat")
 	isPrecondBuilt = false;
 	isTheSameMatrix = false;
 	isCleared = true;
+	isPatternAssembled = false;
+	isBuiltOnPattern = false;
+	iterNum = 0;
 	gmres.Init(1.E-12, 1.E-8, 1E+6, 500);
 	bicgstab.Init(1.E-12, 1.E-8, 1E+6, 500);
 }
@@ -28,12 +33,106 @@ void ParSolver::Clear()
 {
 	bicgstab.Clear();
 	isCleared = true;
+	isBuiltOnPattern = false;
 	isTheSameMatrix = false;
 }
 void ParSolver::Init(const int vecSize, const double relTol, const double dropTol)
 {
 	matSize = vecSize;
 	x.Allocate("x", vecSize);
+	Rhs.Allocate("rhs", vecSize);
+}
+void ParSolver::SetPattern(const int* ind_i, const int* ind_j, const int counter)
+{
+	std::vector<std::vector<int>> rows(matSize);
+	for (int k = 0; k < counter; k++)
+	{
+		if (ind_i[k] < 0 || ind_i[k] >= matSize || ind_j[k] < 0 || ind_j[k] >= matSize)
+			throw std::runtime_error("ParSolver: pattern entry (" + std::to_string(ind_i[k]) + ", " + std::to_string(ind_j[k]) +
+				") is out of " + std::to_string(matSize) + "x" + std::to_string(matSize) + " matrix");
+		rows[ind_i[k]].push_back(ind_j[k]);
+	}
+
+	row_offset.resize(matSize + 1);
+	col_idx.clear();
+	row_offset[0] = 0;
+	for (int i = 0; i < matSize; i++)
+	{
+		auto& row = rows[i];
+		std::sort(row.begin(), row.end());
+		row.erase(std::unique(row.begin(), row.end()), row.end());
+		col_idx.insert(col_idx.end(), row.begin(), row.end());
+		row_offset[i + 1] = col_idx.size();
+	}
+	values.assign(col_idx.size(), 0.0);
+	isPatternAssembled = false;
+}
+void ParSolver::MapEntries(const unsigned int* ind_i, const unsigned int* ind_j, const int counter, std::vector<int>& slots) const
+{
+	slots.resize(counter);
+	for (int k = 0; k < counter; k++)
+	{
+		// Columns of a row are sorted
+		const int* cols = col_idx.data();
+		const int* pos = NULL;
+		if (ind_i[k] < (unsigned int)matSize)
+		{
+			const int* end = cols + row_offset[ind_i[k] + 1];
+			pos = std::lower_bound(cols + row_offset[ind_i[k]], end, (int)ind_j[k]);
+			if (pos == end || *pos != (int)ind_j[k])
+				pos = NULL;
+		}
+		if (pos == NULL)
+			throw std::runtime_error("ParSolver: Jacobian entry (" + std::to_string(ind_i[k]) + ", " + std::to_string(ind_j[k]) +
+				") is out of the matrix pattern");
+		slots[k] = (int)(pos - cols);
+	}
+}
+void ParSolver::ScatterValues(const std::vector<int>& slots, const double* a)
+{
+	std::fill(values.begin(), values.end(), 0.0);
+	const int* slot = slots.data();
+	double* val = values.data();
+	for (size_t k = 0; k < slots.size(); k++)
+		val[slot[k]] += a[k];
+}
+void ParSolver::setPatternMatrix()
+{
+	// Arrays of the operator are replaced, solver has to be built from scratch
+	if (isBuiltOnPattern)
+		Clear();
+	Mat.Clear();
+	Mat.AllocateCSR("A", values.size(), matSize, matSize);
+	Mat.CopyFromCSR(row_offset.data(), col_idx.data(), values.data());
+}
+void ParSolver::AssembleValues(const double* rhs)
+{
+	Mat.MoveToHost();
+	Rhs.MoveToHost();
+	x.MoveToHost();
+
+	// Conversion to CSR only once, values are copied afterwards
+	if (!isPatternAssembled)
+	{
+		setPatternMatrix();
+		isPatternAssembled = true;
+	}
+	else if (!isTheSameMatrix)
+		Mat.UpdateValuesCSR(values.data());
+
+	Rhs.CopyFromData(rhs);
+	x.Zeros();
+
+	Mat.MoveToAccelerator();
+	Rhs.MoveToAccelerator();
+	x.MoveToAccelerator();
+}
+void ParSolver::getInvert(int*& offset, int*& col, double*& dmat)
+{
+	setPatternMatrix();
+	Mat.Invert();
+	Mat.LeaveDataPtrCSR(&offset, &col, &dmat);
+	isPatternAssembled = false;
 }
 void ParSolver::Assemble(const int* ind_i, const int* ind_j, const double* a, const int counter, const int* ind_rhs, const double* rhs)
 {
@@ -88,6 +187,8 @@ void ParSolver::Solve(const PRECOND key)
 }
 void ParSolver::SolveBiCGStab()
 {
+	if (isBuiltOnPattern)
+		Clear();
 	bicgstab.SetOperator(Mat);
 	//p_ilut.Set(1.E-25, 300);
 	p.Set(1);
@@ -101,6 +202,7 @@ void ParSolver::SolveBiCGStab()
 	//bicgstab.RecordResidualHistory();
 	bicgstab.Solve(Rhs, &x);
 	status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
+	iterNum = bicgstab.GetIterationCount();
 	//if(status == RETURN_TYPE::DIV_CRITERIA || status == RETURN_TYPE::MAX_ITER)
 	//bicgstab.RecordHistory(resHistoryFile);
 	//writeSystem();
@@ -132,23 +234,32 @@ void ParSolver::SolveBiCGStab_Simple()
 		Mat.info();
 		bicgstab.Solve(Rhs, &x);
 		status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
+		iterNum = bicgstab.GetIterationCount();
 		//writeSystem();
 	}
 	else
 	{
-		bicgstab.SetOperator(Mat);
-		//p.Set(1.E-15, 100);
-		p.Set(0);
-		bicgstab.SetPreconditioner(p);
-		bicgstab.Build();
-		isCleared = false;
-
-		bicgstab.Init(1.E-12, 1.E-8, 1E+12, 500);
+		// Values of a pinned pattern changed in place: factorization is redone in the built buffers
+		if (isBuiltOnPattern)
+			bicgstab.ReBuildNumeric();
+		else
+		{
+			bicgstab.SetOperator(Mat);
+			//p.Set(1.E-15, 100);
+			p.Set(0);
+			bicgstab.SetPreconditioner(p);
+			bicgstab.Build();
+			isCleared = false;
+			isBuiltOnPattern = isPatternAssembled;
+
+			bicgstab.Init(1.E-12, 1.E-8, 1E+12, 500);
+		}
 		Mat.info();
 
 		//bicgstab.RecordResidualHistory();
 		bicgstab.Solve(Rhs, &x);
 		status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
+		iterNum = bicgstab.GetIterationCount();
 		//if(status == RETURN_TYPE::DIV_CRITERIA || status == RETURN_TYPE::MAX_ITER)
 		//bicgstab.RecordHistory(resHistoryFile);
 		//writeSystem();
@@ -157,8 +268,11 @@ void ParSolver::SolveBiCGStab_Simple()
 		//cout << "Final residual: " << finalRes << endl;
 		//cout << "Number of iterations: " << iterNum << endl << endl;
 
-		bicgstab.Clear();
-		isCleared = true;
+		if (!isBuiltOnPattern)
+		{
+			bicgstab.Clear();
+			isCleared = true;
+		}
 	}
 }
 void ParSolver::SolveGMRES()
@@ -176,6 +290,7 @@ void ParSolver::SolveGMRES()
 	//gmres.RecordResidualHistory();
 	gmres.Solve(Rhs, &x);
 	status = static_cast<RETURN_TYPE>(bicgstab.GetSolverStatus());
+	iterNum = gmres.GetIterationCount();
 	//gmres.RecordHistory(resHistoryFile);
 	//writeSystem();
 
@@ -2,6 +2,7 @@
 #define PARALUTIONINTERFACE_H_
 
 #include <string>
+#include <vector>
 
 #include "paralution.hpp"
 
@@ -42,15 +43,47 @@ protected:
 	int iterNum;
 	const std::string resHistoryFile;
 	void getResiduals();
+
+	// Persistent CSR pattern with pinned values refreshed in place
+	std::vector<int> row_offset, col_idx;
+	std::vector<double> values;
+	bool isPatternAssembled;
+	// Solver and preconditioner stay built on the pinned pattern, new values only refactorize them
+	bool isBuiltOnPattern;
+	void setPatternMatrix();
 public:
 	void Init(const int vecSize, const double relTol, const double dropTol);
 	void Assemble(const int* ind_i, const int* ind_j, const double* a, const int counter, const int* ind_rhs, const double* rhs);
+	// Builds CSR pattern from COO indices once, repeated entries are merged. Indices out of matrix are an error
+	void SetPattern(const int* ind_i, const int* ind_j, const int counter);
+	// Slots of COO entries in pinned values, found once for a fixed sequence of entries.
+	// Entry out of the pattern is an error: dropping it would solve another system
+	void MapEntries(const unsigned int* ind_i, const unsigned int* ind_j, const int counter, std::vector<int>& slots) const;
+	// Zeroes pinned values and adds a[k] to slots[k]
+	void ScatterValues(const std::vector<int>& slots, const double* a);
+	inline double* getValues() { return values.data(); };
+	// Value-only refresh of the matrix from pinned values
+	void AssembleValues(const double* rhs);
+	// Inverse of the matrix made of pinned values
+	void getInvert(int*& offset, int*& col, double*& dmat);
+	// Releases arrays given away by getInvert
+	static void freeInvert(int*& offset, int*& col, double*& dmat)
+	{
+		if (offset != NULL)	paralution::free_host(&offset);
+		if (col != NULL)	paralution::free_host(&col);
+		if (dmat != NULL)	paralution::free_host(&dmat);
+	};
 	void Solve();
 	void Solve(const PRECOND key);
 	void SetSameMatrix();
 	void Clear();
 
 	const Vector& getSolution() { return x; };
+	// Solution array handed out without copying, it has to be returned before the next solve
+	inline double* lendSolution() { double* ptr = NULL; x.LeaveDataPtr(&ptr); return ptr; };
+	inline void returnSolution(double*& ptr) { x.SetDataPtr(&ptr, "x", matSize); };
+	// Iterations made by the last linear solve
+	inline int getIterations() const { return iterNum; };
 	void getInvert(const int* ind_i, const int* ind_j, const double* a, const int counter, int*& offset, int*& col, double*& dmat)
 	{
 		Mat.Zeros();
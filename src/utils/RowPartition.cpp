@@ -0,0 +1,26 @@
+#include "src/utils/RowPartition.hpp"
+
+#include <algorithm>
+
+RowPartition::RowPartition() : bounds({ 0, 0 })
+{
+}
+RowPartition::~RowPartition()
+{
+}
+void RowPartition::build(const int cellsNum, const int rowSize, const int threadsNum)
+{
+	const int rowsNum = (cellsNum + rowSize - 1) / rowSize;
+	int stripsNum = (threadsNum > 0 ? threadsNum : (int)std::thread::hardware_concurrency());
+	stripsNum = std::max(1, std::min(stripsNum, rowsNum));
+
+	// Rows are spread as evenly as possible
+	bounds.resize(stripsNum + 1);
+	for (int t = 0; t <= stripsNum; t++)
+		bounds[t] = std::min(cellsNum, (int)((long long)rowsNum * t / stripsNum) * rowSize);
+	pool.reset();
+}
+void RowPartition::startWorkers()
+{
+	pool.reset(getThreadsNum() > 1 ? new ThreadPool(getThreadsNum()) : NULL);
+}
@@ -0,0 +1,54 @@
+#ifndef ROWPARTITION_HPP_
+#define ROWPARTITION_HPP_
+
+#include <vector>
+#include <memory>
+#include <thread>
+
+#include "src/utils/ThreadPool.hpp"
+
+// Split of cells into contiguous strips of whole grid rows, one strip per thread.
+// Cells are numbered row by row, so every strip owns its own range of matrix rows and of CSR entries:
+// threads write their results without atomics or locks.
+class RowPartition
+{
+protected:
+	// Strip t holds cells [bounds[t], bounds[t + 1])
+	std::vector<int> bounds;
+	// Workers of strips, kept between calls
+	std::unique_ptr<ThreadPool> pool;
+public:
+	RowPartition();
+	~RowPartition();
+
+	// threadsNum = 0 takes the hardware concurrency
+	void build(const int cellsNum, const int rowSize, const int threadsNum);
+	// Starts one worker per strip but the first, without them strips are run one by one by the caller
+	void startWorkers();
+
+	inline int getThreadsNum() const { return (int)bounds.size() - 1; };
+	inline int begin(const int t) const { return bounds[t]; };
+	inline int end(const int t) const { return bounds[t + 1]; };
+
+	// Calls f(t, begin, end) for every strip t, the first strip is done by the calling thread
+	template <class Func>
+	void runStrips(const Func& f) const
+	{
+		const int threadsNum = getThreadsNum();
+		if (!pool)
+		{
+			for (int t = 0; t < threadsNum; t++)
+				f(t, bounds[t], bounds[t + 1]);
+			return;
+		}
+		pool->run(threadsNum, [&f, this](const int t) { f(t, bounds[t], bounds[t + 1]); });
+	};
+	// Calls f(begin, end) for every strip
+	template <class Func>
+	void run(const Func& f) const
+	{
+		runStrips([&f](const int, const int begin, const int end) { f(begin, end); });
+	};
+};
+
+#endif /* ROWPARTITION_HPP_ */
@@ -0,0 +1,57 @@
+#include "src/utils/Schedule.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+Schedule::Schedule() : wellsNum(0)
+{
+}
+Schedule::~Schedule()
+{
+}
+void Schedule::build(const std::vector<Well>& wells)
+{
+	wellsNum = wells.size();
+	times.clear();
+	for (const auto& well : wells)
+		for (int p = 0; p < well.periodsNum; p++)
+			times.push_back(well.period[p]);
+	std::sort(times.begin(), times.end());
+
+	// Ends closer than round-off are the same event
+	const double tol = 1.E-12 * (times.empty() ? 1.0 : fabs(times.back()));
+	times.erase(std::unique(times.begin(), times.end(), [tol](const double a, const double b) { return b - a <= tol; }), times.end());
+
+	const size_t intervalsNum = times.size();
+	periods.resize(intervalsNum * wellsNum);
+	changed.assign(intervalsNum, std::vector<int>());
+	controlChange.assign(intervalsNum, false);
+	for (int w = 0; w < wellsNum; w++)
+	{
+		const auto& well = wells[w];
+		const double* begin = &well.period[0];
+		const double* end = begin + well.periodsNum;
+		for (size_t k = 0; k < intervalsNum; k++)
+		{
+			// Well keeps its last control after the end of its own schedule
+			const int p = std::min(int(std::lower_bound(begin, end, times[k] - tol) - begin), well.periodsNum - 1);
+			periods[k * wellsNum + w] = p;
+
+			const int prev = (k > 0 ? periods[(k - 1) * wellsNum + w] : -1);
+			if (p == prev)
+				continue;
+			changed[k].push_back(w);
+			if (prev < 0 || well.leftBoundIsRate[p] != well.leftBoundIsRate[prev] ||
+				(well.leftBoundIsRate[p] ? well.rate[p] != well.rate[prev] : well.pwf[p] != well.pwf[prev]))
+				controlChange[k] = true;
+		}
+	}
+
+	std::cout << "Schedule: " << wellsNum << " wells, " << intervalsNum << " events" << std::endl;
+}
+size_t Schedule::find(const double t) const
+{
+	const size_t k = std::lower_bound(times.begin(), times.end(), t) - times.begin();
+	return std::min(k, times.size() - 1);
+}
@@ -0,0 +1,38 @@
+#ifndef SCHEDULE_HPP_
+#define SCHEDULE_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "src/Well.hpp"
+
+// Merged schedule of all wells: sorted unique ends of well control periods.
+// Interval k lasts till getTime(k), during it well w follows its own period getPeriod(k, w).
+class Schedule
+{
+protected:
+	int wellsNum;
+	std::vector<double> times;
+	// Period of every well in every interval [intervals x wells]
+	std::vector<int> periods;
+	// Wells which switch the period at the beginning of interval
+	std::vector<std::vector<int>> changed;
+	// Some well changes its boundary condition or its value at the beginning of interval
+	std::vector<bool> controlChange;
+public:
+	Schedule();
+	~Schedule();
+
+	void build(const std::vector<Well>& wells);
+
+	inline size_t size() const { return times.size(); };
+	inline double getTime(const size_t k) const { return times[k]; };
+	inline double getEndTime() const { return times.back(); };
+	inline int getPeriod(const size_t k, const int well) const { return periods[k * wellsNum + well]; };
+	inline const std::vector<int>& getChanged(const size_t k) const { return changed[k]; };
+	inline bool isControlChange(const size_t k) const { return controlChange[k]; };
+	// Interval containing time t
+	size_t find(const double t) const;
+};
+
+#endif /* SCHEDULE_HPP_ */
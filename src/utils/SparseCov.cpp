@@ -0,0 +1,61 @@
+#include "src/utils/SparseCov.hpp"
+
+#include <algorithm>
+
+SparseCov::SparseCov() : n(0)
+{
+}
+SparseCov::~SparseCov()
+{
+}
+void SparseCov::clear()
+{
+	n = 0;
+	offset.clear();
+	col.clear();
+	val.clear();
+}
+void SparseCov::setPattern(std::vector<std::vector<int>>& rows)
+{
+	n = rows.size();
+	offset.resize(n + 1);
+	offset[0] = 0;
+	for (int i = 0; i < n; i++)
+	{
+		auto& row = rows[i];
+		std::sort(row.begin(), row.end());
+		row.erase(std::unique(row.begin(), row.end()), row.end());
+		offset[i + 1] = offset[i] + row.size();
+	}
+
+	col.resize(offset[n]);
+	for (int i = 0; i < n; i++)
+		std::copy(rows[i].begin(), rows[i].end(), col.begin() + offset[i]);
+	val.assign(offset[n], 0.0);
+}
+double SparseCov::get(const int i, const int j) const
+{
+	const auto begin = col.begin() + offset[i];
+	const auto end = col.begin() + offset[i + 1];
+	const auto it = std::lower_bound(begin, end, j);
+	if (it != end && *it == j)
+		return val[it - col.begin()];
+	else
+		return 0.0;
+}
+void SparseCov::getRow(const int i, double* dense) const
+{
+	std::fill(dense, dense + n, 0.0);
+	for (int k = offset[i]; k < offset[i + 1]; k++)
+		dense[col[k]] = val[k];
+}
+void SparseCov::multiply(const double* v, double* res) const
+{
+	for (int i = 0; i < n; i++)
+	{
+		double s = 0.0;
+		for (int k = offset[i]; k < offset[i + 1]; k++)
+			s += val[k] * v[col[k]];
+		res[i] = s;
+	}
+}
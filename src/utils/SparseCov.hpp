@@ -0,0 +1,49 @@
+#ifndef SPARSECOV_HPP_
+#define SPARSECOV_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+// Symmetric covariance matrix in CSR format with sorted column indices
+class SparseCov
+{
+protected:
+	int n;
+	std::vector<int> offset;
+	std::vector<int> col;
+	std::vector<double> val;
+public:
+	SparseCov();
+	~SparseCov();
+
+	// Sets sparsity pattern from (unsorted, possibly repeated) column lists of each row, values are zeroed
+	void setPattern(std::vector<std::vector<int>>& rows);
+	void clear();
+	inline void swap(SparseCov& other)
+	{
+		std::swap(n, other.n);
+		offset.swap(other.offset);
+		col.swap(other.col);
+		val.swap(other.val);
+	};
+
+	inline int getSize() const { return n; };
+	inline size_t getNonZerosNum() const { return val.size(); };
+	inline size_t getMemory() const { return val.size() * (sizeof(double) + sizeof(int)) + offset.size() * sizeof(int); };
+	inline int rowBegin(const int i) const { return offset[i]; };
+	inline int rowEnd(const int i) const { return offset[i + 1]; };
+	inline int getCol(const int k) const { return col[k]; };
+	inline double& getVal(const int k) { return val[k]; };
+	inline double getVal(const int k) const { return val[k]; };
+	inline double* getValues() { return val.data(); };
+	inline const double* getValues() const { return val.data(); };
+
+	// Zero if (i, j) is out of pattern
+	double get(const int i, const int j) const;
+	// Writes i-th row into dense array of size n
+	void getRow(const int i, double* dense) const;
+	void multiply(const double* v, double* res) const;
+};
+
+#endif /* SPARSECOV_HPP_ */
@@ -0,0 +1,56 @@
+#include "src/utils/StepController.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+std::unique_ptr<StepController> StepController::create(const StepControlProps& props)
+{
+	if (props.type == StepControlProps::PID)
+		return std::unique_ptr<StepController>(new PIDController(props));
+	else
+		return std::unique_ptr<StepController>(new DoublingController(props));
+}
+
+double DoublingController::propose(const double ht, const StepFeedback&)
+{
+	return 2.0 * ht;
+}
+
+void PIDController::reset()
+{
+	state.e0 = state.e1 = state.e2 = 1.0;
+	state.history = 0;
+}
+void PIDController::saveState(Checkpoint& chk) const
+{
+	chk.add("step_pid", &state, sizeof(state));
+}
+void PIDController::loadState(Checkpoint& chk)
+{
+	chk.get("step_pid", &state, sizeof(state));
+}
+double PIDController::propose(const double ht, const StepFeedback& fb)
+{
+	if (!fb.valid)
+		return ht;
+	if (!fb.converged)
+		return props.min_ratio * ht;
+
+	double& e0 = state.e0;
+	double& e1 = state.e1;
+	double& e2 = state.e2;
+	e2 = e1;	e1 = e0;
+	e0 = std::max(fb.change / props.p0_tol, 1.E-10);
+	state.history++;
+	// Missing history makes P and D terms neutral
+	if (state.history < 2)	e1 = e0;
+	if (state.history < 3)	e2 = e1;
+
+	double ratio = pow(e1 / e0, props.kP) * pow(1.0 / e0, props.kI) * pow(e1 * e1 / e0 / e2, props.kD);
+	if (props.newton_target > 0 && fb.newtonIters > 0)
+		ratio = std::min(ratio, (double)props.newton_target / (double)fb.newtonIters);
+	if (props.linear_target > 0 && fb.linearIters > 0.0)
+		ratio = std::min(ratio, (double)props.linear_target / fb.linearIters);
+
+	return limit(ratio) * ht;
+}
@@ -0,0 +1,85 @@
+#ifndef STEPCONTROLLER_HPP_
+#define STEPCONTROLLER_HPP_
+
+#include <memory>
+#include <cstdint>
+
+#include "src/utils/Checkpoint.hpp"
+
+struct StepControlProps
+{
+	enum Type { DOUBLING, PID };
+	Type type;
+	// Target max relative change of p0 over a step
+	double p0_tol;
+	// Targets for Newton iterations of p0 and linear solver iterations per Newton iteration (0 - not used)
+	int newton_target, linear_target;
+	// PID gains on log of normalized error
+	double kP, kI, kD;
+	// Bounds of step ratio between consecutive steps
+	double min_ratio, max_ratio;
+
+	StepControlProps() : type(DOUBLING), p0_tol(0.05), newton_target(4), linear_target(0),
+		kP(0.075), kI(0.175), kD(0.01), min_ratio(0.2), max_ratio(2.0) {};
+};
+// Results of the last step used to choose the next one
+struct StepFeedback
+{
+	bool valid;
+	bool converged;
+	// Max relative change of p0 over the step
+	double change;
+	int newtonIters;
+	double linearIters;
+
+	StepFeedback() : valid(false), converged(true), change(0.0), newtonIters(0), linearIters(0.0) {};
+};
+
+class StepController
+{
+protected:
+	const StepControlProps props;
+	inline double limit(const double ratio) const
+	{
+		return (ratio < props.min_ratio ? props.min_ratio : (ratio > props.max_ratio ? props.max_ratio : ratio));
+	};
+public:
+	StepController(const StepControlProps& _props) : props(_props) {};
+	virtual ~StepController() {};
+
+	// Forget history, e.g. at the beginning of well control period
+	virtual void reset() {};
+	// Next time step from the last one
+	virtual double propose(const double ht, const StepFeedback& fb) = 0;
+	// History of the controller, restarted run takes the same steps
+	virtual void saveState(Checkpoint&) const {};
+	virtual void loadState(Checkpoint&) {};
+
+	static std::unique_ptr<StepController> create(const StepControlProps& props);
+};
+// Doubles the step every time
+class DoublingController : public StepController
+{
+public:
+	DoublingController(const StepControlProps& _props) : StepController(_props) {};
+	double propose(const double ht, const StepFeedback& fb);
+};
+// PID control of p0 change (Valli et al.) limited by Newton and linear iterations targets
+class PIDController : public StepController
+{
+protected:
+	// Normalized errors of the last, previous and pre-previous steps and number of steps behind them
+	struct State
+	{
+		double e0, e1, e2;
+		int64_t history;
+	} state;
+public:
+	PIDController(const StepControlProps& _props) : StepController(_props) { reset(); };
+	void reset();
+	double propose(const double ht, const StepFeedback& fb);
+	void saveState(Checkpoint& chk) const;
+	void loadState(Checkpoint& chk);
+};
+
+#endif /* STEPCONTROLLER_HPP_ */
@@ -0,0 +1,56 @@
+#include "src/utils/ThreadPool.hpp"
+
+ThreadPool::ThreadPool(const int _threadsNum) : threadsNum(_threadsNum > 1 ? _threadsNum : 1), ctx(NULL), call(NULL), tasksNum(0), generation(0), pending(0), isStopped(false)
+{
+	workers.reserve(threadsNum - 1);
+	for (int id = 1; id < threadsNum; id++)
+		workers.emplace_back(&ThreadPool::loop, this, id);
+}
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopped = true;
+	}
+	start_cv.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+void ThreadPool::loop(const int id)
+{
+	uint64_t seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_cv.wait(lock, [&]() { return isStopped || generation != seen; });
+			if (isStopped)
+				return;
+			seen = generation;
+		}
+		for (int t = id; t < tasksNum; t += threadsNum)
+			call(ctx, t);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0)
+				done_cv.notify_one();
+		}
+	}
+}
+void ThreadPool::dispatch(const int _tasksNum, const void* _ctx, void (*_call)(const void*, const int))
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ctx = _ctx;
+		call = _call;
+		tasksNum = _tasksNum;
+		pending = (int)workers.size();
+		generation++;
+	}
+	start_cv.notify_all();
+	for (int t = 0; t < _tasksNum; t += threadsNum)
+		_call(_ctx, t);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cv.wait(lock, [this]() { return pending == 0; });
+}
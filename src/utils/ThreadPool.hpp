@@ -0,0 +1,58 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Workers started once and woken for every batch of tasks.
+// Tasks 0..tasksNum-1 of a batch go round robin over the calling thread (task 0) and workers,
+// a batch is handed over by pointer, so run() neither allocates nor copies the callable.
+// One batch at a time: a pool must not be shared by concurrently running callers
+class ThreadPool
+{
+protected:
+	const int threadsNum;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start_cv, done_cv;
+	// Current batch
+	const void* ctx;
+	void (*call)(const void* ctx, const int task);
+	int tasksNum;
+	uint64_t generation;
+	int pending;
+	bool isStopped;
+
+	void loop(const int id);
+	void dispatch(const int _tasksNum, const void* _ctx, void (*_call)(const void*, const int));
+	template <class Func>
+	static void invoke(const void* f, const int task)
+	{
+		(*static_cast<const Func*>(f))(task);
+	};
+public:
+	// threadsNum counts the calling thread, so threadsNum - 1 workers are started
+	ThreadPool(const int _threadsNum);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	inline int getThreadsNum() const { return threadsNum; };
+	// Calls f(task) for every task and returns when all of them are done
+	template <class Func>
+	void run(const int _tasksNum, const Func& f)
+	{
+		if (workers.empty() || _tasksNum <= 1)
+		{
+			for (int t = 0; t < _tasksNum; t++)
+				f(t);
+			return;
+		}
+		dispatch(_tasksNum, &f, &invoke<Func>);
+	};
+};
+
+#endif /* THREADPOOL_HPP_ */
@@ -27,19 +27,26 @@ using namespace std;
 using namespace snapshotter;
 
 template<class modelType>
-VTKSnapshotter<modelType>::VTKSnapshotter(const Model* _model) : model(_model), mesh(_model->getMesh())
+VTKSnapshotter<modelType>::VTKSnapshotter(const Model* _model) : model(_model), mesh(_model->getMesh()), prefix(_model->getOutDir())
 {
 	R_dim = model->R_dim;
 	pattern = prefix + "Mesh_%{STEP}.vtu";
 }
-VTKSnapshotter<stoch_oil::StochOil>::VTKSnapshotter(const stoch_oil::StochOil* _model) : model(_model), mesh(_model->getMesh())
+VTKSnapshotter<oil::Oil>::VTKSnapshotter(const oil::Oil* _model) : model(_model), mesh(_model->getMesh()), prefix(_model->getOutDir())
+{
+	R_dim = model->R_dim;
+	pattern = prefix + "Oil_%{STEP}.vtu";
+
+	num_x = mesh->num_x;	num_y = mesh->num_y;
+}
+VTKSnapshotter<stoch_oil::StochOil>::VTKSnapshotter(const stoch_oil::StochOil* _model) : model(_model), mesh(_model->getMesh()), prefix(_model->getOutDir())
 {
 	R_dim = model->R_dim;
 	pattern = prefix + "StochOil_%{STEP}.vtu";
 
 	num_x = mesh->num_x;	num_y = mesh->num_y;
 }
-VTKSnapshotter<dual_stoch_oil::DualStochOil>::VTKSnapshotter(const dual_stoch_oil::DualStochOil* _model) : model(_model), mesh(_model->getCellMesh())
+VTKSnapshotter<dual_stoch_oil::DualStochOil>::VTKSnapshotter(const dual_stoch_oil::DualStochOil* _model) : model(_model), mesh(_model->getCellMesh()), prefix(_model->getOutDir())
 {
     R_dim = model->R_dim;
     pattern = prefix + "DualStochOil_%{STEP}.vtu";
@@ -72,6 +79,72 @@ template<class modelType>
 void VTKSnapshotter<modelType>::dump(const int i)
 {
 }
+void VTKSnapshotter<oil::Oil>::dump(const int snap_idx)
+{
+	using namespace oil;
+	auto grid = vtkSmartPointer<vtkUnstructuredGrid>::New();
+	auto points = vtkSmartPointer<vtkPoints>::New();
+	auto cells = vtkSmartPointer<vtkCellArray>::New();
+	auto pres = vtkSmartPointer<vtkDoubleArray>::New();
+	pres->SetName("pressure");
+	auto visc = vtkSmartPointer<vtkDoubleArray>::New();
+	visc->SetName("viscosity");
+	auto perm = vtkSmartPointer<vtkDoubleArray>::New();
+	perm->SetName("Permeability");
+	auto well_id = vtkSmartPointer<vtkIntArray>::New();
+	well_id->SetName("well_id");
+
+	points->Allocate((num_x + 1) * (num_y + 1));
+	cells->Allocate(num_x * num_y);
+
+	for (int i = 0; i < num_x + 1; i++)
+		for (int j = 0; j < num_y + 1; j++)
+		{
+			const Cell& cell = mesh->cells[(num_y + 2) * i + j];
+			points->InsertNextPoint(R_dim * (cell.cent.x + cell.hx / 2), R_dim * (cell.cent.y + cell.hy / 2), 0.0);
+		}
+	grid->SetPoints(points);
+
+	size_t x_ind, y_ind;
+	for (const auto& cell : mesh->cells)
+	{
+		if (cell.type == elem::QUAD)
+		{
+			x_ind = cell.id / (num_y + 2) - 1;
+			y_ind = cell.id % (num_y + 2) - 1;
+
+			vtkSmartPointer<vtkQuad> quad = vtkSmartPointer<vtkQuad>::New();
+			quad->GetPointIds()->SetId(0, y_ind + x_ind * (num_y + 1));
+			quad->GetPointIds()->SetId(1, y_ind + x_ind * (num_y + 1) + 1);
+			quad->GetPointIds()->SetId(2, y_ind + (x_ind + 1) * (num_y + 1) + 1);
+			quad->GetPointIds()->SetId(3, y_ind + (x_ind + 1) * (num_y + 1));
+			cells->InsertNextCell(quad);
+
+			const double p = (*model)[cell.id].u_next.p0;
+			pres->InsertNextValue(p * model->P_dim / BAR_TO_PA);
+			visc->InsertNextValue(model->props_oil.getViscosity(p) * model->P_dim * model->t_dim / cPToPaSec(1.0));
+			perm->InsertNextValue(M2toMilliDarcy(model->getPerm(cell) * R_dim * R_dim));
+
+			auto it = find_if(model->wells.begin(), model->wells.end(), [&](const Well& well) {return well.cell_id == cell.id; });
+			if (it != model->wells.end())
+				well_id->InsertNextValue(it->id + 1);
+			else
+				well_id->InsertNextValue(0);
+		}
+	}
+	grid->SetCells(VTK_QUAD, cells);
+
+	vtkCellData* fd = grid->GetCellData();
+	fd->AddArray(well_id);
+	fd->AddArray(pres);
+	fd->AddArray(visc);
+	fd->AddArray(perm);
+
+	auto writer = vtkSmartPointer<vtkXMLUnstructuredGridWriter>::New();
+	writer->SetFileName(getFileName(snap_idx).c_str());
+	writer->SetInputData(grid);
+	writer->Write();
+}
 void VTKSnapshotter<stoch_oil::StochOil>::dump(const int snap_idx)
 {
 	using namespace stoch_oil;
@@ -185,7 +258,7 @@ void VTKSnapshotter<stoch_oil::StochOil>::dump(const int snap_idx)
 			p2->InsertNextValue(model->p2_next[cell.id] * model->P_dim / BAR_TO_PA);
             perm->InsertNextValue(M2toMilliDarcy(model->getPerm(cell) * R_dim * R_dim));
 
-			var = model->Cp_next[snap_idx][cell.id * model->cellsNum + cell.id] * model->P_dim / BAR_TO_PA * model->P_dim / BAR_TO_PA;
+			var = model->getCp(&model->Cp_next[snap_idx][0], cell.id, cell.id) * model->P_dim / BAR_TO_PA * model->P_dim / BAR_TO_PA;
 			p_var->InsertNextValue(var);
 			if(var >= 0.0)
 				p_std->InsertNextValue(sqrt(var));
@@ -201,9 +274,9 @@ void VTKSnapshotter<stoch_oil::StochOil>::dump(const int snap_idx)
             perm_kg->InsertNextValue(M2toMilliDarcy(Kg * model->props_oil.visc * R_dim * R_dim));
 			Jx = -(model->p0_next[beta_x_plus.id] - model->p0_next[beta_x_minus.id]) / (beta_x_plus.cent.x - beta_x_minus.cent.x);
 			Jy = -(model->p0_next[beta_y_plus.id] - model->p0_next[beta_y_minus.id]) / (beta_y_plus.cent.y - beta_y_minus.cent.y);
-			dCfp_dx = (model->Cfp_prev[cell.id * model->cellsNum + beta_x_plus.id] - model->Cfp_prev[cell.id * model->cellsNum + beta_x_minus.id]) / 
+			dCfp_dx = (model->getCfp(model->Cfp_prev, cell.id, beta_x_plus.id) - model->getCfp(model->Cfp_prev, cell.id, beta_x_minus.id)) / 
 						(beta_x_plus.cent.x - beta_x_minus.cent.x);
-			dCfp_dy = (model->Cfp_prev[cell.id * model->cellsNum + beta_y_plus.id] - model->Cfp_prev[cell.id * model->cellsNum + beta_y_minus.id]) / 
+			dCfp_dy = (model->getCfp(model->Cfp_prev, cell.id, beta_y_plus.id) - model->getCfp(model->Cfp_prev, cell.id, beta_y_minus.id)) / 
 						(beta_y_plus.cent.y - beta_y_minus.cent.y);
 			Sigma2 = model->getSigma2f(cell);
 
@@ -217,9 +290,9 @@ void VTKSnapshotter<stoch_oil::StochOil>::dump(const int snap_idx)
 			q_avg_2->InsertNextTuple(q_comps);
 
 			var = Kg * Kg * (Jx * Jx * Sigma2 - 2.0 * Jx * dCfp_dx + 
-			((model->Cp_next[snap_idx][model->cellsNum * beta_x_plus.id + beta_x_plus.id] - model->Cp_next[snap_idx][model->cellsNum * beta_x_minus.id + beta_x_plus.id]) /
+			((model->getCp(&model->Cp_next[snap_idx][0], beta_x_plus.id, beta_x_plus.id) - model->getCp(&model->Cp_next[snap_idx][0], beta_x_minus.id, beta_x_plus.id)) /
 				(beta_x_plus.cent.x - beta_x_minus.cent.x) - 
-			(model->Cp_next[snap_idx][model->cellsNum * beta_x_plus.id + beta_x_minus.id] - model->Cp_next[snap_idx][model->cellsNum * beta_x_minus.id + beta_x_minus.id]) / 
+			(model->getCp(&model->Cp_next[snap_idx][0], beta_x_plus.id, beta_x_minus.id) - model->getCp(&model->Cp_next[snap_idx][0], beta_x_minus.id, beta_x_minus.id)) / 
 				(beta_x_plus.cent.x - beta_x_minus.cent.x)) / (beta_x_plus.cent.x - beta_x_minus.cent.x)) * cell.hy * cell.hz * cell.hy * cell.hz * model->Q_dim * 86400.0 * model->Q_dim * 86400.0;
 			if (var > 0.0)
 				qx_std->InsertNextValue(sqrt(var));
@@ -227,9 +300,9 @@ void VTKSnapshotter<stoch_oil::StochOil>::dump(const int snap_idx)
 				qx_std->InsertNextValue(0.0);
 
 			var = Kg * Kg * (Jy * Jy * Sigma2 - 2.0 * Jy * dCfp_dy +
-			((model->Cp_next[snap_idx][model->cellsNum * beta_y_plus.id + beta_y_plus.id] - model->Cp_next[snap_idx][model->cellsNum * beta_y_minus.id + beta_y_plus.id]) /
+			((model->getCp(&model->Cp_next[snap_idx][0], beta_y_plus.id, beta_y_plus.id) - model->getCp(&model->Cp_next[snap_idx][0], beta_y_minus.id, beta_y_plus.id)) /
 				(beta_y_plus.cent.y - beta_y_minus.cent.y) -
-			(model->Cp_next[snap_idx][model->cellsNum * beta_y_plus.id + beta_y_minus.id] - model->Cp_next[snap_idx][model->cellsNum * beta_y_minus.id + beta_y_minus.id]) /
+			(model->getCp(&model->Cp_next[snap_idx][0], beta_y_plus.id, beta_y_minus.id) - model->getCp(&model->Cp_next[snap_idx][0], beta_y_minus.id, beta_y_minus.id)) /
 				(beta_y_plus.cent.y - beta_y_minus.cent.y)) / (beta_y_plus.cent.y - beta_y_minus.cent.y)) * cell.hx * cell.hz * cell.hx * cell.hz * model->Q_dim * 86400.0 * model->Q_dim * 86400.0;
 			if (var > 0.0)
 				qy_std->InsertNextValue(sqrt(var));
@@ -238,9 +311,9 @@ void VTKSnapshotter<stoch_oil::StochOil>::dump(const int snap_idx)
 
             /*for (size_t time_step = 0; time_step < model->possible_steps_num; time_step++)
             {
-                Cp_well[time_step]->InsertNextValue(model->Cp_next[time_step][model->wells.back().cell_id * model->cellsNum + cell.id] /
-                                                                        sqrt(model->Cp_next[time_step][model->wells.back().cell_id * model->cellsNum + model->wells.back().cell_id] *
-                                                                            model->Cp_next[time_step][cell.id * model->cellsNum + cell.id]));
+                Cp_well[time_step]->InsertNextValue(model->getCp(&model->Cp_next[time_step][0], model->wells.back().cell_id, cell.id) /
+                                                                        sqrt(model->getCp(&model->Cp_next[time_step][0], model->wells.back().cell_id, model->wells.back().cell_id) *
+                                                                            model->getCp(&model->Cp_next[time_step][0], cell.id, cell.id)));
             }*/
 
             buf1 = model->getPerm(cell);
@@ -250,18 +323,18 @@ void VTKSnapshotter<stoch_oil::StochOil>::dump(const int snap_idx)
             for (int i = 0; i < model->wells.size(); i++)
             {
                 const auto& well = model->wells[i];
-                buf3 = model->Cfp_next[well.cell_id * model->cellsNum + cell.id] * model->P_dim / BAR_TO_PA;
+                buf3 = model->getCfp(model->Cfp_next, well.cell_id, cell.id) * model->P_dim / BAR_TO_PA;
                 buf4 = model->getSigma2f(cell);
-                buf5 = model->Cp_next[snap_idx][well.cell_id * model->cellsNum + well.cell_id];
+                buf5 = model->getCp(&model->Cp_next[snap_idx][0], well.cell_id, well.cell_id);
                 cmp[0]->InsertNextValue(buf3);
-                cmp[1]->InsertNextValue(model->Cfp_next[well.cell_id * model->cellsNum + cell.id] * model->P_dim / BAR_TO_PA);
+                cmp[1]->InsertNextValue(model->getCfp(model->Cfp_next, well.cell_id, cell.id) * model->P_dim / BAR_TO_PA);
                 if (fabs(buf3) == 0.0 && (sqrt(buf4) == 0.0 || sqrt(buf5) == 0.0))
                     buf1 = 0.0;
                 else
                     buf1 = buf3;// / sqrt(buf4 * buf5);
-                buf3 = model->Cp_next[snap_idx][well.cell_id * model->cellsNum + cell.id] * model->P_dim / BAR_TO_PA * model->P_dim / BAR_TO_PA;
-                buf4 = model->Cp_next[snap_idx][well.cell_id * model->cellsNum + well.cell_id];
-                buf5 = model->Cp_next[snap_idx][cell.id * model->cellsNum + cell.id];
+                buf3 = model->getCp(&model->Cp_next[snap_idx][0], well.cell_id, cell.id) * model->P_dim / BAR_TO_PA * model->P_dim / BAR_TO_PA;
+                buf4 = model->getCp(&model->Cp_next[snap_idx][0], well.cell_id, well.cell_id);
+                buf5 = model->getCp(&model->Cp_next[snap_idx][0], cell.id, cell.id);
                 if (fabs(buf3) == 0.0 && (sqrt(buf4) == 0.0 || sqrt(buf5) == 0.0))
                     buf2 = 0.0;
                 else
@@ -607,5 +680,6 @@ void VTKSnapshotter<dual_stoch_oil::DualStochOil>::dump(const int snap_idx)
     writer->Write();
 }
 
+template class VTKSnapshotter<oil::Oil>;
 template class VTKSnapshotter<stoch_oil::StochOil>;
 template class VTKSnapshotter<dual_stoch_oil::DualStochOil>;
@@ -13,7 +13,8 @@ namespace snapshotter
 	protected:
 		const Model* model;
 		const Mesh* mesh;
-		const std::string prefix = "snaps/";
+		// Output directory of the model
+		const std::string prefix;
 		std::string pattern;
 		std::string replace(std::string filename, std::string from, std::string to);
 		std::string getFileName(const int snap_idx);
@@ -0,0 +1,100 @@
+#include "src/utils/Workspace.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+Workspace::Workspace() : block(NULL), total(0)
+{
+}
+Workspace::~Workspace()
+{
+	release();
+}
+void Workspace::allocate()
+{
+	release();
+	for (const auto& req : requests)
+		total += (req.bytes + alignment - 1) / alignment * alignment;
+
+	// Extra alignment bytes keep the first buffer aligned
+	block = new char[total + alignment];
+	memset(block, 0, total + alignment);
+	char* ptr = block + (alignment - reinterpret_cast<size_t>(block) % alignment) % alignment;
+	for (const auto& req : requests)
+	{
+		req.assign(ptr);
+		ptr += (req.bytes + alignment - 1) / alignment * alignment;
+	}
+}
+void Workspace::release()
+{
+	delete[] block;
+	block = NULL;
+	total = 0;
+	for (const auto& req : requests)
+		req.assign(NULL);
+}
+
+#ifdef STOCH_COUNT_ALLOCS
+#include <atomic>
+
+// malloc / calloc / realloc of C code (ADOL-C) bypass these and stay uncounted
+
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t bytes)
+{
+	allocations++;
+	if (void* ptr = malloc(bytes ? bytes : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t bytes)
+{
+	return operator new(bytes);
+}
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+	allocations++;
+	return malloc(bytes ? bytes : 1);
+}
+void* operator new[](size_t bytes, const std::nothrow_t& tag) noexcept
+{
+	return operator new(bytes, tag);
+}
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+size_t alloc_counter::get()
+{
+	return allocations;
+}
+bool alloc_counter::isEnabled()
+{
+	return true;
+}
+#else
+size_t alloc_counter::get()
+{
+	return 0;
+}
+bool alloc_counter::isEnabled()
+{
+	return false;
+}
+#endif
@@ -0,0 +1,53 @@
+#ifndef WORKSPACE_HPP_
+#define WORKSPACE_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Arena for work buffers of a method: all of them are carved out of one aligned block.
+// Buffers are registered with add() and get their addresses in allocate(), they live until release().
+class Workspace
+{
+public:
+	static const size_t alignment = 64;
+protected:
+	struct Request
+	{
+		// Sets the registered pointer of its own type, NULL on release
+		std::function<void(char*)> assign;
+		size_t bytes;
+	};
+	std::vector<Request> requests;
+	char* block;
+	size_t total;
+public:
+	Workspace();
+	~Workspace();
+	Workspace(const Workspace&) = delete;
+	Workspace& operator=(const Workspace&) = delete;
+
+	template <typename T>
+	void add(T*& ptr, const size_t n)
+	{
+		ptr = NULL;
+		T** dst = &ptr;
+		requests.push_back({ [dst](char* buf) { *dst = reinterpret_cast<T*>(buf); }, n * sizeof(T) });
+	};
+	// Single zeroed allocation for all registered buffers
+	void allocate();
+	void release();
+
+	inline size_t getMemory() const { return total; };
+};
+
+// Number of heap allocations made through operator new,
+// counted only if the build defines STOCH_COUNT_ALLOCS (test hook for allocation-free loops, see tests/AllocTest.cpp).
+// Only operator new / delete are replaced: C-level malloc, e.g. ADOL-C tapes and sparse_jac buffers, is not counted
+namespace alloc_counter
+{
+	size_t get();
+	bool isEnabled();
+};
+
+#endif /* WORKSPACE_HPP_ */
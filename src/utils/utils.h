@@ -114,38 +114,36 @@ struct sort_pair_second {
     }
 };
 
-inline Interpolate* setDataset(vector< pair<double,double> >& vec, const double xDim, const double yDim)
+inline Interpolate* setDataset(vector< pair<double,double> >& vec, const double xDim, const double yDim,
+								const Interpolate::Method method = Interpolate::LINEAR)
 {
 	sort(vec.begin(), vec.end(), sort_pair_first());
 
 	const size_t N = vec.size();
-	double* x = new double [N];
-	double* y  = new double [N];
-
+	vector<double> x(N), y(N);
 	for (size_t i = 0; i < N; i++)
 	{
 		x[i] = vec[i].first / xDim;
 		y[i] = vec[i].second / yDim;
 	}
 
-	return new Interpolate(x, y, N);
+	return new Interpolate(std::move(x), std::move(y), method);
 };
 
-inline Interpolate* setInvDataset(vector< pair<double,double> >& vec, const double xDim, const double yDim)
+inline Interpolate* setInvDataset(vector< pair<double,double> >& vec, const double xDim, const double yDim,
+								const Interpolate::Method method = Interpolate::LINEAR)
 {
 	sort(vec.begin(), vec.end(), sort_pair_second());
 
 	const size_t N = vec.size();
-	double* x = new double [N];
-	double* y  = new double [N];
-
+	vector<double> x(N), y(N);
 	for (size_t i = 0; i < N; i++)
 	{
 		x[i] = vec[i].second / xDim;
 		y[i] = vec[i].first / yDim;
 	}
 
-	return new Interpolate(x, y, N);
+	return new Interpolate(std::move(x), std::move(y), method);
 };
 
 #endif /* UTILS_H_ */
\ No newline at end of file
@@ -0,0 +1,80 @@
+// Runs a few steps of tests/alloc.ini and checks that p0 & p2 Newton iterations reusing the tape
+// make no heap allocations through operator new (see alloc_counter, malloc of ADOL-C is not seen).
+// Built by tests/alloc_test.vcxproj with STOCH_COUNT_ALLOCS, run from the repository root:
+//	alloc_test [scenario.ini], exit code 0 on success
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#include "paralution.hpp"
+#include "src/Scenario.hpp"
+#include "src/utils/Comm.hpp"
+#include "src/utils/Workspace.hpp"
+#include "src/model/stoch_oil/StochOilMethod.hpp"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	if (!alloc_counter::isEnabled())
+	{
+		cerr << "FAIL: built without STOCH_COUNT_ALLOCS" << endl;
+		return 1;
+	}
+	// Counter has to see allocations of this binary at all
+	const size_t before = alloc_counter::get();
+	int* volatile probe = new int(0);
+	delete probe;
+	if (alloc_counter::get() == before)
+	{
+		cerr << "FAIL: operator new is not counted" << endl;
+		return 1;
+	}
+
+	comm::init(&argc, &argv);
+	size_t allocations = 0;
+	int iterations = 0;
+	paralution::init_paralution();
+	try
+	{
+		const std::string fileName = (argc > 1 ? argv[1] : "tests/alloc.ini");
+		Config cfg(fileName);
+		if (scenario::getIssueType(cfg) != scenario::STOCH_OIL)
+			throw std::runtime_error(fileName + ": stoch_oil issue expected");
+		stoch_oil::Properties props;
+		scenario::load(cfg, props);
+
+		auto model = std::make_shared<stoch_oil::StochOil>();
+		model->load(props);
+		model->setSnapshotter(model.get());
+		stoch_oil::StochOilMethod method(model.get());
+		method.setAssemblyThreads(props.assembly_threads);
+		method.start();
+
+		allocations = method.getSteadyAllocations();
+		iterations = method.getSteadyIterations();
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "FAIL: " << e.what() << endl;
+		paralution::stop_paralution();
+		comm::finalize();
+		return 1;
+	}
+	paralution::stop_paralution();
+	comm::finalize();
+
+	cout << allocations << " heap allocations in " << iterations << " steady-state iterations" << endl;
+	if (iterations == 0)
+	{
+		cerr << "FAIL: no iteration reused the tape, nothing was checked" << endl;
+		return 1;
+	}
+	if (allocations != 0)
+	{
+		cerr << "FAIL: steady-state iterations allocate" << endl;
+		return 1;
+	}
+	cout << "OK" << endl;
+	return 0;
+}